@@ -9,17 +9,34 @@
 /** An ID tracks an element of data in the CECS system */
 typedef uint64_t cecs_id_t;
 
-/** Represents an object that composes over components */
+/** Represents an object that composes over components. The low 32 bits are an
+ * index into the entity table, and the high 32 bits are the generation of the
+ * index, which changes whenever the entity using it is destroyed. */
 typedef cecs_id_t cecs_entity_t;
 
 #define CECS_ENTITY_INVALID ((cecs_entity_t)0u)
 
+/** Build an entity handle from an index and a generation */
+#define CECS_ENTITY(index, generation) \
+    ((cecs_entity_t)(((cecs_entity_t)(generation) << 32u) | (cecs_entity_t)(index)))
+
+/** Get the index of the given entity in the entity table */
+#define CECS_ENTITY_INDEX(entity) ((uint32_t)((entity) & (cecs_entity_t)0xFFFFFFFFu))
+
+/** Get the generation of the given entity's index */
+#define CECS_ENTITY_GENERATION(entity) ((uint32_t)((entity) >> 32u))
+
 /** A component is a struct of data that can be composed to form an entity's
  * state */
 typedef cecs_id_t cecs_component_t;
 
 #define CECS_COMPONENT_INVALID ((cecs_component_t)0u)
 
+/** A tick counts the changes made to a world. Every write is stamped with the
+ * world's current tick, so systems can find what changed since they last ran.
+ * Tick 0 means never written. */
+typedef uint64_t cecs_tick_t;
+
 /** Used to track the ID that will be assigned to the next component defined */
 extern cecs_component_t CECS_NEXT_COMPONENT_ID;
 
@@ -28,7 +45,11 @@ extern cecs_component_t CECS_NEXT_COMPONENT_ID;
 #define CECS_SIZE_OF(type) __cecs_##type##_size
 
 
-#define CECS_N_COMPONENTS ((cecs_component_t)1024u)
+/** Maximum number of component types, which sets the size of a signature. May
+ * be overridden at build time; must be a multiple of 64. */
+#ifndef CECS_N_COMPONENTS
+#define CECS_N_COMPONENTS 1024u
+#endif
 #define CECS_MAX_COMPONENT \
     ((cecs_component_t)(CECS_N_COMPONENTS - (cecs_component_t)1u))
 
@@ -51,7 +72,7 @@ extern cecs_component_t CECS_NEXT_COMPONENT_ID;
 /** Initialize a component. This should be done once at application startup. */
 #define CECS_COMPONENT(type)                                         \
     CECS_ID_OF(type) = (cecs_component_t)(CECS_NEXT_COMPONENT_ID++); \
-    cecs_register_component(CECS_ID_OF(type), CECS_SIZE_OF(type))
+    cecs_register_component(CECS_ID_OF(type), CECS_SIZE_OF(type), #type)
 
 
 #define FE_0(WHAT)
@@ -75,77 +96,874 @@ extern cecs_component_t CECS_NEXT_COMPONENT_ID;
 #define FOR_EACH_RSEQ_N()                                          9, 8, 7, 6, 5, 4, 3, 2, 1, 0
 
 
+/** Get the component of the specified type for the given entity in the given
+ * world */
+#define cecs_get_in(world, entity, type) \
+    ((type *)_cecs_get(world, entity, CECS_ID_OF(type)))
+
+/** Get the component of the specified type for the given entity in the given
+ * world for reading only, which isn't recorded as a change */
+#define cecs_get_const_in(world, entity, type) \
+    ((const type *)_cecs_get_const(world, entity, CECS_ID_OF(type)))
+
+/** Log the removals of the specified component in the given world */
+#define cecs_track_removed_in(world, type) \
+    _cecs_track_removed(world, CECS_ID_OF(type))
+
+/** Get an iterator over the entities the specified component was removed from
+ * in the given world at or after tick `since` */
+#define cecs_query_removed_in(world, it, type, since) \
+    _cecs_query_removed(world, it, CECS_ID_OF(type), since)
+
+/** Returns true if the given entity in the given world has the specified
+ * component, which may be a tag */
+#define cecs_has_in(world, entity, type) \
+    _cecs_has(world, entity, CECS_ID_OF(type))
+
+/** Enable the specified component of the given entity in the given world */
+#define cecs_enable_in(world, entity, type) \
+    _cecs_set_enabled(world, entity, CECS_ID_OF(type), true)
+
+/** Disable the specified component of the given entity in the given world */
+#define cecs_disable_in(world, entity, type) \
+    _cecs_set_enabled(world, entity, CECS_ID_OF(type), false)
+
+/** Returns true if the given entity in the given world has the specified
+ * component and it is enabled */
+#define cecs_is_enabled_in(world, entity, type) \
+    _cecs_is_enabled(world, entity, CECS_ID_OF(type))
+
+/** Create a new entity with the given components in the given world */
+#define cecs_create_in(world, ...) \
+    _cecs_create(world, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Create `count` entities with the given components in the given world,
+ * writing their handles to `entities` and copying their initial data from
+ * `data`, if either isn't NULL */
+#define cecs_create_n_in(world, count, entities, data, ...) \
+    _cecs_create_n(world, count, entities, data, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Add one or more components to the given entity in the given world */
+#define cecs_add_in(world, entity, ...) \
+    _cecs_add(world, entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Remove one or more components from the given entity in the given world */
+#define cecs_remove_in(world, entity, ...) \
+    _cecs_remove(world, entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Reserve room for `n_rows` entities in the given world's table of the
+ * archetype with exactly the given components */
+#define cecs_reserve_in(world, n_rows, ...) \
+    _cecs_reserve(world, n_rows, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Sort the rows of every archetype in the given world implementing the given
+ * component by its data */
+#define cecs_sort_by_in(world, type, compare) \
+    _cecs_sort_by(world, CECS_ID_OF(type), compare)
+
+/** Measure the memory held by the columns of the specified component in the
+ * given world */
+#define cecs_component_memory_in(world, type, usage) \
+    _cecs_component_memory(world, CECS_ID_OF(type), usage)
+
+/** Get an iterator over entities in the given world that have the specified
+ * components */
+#define cecs_query_in(world, it, ...) \
+    _cecs_query(world, it, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Assign a value to the specified component for the given entity in the given
+ * world */
+#define cecs_set_in(world, entity, type, source) \
+    _cecs_set(world, entity, CECS_ID_OF(type), source)
+
+/** Zero out the specified component for the given entity in the given world */
+#define cecs_zero_in(world, entity, ...) \
+    _cecs_zero(world, entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Create a persistent query over the entities in the given world that have
+ * the specified components */
+#define cecs_query_create_in(world, ...) \
+    _cecs_query_create(world, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Get a chunk iterator over the entities in the given world that have the
+ * specified components */
+#define cecs_query_chunks_in(world, it, ...) \
+    _cecs_query_chunks(world, it, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+
 /** Get the component of the specified type for the given entity, drawing from
  * the given query result */
-#define cecs_get(entity, type) (type *)_cecs_get(entity, CECS_ID_OF(type))
+#define cecs_get(entity, type) cecs_get_in(cecs_default_world(), entity, type)
+
+/** Get the component of the specified type for the given entity for reading
+ * only, which isn't recorded as a change */
+#define cecs_get_const(entity, type) \
+    cecs_get_const_in(cecs_default_world(), entity, type)
+
+/** Log the removals of the specified component */
+#define cecs_track_removed(type) cecs_track_removed_in(cecs_default_world(), type)
+
+/** Get an iterator over the entities the specified component was removed from
+ * at or after tick `since` */
+#define cecs_query_removed(it, type, since) \
+    cecs_query_removed_in(cecs_default_world(), it, type, since)
+
+/** Returns true if the given entity has the specified component, which may be
+ * a tag */
+#define cecs_has(entity, type) cecs_has_in(cecs_default_world(), entity, type)
+
+/** Enable the specified component of the given entity */
+#define cecs_enable(entity, type) cecs_enable_in(cecs_default_world(), entity, type)
+
+/** Disable the specified component of the given entity, so entity iterators
+ * over it skip the entity, without moving it to another archetype */
+#define cecs_disable(entity, type) cecs_disable_in(cecs_default_world(), entity, type)
+
+/** Returns true if the given entity has the specified component and it is
+ * enabled */
+#define cecs_is_enabled(entity, type) \
+    cecs_is_enabled_in(cecs_default_world(), entity, type)
 
 /** Create a new entity with the given components */
-#define cecs_create(...) \
-    _cecs_create(FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+#define cecs_create(...) cecs_create_in(cecs_default_world(), __VA_ARGS__)
+
+/** Create `count` entities with the given components, writing their handles
+ * to `entities` and copying their initial data from `data`, if either isn't
+ * NULL */
+#define cecs_create_n(count, entities, data, ...) \
+    cecs_create_n_in(cecs_default_world(), count, entities, data, __VA_ARGS__)
 
 /** Add one or more components to the given entity */
-#define cecs_add(entity, ...) \
-    _cecs_add(entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+#define cecs_add(entity, ...) cecs_add_in(cecs_default_world(), entity, __VA_ARGS__)
 
 /** Remove one or more components from the given entity */
 #define cecs_remove(entity, ...) \
-    _cecs_remove(entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+    cecs_remove_in(cecs_default_world(), entity, __VA_ARGS__)
+
+/** Destroy the given entity, removing it and its component data from its
+ * archetype. Returns false if the entity doesn't exist. */
+#define cecs_destroy(entity) cecs_destroy_in(cecs_default_world(), entity)
+
+/** Returns true if the given entity handle refers to a live entity, i.e. it
+ * hasn't been destroyed */
+#define cecs_is_alive(entity) cecs_is_alive_in(cecs_default_world(), entity)
+
+/** Reserve room for `n_rows` entities in the table of the archetype with
+ * exactly the given components */
+#define cecs_reserve(n_rows, ...) \
+    cecs_reserve_in(cecs_default_world(), n_rows, __VA_ARGS__)
+
+/** Sort the rows of every archetype implementing the given component by its
+ * data */
+#define cecs_sort_by(type, compare) \
+    cecs_sort_by_in(cecs_default_world(), type, compare)
+
+/** Measure the memory held by the columns of the specified component */
+#define cecs_component_memory(type, usage) \
+    cecs_component_memory_in(cecs_default_world(), type, usage)
 
 /** Get an iterator over entities that have the specified components */
-#define cecs_query(it, ...) \
-    _cecs_query(it, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+#define cecs_query(it, ...) cecs_query_in(cecs_default_world(), it, __VA_ARGS__)
 
 /** Assign a value to the specified component for the given entity */
 #define cecs_set(entity, type, source) \
-    _cecs_set(entity, CECS_ID_OF(type), source)
+    cecs_set_in(cecs_default_world(), entity, type, source)
 
 /** Zero out the specified component for the given entity */
-#define cecs_zero(entity, ...) \
-    _cecs_zero(entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+#define cecs_zero(entity, ...) cecs_zero_in(cecs_default_world(), entity, __VA_ARGS__)
+
+/** Create a persistent query over the entities that have the specified
+ * components */
+#define cecs_query_create(...) \
+    cecs_query_create_in(cecs_default_world(), __VA_ARGS__)
+
+/** Get a chunk iterator over the entities that have the specified components */
+#define cecs_query_chunks(it, ...) \
+    cecs_query_chunks_in(cecs_default_world(), it, __VA_ARGS__)
+
+/** Save the default world to a snapshot file at the specified path */
+#define cecs_snapshot_save(path) cecs_snapshot_save_in(cecs_default_world(), path)
+
+/** Load a snapshot into the default world, which must never have had an
+ * entity */
+#define cecs_snapshot_load(path) cecs_snapshot_load_in(cecs_default_world(), path)
+
+/** Get a pointer to the first element of the given chunk's column of the
+ * specified component type, or NULL if the chunk doesn't have the component */
+#define cecs_chunk_column(chunk, type) \
+    ((type *)_cecs_chunk_column(chunk, CECS_ID_OF(type)))
+
+/** Get a read-only pointer to the first element of the given chunk's column of
+ * the specified component type, which isn't recorded as a change */
+#define cecs_chunk_column_const(chunk, type) \
+    ((const type *)_cecs_chunk_column_const(chunk, CECS_ID_OF(type)))
+
+/** Get an iterator over the entities matching a persistent query in chunks
+ * where the specified component was written at or after tick `since` */
+#define cecs_query_iter_changed(query, it, type, since) \
+    _cecs_query_iter_changed(query, it, CECS_ID_OF(type), since)
+
+/** Get a chunk iterator over the chunks of a persistent query where the
+ * specified component was written at or after tick `since` */
+#define cecs_query_iter_chunks_changed(query, it, type, since) \
+    _cecs_query_iter_chunks_changed(query, it, CECS_ID_OF(type), since)
+
+/** Get the enabled bits of the given chunk's rows for the specified component
+ * type, or NULL if it is enabled on every row */
+#define cecs_chunk_enabled(chunk, type) \
+    _cecs_chunk_enabled(chunk, CECS_ID_OF(type))
+
+/** Returns true if row `i` of a chunk is enabled in bits returned by
+ * cecs_chunk_enabled() */
+#define CECS_CHUNK_ROW_ENABLED(bits, i) \
+    (!(bits) || (((bits)[(i) / 64u] >> ((i) % 64u)) & 1u))
+
+/** Add one or more components to every entity matching a persistent query */
+#define cecs_query_add(query, ...) \
+    _cecs_query_add(query, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Remove one or more components from every entity matching a persistent
+ * query */
+#define cecs_query_remove(query, ...) \
+    _cecs_query_remove(query, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Record the creation of an entity with the given components in a command
+ * buffer, returning a placeholder handle for it */
+#define cecs_cmd_create(buffer, ...) \
+    _cecs_cmd_create(buffer, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Record adding one or more components to the given entity in a command
+ * buffer */
+#define cecs_cmd_add(buffer, entity, ...) \
+    _cecs_cmd_add(buffer, entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Record removing one or more components from the given entity in a command
+ * buffer */
+#define cecs_cmd_remove(buffer, entity, ...) \
+    _cecs_cmd_remove(buffer, entity, FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__))
+
+/** Record assigning a value to the specified component of the given entity in
+ * a command buffer */
+#define cecs_cmd_set(buffer, entity, type, source) \
+    _cecs_cmd_set(buffer, entity, CECS_ID_OF(type), source)
+
+/** List the components a query requires, for cecs_query_create_terms() */
+#define cecs_with(...) \
+    (cecs_component_t)FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__)
+
+/** List the components a query excludes, for cecs_query_create_terms() */
+#define cecs_without(...) \
+    (cecs_component_t)FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__)
+
+/** List the components a query may use if present, for
+ * cecs_query_create_terms() */
+#define cecs_optional(...) \
+    (cecs_component_t)FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__)
+
+/** List the components of which a query requires at least one, for
+ * cecs_query_create_terms() */
+#define cecs_any_of(...) \
+    (cecs_component_t)FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__)
+
+/** Create a persistent query over the entities in the given world matching the
+ * given terms, e.g. `cecs_query_create_terms_in(world, cecs_with(pos_t),
+ * cecs_without(is_alive_t), cecs_no_components(), cecs_no_components())` */
+#define cecs_query_create_terms_in(world, ...) _cecs_query_create_terms(world, __VA_ARGS__)
+
+/** Create a persistent query over the entities matching the given terms, which
+ * are given in the same order as for cecs_query_create_terms_in() */
+#define cecs_query_create_terms(...) \
+    cecs_query_create_terms_in(cecs_default_world(), __VA_ARGS__)
+
+/** List the components a system reads, for cecs_system_register() */
+#define cecs_reads(...) \
+    (cecs_component_t)FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__)
+
+/** List the components a system writes, for cecs_system_register() */
+#define cecs_writes(...) \
+    (cecs_component_t)FOR_EACH_NARG(__VA_ARGS__), FOR_EACH(CECS_ID_OF, __VA_ARGS__)
+
+/** Stand-in for a list of components, such as cecs_reads() or cecs_without(),
+ * naming no components */
+#define cecs_no_components() (cecs_component_t)0u
+
+/** Register a system to be run by cecs_progress(), declaring the components it
+ * reads and writes, e.g.
+ * `cecs_system_register(move, NULL, cecs_reads(vel_t), cecs_writes(pos_t))` */
+#define cecs_system_register(fn, ctx, reads, writes) \
+    _cecs_system_register(fn, ctx, reads, writes)
 
 #define cecs_set_new(entity, type, source) \
     cecs_add(entity, type);                \
     cecs_set(entity, type, source)
 
 
-struct cecs_entity_set;
 
-/** Iterator over a set of entities */
+/** Maximum number of components that can be named in a single query */
+#define CECS_MAX_QUERY_COMPONENTS ((size_t)9u)
+
+/** Maximum number of rows yielded in a single chunk */
+#define CECS_CHUNK_ROWS ((size_t)1024u)
+
+/** A world owns a set of entities, their component data and the queries over
+ * them. Worlds are independent of each other and may be used from different
+ * threads at once; component registrations are shared by all worlds. */
+typedef struct cecs_world cecs_world_t;
+
+struct cecs_archetype;
+
+/** A persistent query, which keeps track of the archetypes implementing its
+ * components as they are created */
+typedef struct cecs_query cecs_query_t;
+
+/** A contiguous range of entities from a single archetype, whose component data
+ * is laid out as one packed array per component */
+typedef struct {
+    /** Number of entities in the chunk */
+    size_t count;
+    /** The entities in the chunk, in the same order as the column data */
+    const cecs_entity_t *entities;
+    struct cecs_archetype *archetype;
+    /** Row of the first entity of the chunk in its archetype's table */
+    size_t row;
+} cecs_chunk_t;
+
+/** Which chunks a chunk iterator yields, by when they were last touched */
+typedef enum {
+    /** Yield every chunk */
+    CECS_FILTER_NONE,
+    /** Yield chunks where a component was written at or after a tick */
+    CECS_FILTER_CHANGED,
+    /** Yield chunks that had rows added at or after a tick */
+    CECS_FILTER_ADDED,
+} cecs_filter_t;
+
+/** Iterator over the chunks of the archetypes matching a set of components */
+typedef struct {
+    /** World whose archetypes are iterated */
+    cecs_world_t *world;
+    /** Persistent query whose archetypes are iterated, or NULL to match
+     * `components` against every archetype */
+    const cecs_query_t *query;
+    cecs_component_t n;
+    cecs_component_t components[CECS_MAX_QUERY_COMPONENTS];
+    /** Component whose archetypes are checked against `components`, being
+     * the one implemented by the fewest, or CECS_COMPONENT_INVALID to check
+     * every archetype */
+    cecs_component_t lead;
+    size_t i_entry;
+    size_t row;
+    /** Filter on when the chunks yielded were last touched */
+    cecs_filter_t filter;
+    /** Component whose writes are checked by CECS_FILTER_CHANGED */
+    cecs_component_t filter_id;
+    /** Earliest tick a chunk must have been touched at to be yielded */
+    cecs_tick_t since;
+} cecs_chunk_iter_t;
+
+/** Iterator over the entities of the archetypes matching a set of components.
+ * Entities with any of the components disabled are skipped. The entity most
+ * recently returned may be removed from its archetype during iteration; other
+ * structural changes are not allowed. */
 typedef struct {
-    struct cecs_entity_set *set;
-    size_t i_bucket;
+    cecs_chunk_iter_t chunks;
+    /** Chunk of the archetype currently being iterated */
+    cecs_chunk_t chunk;
+    /** Index of the next entity to return within `chunk` */
     size_t i_entity;
+    /** The entity most recently returned */
+    cecs_entity_t entity;
 } cecs_iter_t;
 
+/** Iterator over the entities a component was removed from, including by
+ * destroying them */
+typedef struct {
+    cecs_world_t *world;
+    cecs_component_t id;
+    /** Index of the next entry of the world's removed log to check */
+    size_t i;
+} cecs_removed_iter_t;
+
+/** Growable buffer a delta of world changes is encoded into. Reusing one
+ * across encodes avoids reallocating it every time. */
+typedef struct {
+    uint8_t *data;
+    /** Number of bytes of the encoded delta */
+    size_t size;
+    /** Number of bytes allocated */
+    size_t cap;
+} cecs_delta_buffer_t;
+
+
+/** Hooks through which CECS allocates all of its memory. Each is passed `ctx`.
+ * `realloc` must accept a NULL pointer like the C library's. A hook returning
+ * NULL aborts the program, since a failed allocation can't be unwound from the
+ * middle of a structural change. */
+typedef struct {
+    void *(*alloc)(const size_t size, void *ctx);
+    void *(*realloc)(void *ptr, const size_t size, void *ctx);
+    void (*free)(void *ptr, void *ctx);
+    void *ctx;
+} cecs_allocator_t;
+
+/** Set the hooks used for all the memory CECS allocates, or restore the C
+ * library's if `allocator` is NULL. Must be called before anything is
+ * allocated, i.e. before the first world, entity, query, command buffer or
+ * system is created, since memory must be freed by the hooks that allocated
+ * it. */
+void cecs_set_allocator(const cecs_allocator_t *allocator);
+
+/** Allocate memory through the allocator hooks */
+void *cecs_alloc(const size_t size);
+
+/** Resize memory allocated through the allocator hooks */
+void *cecs_realloc(void *ptr, const size_t size);
+
+/** Free memory allocated through the allocator hooks. Does nothing if `ptr`
+ * is NULL. */
+void cecs_free(void *ptr);
+
+/** Register the given component ID with the specified size. The name, which
+ * must outlive the library's use of it, identifies the component in
+ * snapshots. */
+void cecs_register_component(const cecs_component_t id, const size_t size, const char *name);
+
+/** Get the world used by the API functions that don't name one */
+cecs_world_t *cecs_default_world(void);
+
+/** Create a new, empty world */
+cecs_world_t *cecs_world_create(void);
+
+/** Destroy the given world, releasing its entities, archetypes and persistent
+ * queries. The default world can't be destroyed. */
+void cecs_world_destroy(cecs_world_t *world);
+
+/** Allocate temporary memory from the given world's frame arena, aligned to 16
+ * bytes. It stays valid until the arena is reset, which cecs_progress() does
+ * at the start of every frame, and is never freed individually. May be called
+ * from systems and parallel callbacks running at the same time. */
+void *cecs_frame_alloc(cecs_world_t *world, const size_t size);
+
+/** Release everything allocated from the given world's frame arena. Its memory
+ * is kept for later frames. */
+void cecs_frame_reset(cecs_world_t *world);
+
+/** Bytes of memory holding live data, out of the bytes allocated */
+typedef struct {
+    size_t used;
+    size_t allocated;
+} cecs_memory_usage_t;
 
-/** Register the given component ID with the specified size */
-void cecs_register_component(const cecs_component_t id, const size_t size);
+/** Memory held by a world, by what it is used for */
+typedef struct {
+    /** Component data in the archetype tables */
+    cecs_memory_usage_t columns;
+    /** The rest of the archetype tables: entity arrays, change ticks, enabled
+     * masks and edges */
+    cecs_memory_usage_t tables;
+    /** Pages of the map from entities to their rows */
+    cecs_memory_usage_t entity_index;
+    /** Indices of destroyed entities awaiting reuse */
+    cecs_memory_usage_t free_list;
+    /** Maps from signatures and components to archetypes */
+    cecs_memory_usage_t archetype_index;
+    /** Archetype lists of persistent queries */
+    cecs_memory_usage_t queries;
+    /** Pools holding the archetypes and persistent queries themselves */
+    cecs_memory_usage_t pools;
+    cecs_memory_usage_t frame_arena;
+    /** Log of removed components */
+    cecs_memory_usage_t removed_log;
+    /** Buffers reused between queries */
+    cecs_memory_usage_t scratch;
+    /** Sum of all of the above */
+    cecs_memory_usage_t total;
+} cecs_memory_stats_t;
+
+/** Measure the memory held by the given world */
+void cecs_memory_stats(cecs_world_t *world, cecs_memory_stats_t *stats);
+
+/** Measure the memory held by the table of the given archetype, e.g. a chunk's
+ * `archetype` */
+void cecs_archetype_memory(const struct cecs_archetype *archetype, cecs_memory_usage_t *usage);
+
+/** Measure the memory held by the columns of the given component in the given
+ * world */
+void _cecs_component_memory(cecs_world_t *world, const cecs_component_t id, cecs_memory_usage_t *usage);
+
+/** Reserve room for exactly `n_rows` entities in the table of the archetype
+ * with the given components, creating the archetype if needed, so filling it
+ * doesn't reallocate the table. Does nothing if the table is already big
+ * enough. */
+void _cecs_reserve(cecs_world_t *world, const size_t n_rows, const cecs_component_t n, ...);
+
+/** Shrink the tables of the given world to fit their entities, freeing those
+ * of empty archetypes, and release its spare bookkeeping and frame arena */
+void cecs_shrink(cecs_world_t *world);
+
+/** Incrementally compact the storage of the given world, spending about
+ * `budget_us` microseconds per call and resuming where the last call stopped.
+ * Tables left mostly empty are shrunk and those of empty archetypes freed,
+ * and the free list is ordered so new entities reuse the lowest indices.
+ * Meant to be called at the end of a frame, never while iterating. Returns
+ * true when a full pass over the world has been completed. */
+bool cecs_compact(cecs_world_t *world, const uint64_t budget_us);
+
+/** Orders two components of the same type, returning a negative number if
+ * `lhs` sorts before `rhs`, a positive number if after and 0 if equal */
+typedef int (*cecs_compare_fn)(const void *lhs, const void *rhs);
+
+/** Reorder the rows of every archetype implementing the specified component so
+ * iterating them visits its data in the order given by `compare`, moving the
+ * entities and all their components together. The sort is stable and close to
+ * linear on rows that are still nearly sorted from a previous call, so it can
+ * be rerun every frame to keep e.g. spatially close entities adjacent. The
+ * component must have data, and the world must not be iterated meanwhile. */
+void _cecs_sort_by(cecs_world_t *world, const cecs_component_t id, cecs_compare_fn compare);
+
+/** Release everything CECS has allocated: the default world's contents, the
+ * worker threads and the registered systems. The default world is left empty
+ * and the library may be used again; component registrations are kept. Worlds
+ * created with cecs_world_create() must be destroyed first. Must not be called
+ * while parallel work is running. */
+void cecs_shutdown(void);
+
+/** Save the given world to a snapshot file at the specified path. Snapshots
+ * hold every entity with its components, disabled state and handle, laid out
+ * as one block per archetype column. Change history and removal logs aren't
+ * saved. Returns false if the file couldn't be written. */
+bool cecs_snapshot_save_in(cecs_world_t *world, const char *path);
+
+/** Load a snapshot into the given world, which must never have had an entity.
+ * Components are matched by name and must have the same size as when saved.
+ * The file is mapped and each column copied into place whole, so loading
+ * costs little more than reading the file. Entities keep their handles and
+ * are seen as added at the load. Returns false, leaving the world untouched,
+ * if the file can't be read, is malformed or doesn't match the registered
+ * components. */
+bool cecs_snapshot_load_in(cecs_world_t *world, const char *path);
+
+/** Encode the changes made to the given world at or after tick `since` into
+ * the buffer, replacing its contents. A delta holds the entities destroyed,
+ * the entities created or moved to another archetype with all their data, the
+ * columns written to, and the enabled state of components toggled, tags
+ * included, at the granularity of CECS_CHUNK_ROWS rows. Destroys
+ * are only included if tracked with cecs_track_destroyed(). Applying a delta
+ * twice is harmless, so consecutive deltas may be encoded since the tick the
+ * previous one was encoded at. */
+void cecs_delta_encode(cecs_world_t *world, const cecs_tick_t since, cecs_delta_buffer_t *buffer);
+
+/** Encode the changes made to the given world at or after tick `since` and
+ * write them to a file descriptor, returning false if the write failed */
+bool cecs_delta_encode_fd(cecs_world_t *world, const cecs_tick_t since, const int fd);
+
+/** Free the memory held by a delta buffer, leaving it empty */
+void cecs_delta_buffer_free(cecs_delta_buffer_t *buffer);
+
+/** Apply a delta encoded by cecs_delta_encode() to the given world, creating,
+ * moving and destroying entities under the handles they have in the world it
+ * was encoded from, which may only be created in the receiving world through
+ * deltas or a snapshot. Components are matched by name. Returns false, leaving
+ * the world untouched, if the delta is malformed or doesn't match the
+ * registered components. */
+bool cecs_delta_apply(cecs_world_t *world, const void *delta, const size_t size);
+
+/** Read one delta written by cecs_delta_encode_fd() from a file descriptor
+ * and apply it to the given world. The header is checked before the rest is
+ * read, and memory for it comes straight from the allocator hooks, so a
+ * corrupt stream fails rather than aborting. Returns false at the end of the
+ * file, if the delta can't be allocated or if it can't be applied. */
+bool cecs_delta_apply_fd(cecs_world_t *world, const int fd);
+
+/** Stop the worker threads and unregister every system, releasing their
+ * memory. Called by cecs_shutdown(). */
+void cecs_parallel_shutdown(void);
+
+/** Occupancy and probe lengths of one of a world's hash maps */
+typedef struct {
+    /** Number of values stored */
+    size_t count;
+    /** Number of slots */
+    size_t capacity;
+    /** Slots probed to find every value once, so the mean probe length is
+     * `total_probes / count` */
+    size_t total_probes;
+    /** Length of the longest probe sequence */
+    size_t max_probe;
+} cecs_map_stats_t;
+
+/** Measure the occupancy and probe lengths of the map from signatures to
+ * archetypes in the given world */
+void cecs_archetype_map_stats(const cecs_world_t *world, cecs_map_stats_t *stats);
+
+/** Get the current tick of the given world, which is stamped on every change
+ * made to it */
+cecs_tick_t cecs_world_tick(const cecs_world_t *world);
+
+/** Advance the tick of the given world and return the new tick. cecs_progress()
+ * does this at the start of every frame. */
+cecs_tick_t cecs_world_advance_tick(cecs_world_t *world);
 
 /** Return an iterator over the entities representing the archetype specified in
  * the varargs parameter */
-cecs_entity_t _cecs_query(cecs_iter_t *it, const cecs_component_t n, ...);
+cecs_entity_t _cecs_query(cecs_world_t *world, cecs_iter_t *it, const cecs_component_t n, ...);
 
 /** Returns the next entity in the iterator, or CECS_ENTITY_INVALID if the end is reached */
 cecs_entity_t cecs_iter_next(cecs_iter_t *it);
 
+/** Return a chunk iterator over the archetypes implementing the components
+ * specified in the varargs parameter. Entities must not be created or change
+ * archetype while the iterator is in use. */
+void _cecs_query_chunks(cecs_world_t *world, cecs_chunk_iter_t *it, const cecs_component_t n, ...);
+
+/** Create a persistent query over the archetypes implementing the components
+ * specified in the varargs parameter */
+cecs_query_t *_cecs_query_create(cecs_world_t *world, const cecs_component_t n, ...);
+
+/** Create a persistent query from four terms, each given as a count followed
+ * by that many component IDs, in order: the components matching archetypes
+ * must all implement, the ones they must not implement, optional ones, and
+ * ones of which they must implement at least one unless the term is empty.
+ * Terms are tested once per archetype, so entities are never checked one by
+ * one. Chunk columns of optional components are NULL where they are missing,
+ * and entity iterators only skip rows whose required components are
+ * disabled. */
+cecs_query_t *_cecs_query_create_terms(cecs_world_t *world, ...);
+
+/** Destroy the given persistent query */
+void cecs_query_destroy(cecs_query_t *query);
+
+/** Return the number of entities matching the given persistent query */
+size_t cecs_query_count(const cecs_query_t *query);
+
+/** Return an iterator over the entities matching the given persistent query */
+void cecs_query_iter(const cecs_query_t *query, cecs_iter_t *it);
+
+/** Return a chunk iterator over the archetypes matching the given persistent
+ * query. Entities must not be created or change archetype while the iterator
+ * is in use. */
+void cecs_query_iter_chunks(const cecs_query_t *query, cecs_chunk_iter_t *it);
+
+/** Return an iterator over the entities matching the given persistent query in
+ * chunks where the specified component was written at or after tick `since`.
+ * Changes are tracked per chunk of CECS_CHUNK_ROWS rows, so untouched chunks
+ * are skipped whole, and rows of a touched chunk may not have changed
+ * themselves. Writes are any cecs_set(), cecs_zero(), enabling or disabling,
+ * adding the component, or taking a mutable pointer with cecs_get() or
+ * cecs_chunk_column(). Tags hold no data, so they count as written when
+ * added. Archetypes matched through an optional term that lack the component
+ * are skipped. */
+void _cecs_query_iter_changed(const cecs_query_t *query, cecs_iter_t *it, const cecs_component_t id, const cecs_tick_t since);
+
+/** Return a chunk iterator over the chunks of the given persistent query where
+ * the specified component was written at or after tick `since` */
+void _cecs_query_iter_chunks_changed(const cecs_query_t *query, cecs_chunk_iter_t *it, const cecs_component_t id, const cecs_tick_t since);
+
+/** Return an iterator over the entities matching the given persistent query in
+ * chunks that had entities added at or after tick `since`, either by creation
+ * or by moving in from another archetype */
+void cecs_query_iter_added(const cecs_query_t *query, cecs_iter_t *it, const cecs_tick_t since);
+
+/** Return a chunk iterator over the chunks of the given persistent query that
+ * had entities added at or after tick `since` */
+void cecs_query_iter_chunks_added(const cecs_query_t *query, cecs_chunk_iter_t *it, const cecs_tick_t since);
+
+/** Start logging the removals of the given component in the specified world,
+ * for _cecs_query_removed(). The log grows until trimmed. */
+void _cecs_track_removed(cecs_world_t *world, const cecs_component_t id);
+
+/** Return an iterator over the entities the given component was removed from
+ * at or after tick `since`, which may no longer be alive */
+void _cecs_query_removed(cecs_world_t *world, cecs_removed_iter_t *it, const cecs_component_t id, const cecs_tick_t since);
+
+/** Returns the next entity in the removed iterator, or CECS_ENTITY_INVALID if
+ * the end is reached */
+cecs_entity_t cecs_removed_next(cecs_removed_iter_t *it);
+
+/** Drop the removals logged before tick `before` in the given world */
+void cecs_trim_removed(cecs_world_t *world, const cecs_tick_t before);
+
+/** Start logging the entities destroyed in the given world, for
+ * cecs_query_destroyed() and deltas. Destroys share the removed log and are
+ * trimmed with cecs_trim_removed(). */
+void cecs_track_destroyed(cecs_world_t *world);
+
+/** Return an iterator over the entities destroyed in the given world at or
+ * after tick `since`, which must be tracked with cecs_track_destroyed() */
+void cecs_query_destroyed(cecs_world_t *world, cecs_removed_iter_t *it, const cecs_tick_t since);
+
+/** Add the given components to every entity matching the persistent query.
+ * Each matched archetype's whole table is moved to its destination with one
+ * copy per column. Returns the number of entities moved. Must not be called
+ * while iterating the query's world. */
+size_t _cecs_query_add(cecs_query_t *query, const cecs_component_t n, ...);
+
+/** Remove the given components from every entity matching the persistent
+ * query, moving whole tables like _cecs_query_add(). Returns the number of
+ * entities moved. */
+size_t _cecs_query_remove(cecs_query_t *query, const cecs_component_t n, ...);
+
+/** Destroy every entity matching the persistent query, emptying each matched
+ * archetype's table at once. Returns the number of entities destroyed. */
+size_t cecs_query_destroy_entities(cecs_query_t *query);
+
+/** Fill `chunk` with the next chunk in the iterator. Returns false if the end
+ * is reached. */
+bool cecs_chunk_next(cecs_chunk_iter_t *it, cecs_chunk_t *chunk);
+
+/** Get a pointer to the first element of the chunk's column for the given
+ * component ID, or NULL if the chunk's archetype doesn't implement it or it's a
+ * zero-sized tag, which has no data */
+void *_cecs_chunk_column(const cecs_chunk_t *chunk, const cecs_component_t id);
+
+/** Get a read-only pointer to the first element of the chunk's column for the
+ * given component ID, which unlike _cecs_chunk_column() isn't recorded as a
+ * change */
+const void *_cecs_chunk_column_const(const cecs_chunk_t *chunk, const cecs_component_t id);
+
+/** Get the enabled state of the given component for the chunk's rows, one bit
+ * per row starting at bit 0 of the first word, or NULL if it is enabled on
+ * every row. Chunk iterators yield disabled rows; use this to skip them. */
+const uint64_t *_cecs_chunk_enabled(const cecs_chunk_t *chunk, const cecs_component_t id);
+
 /** Get a pointer to the component implemented by the specified entity, drawing
  * from the given entity iterator over an archetype */
-void *_cecs_get(const cecs_entity_t entity, const cecs_component_t id);
+void *_cecs_get(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id);
+
+/** Get a read-only pointer to the component implemented by the specified
+ * entity, which unlike _cecs_get() isn't recorded as a change */
+const void *_cecs_get_const(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id);
 
 /** Create an entity with the given components */
-cecs_entity_t _cecs_create(const cecs_component_t n, ...);
+cecs_entity_t _cecs_create(cecs_world_t *world, const cecs_component_t n, ...);
+
+/** Callback run on a chunk by cecs_query_each_parallel(). `worker` is the
+ * index of the worker thread running it, below cecs_worker_count(), so
+ * callbacks can accumulate into per-worker state without locking. */
+typedef void (*cecs_chunk_fn)(const cecs_chunk_t *chunk, const size_t worker, void *ctx);
+
+/** Set the number of threads used to run parallel work, including the thread
+ * that starts it. 0 selects one per online processor, which is the default.
+ * Must not be called while parallel work is running. */
+void cecs_set_worker_count(const size_t n_workers);
+
+/** Get the number of threads used to run parallel work */
+size_t cecs_worker_count(void);
+
+/** Get the index of the worker the calling thread is running parallel work as,
+ * or 0 outside parallel work */
+size_t cecs_current_worker(void);
+
+/** Run `fn` on every chunk matching the persistent query, spread across the
+ * worker threads with work stealing, and return once all of them are done.
+ * Callbacks may read and write the chunk's columns but must not add, remove or
+ * destroy entities, since that would move rows under other workers. Threads
+ * running parallel queries on different worlds don't wait on each other; idle
+ * workers help whichever of them has chunks left. */
+void cecs_query_each_parallel(const cecs_query_t *query, cecs_chunk_fn fn, void *ctx);
+
+/** A command buffer records entity creation, destruction and component
+ * changes to apply later at a sync point, so they can be made while iterating
+ * or from worker threads. Each buffer must only be used by one thread at a
+ * time; give each worker its own. */
+typedef struct cecs_cmd_buffer cecs_cmd_buffer_t;
+
+/** Create an empty command buffer */
+cecs_cmd_buffer_t *cecs_cmd_buffer_create(void);
+
+/** Destroy the given command buffer, discarding any commands not applied */
+void cecs_cmd_buffer_destroy(cecs_cmd_buffer_t *buffer);
+
+/** Record the creation of an entity with the given components. Returns a
+ * placeholder handle which may be used in later commands of the same buffer,
+ * and resolved with cecs_cmd_buffer_resolve() once the buffer is applied. */
+cecs_entity_t _cecs_cmd_create(cecs_cmd_buffer_t *buffer, const cecs_component_t n, ...);
+
+/** Record adding the given components to the specified entity */
+void _cecs_cmd_add(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity, const cecs_component_t n, ...);
+
+/** Record removing the given components from the specified entity */
+void _cecs_cmd_remove(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity, const cecs_component_t n, ...);
+
+/** Record setting the given component data for the specified entity. The data
+ * is copied into the buffer, and written once the entity has the component. */
+void _cecs_cmd_set(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity, const cecs_component_t id, const void *data);
+
+/** Record destroying the specified entity */
+void cecs_cmd_destroy(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity);
+
+/** Apply the commands recorded in the given buffer to the specified world in
+ * one batch, and empty the buffer. Each entity's commands are reduced to a
+ * single move into its final archetype, and the moves are grouped by archetype
+ * so each table grows at most once. Commands on entities that no longer exist
+ * are dropped, and an entity both created and destroyed by the buffer is never
+ * made at all. */
+void cecs_cmd_buffer_apply(cecs_world_t *world, cecs_cmd_buffer_t *buffer);
+
+/** Get the entity created for a placeholder handle returned by the given
+ * buffer, valid from when the buffer is applied until the next command is
+ * recorded, or CECS_ENTITY_INVALID if the buffer also destroyed it. Handles
+ * that aren't placeholders are returned as-is. */
+cecs_entity_t cecs_cmd_buffer_resolve(const cecs_cmd_buffer_t *buffer, const cecs_entity_t entity);
+
+/** A system run by cecs_progress() against the world being progressed */
+typedef void (*cecs_system_fn)(cecs_world_t *world, void *ctx);
+
+/** Register a system along with the components it reads and writes, each given
+ * as a count followed by that many component IDs. Returns the system's index.
+ * May be called from a running system, in which case the new system runs from
+ * the next frame on. Systems that don't conflict, i.e. where neither writes a component the other
+ * reads or writes, may run at the same time; conflicting systems run in
+ * registration order. */
+size_t _cecs_system_register(cecs_system_fn fn, void *ctx, ...);
+
+/** Run every registered system once against the given world, spreading
+ * systems that don't conflict across the worker threads. Systems that run in
+ * parallel must not add, remove, create or destroy entities, and parallel
+ * queries started from a system run on that system's worker alone. Systems
+ * should read the components they don't write through the `_const` accessors,
+ * since mutable access stamps the component as changed. The world's tick is
+ * advanced and its frame arena reset before any system runs. Different worlds
+ * may be progressed from different threads at the same time, sharing the
+ * worker threads. */
+void cecs_progress(cecs_world_t *world);
+
+/** Destroy the given entity in the given world */
+bool cecs_destroy_in(cecs_world_t *world, const cecs_entity_t entity);
+
+/** Returns true if the given entity handle refers to a live entity in the
+ * given world */
+bool cecs_is_alive_in(cecs_world_t *world, const cecs_entity_t entity);
+
+/** Create `count` entities implementing the given components, reserving their
+ * rows in one step. If `entities` isn't NULL the new handles are written to it.
+ * If `data` isn't NULL it holds one array of `count` elements per component,
+ * in the order the components are given, to copy into the new rows; a NULL
+ * array leaves that component uninitialized. */
+void _cecs_create_n(cecs_world_t *world, const size_t count, cecs_entity_t *entities, const void *const *data, const cecs_component_t n, ...);
+
+/** Returns true if the given entity implements the specified component */
+bool _cecs_has(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id);
+
+/** Enable or disable the given component of the specified entity. Disabled
+ * components keep their data and archetype, but entity iterators naming them
+ * skip the entity. Returns false if the entity doesn't have the component. */
+bool _cecs_set_enabled(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id, const bool enabled);
+
+/** Returns true if the given entity has the specified component enabled */
+bool _cecs_is_enabled(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id);
 
 /** Add the given components to the specified entity */
-void _cecs_add(const cecs_entity_t entity, const cecs_component_t n, ...);
+void _cecs_add(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t n, ...);
 
 /** Remove the given components from the specified entity */
-void _cecs_remove(const cecs_entity_t entity, const cecs_component_t n, ...);
+void _cecs_remove(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t n, ...);
 
 /** Set the given component data for the specified entity */
-bool _cecs_set(const cecs_entity_t entity, const cecs_component_t id, void *data);
+bool _cecs_set(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id, void *data);
 
 /** Zero out the given component data for the specified entity */
-bool _cecs_zero(const cecs_entity_t entity, const size_t n, ...);
+bool _cecs_zero(cecs_world_t *world, const cecs_entity_t entity, const size_t n, ...);
 
 
 #endif
\ No newline at end of file
@@ -1,14 +1,31 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <fcntl.h>
 #include <memory.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <cecs/cecs.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
-#define __always_inline __attribute__((__always_inline__)) inline
+#ifndef __always_inline
+#define __always_inline inline __attribute__((__always_inline__))
+#endif
 
 
 /** Convert a component ID to the LSB into the appropriate index into the
@@ -41,10 +58,10 @@
 /** The next component ID to be assigned on registration */
 cecs_component_t CECS_NEXT_COMPONENT_ID = (cecs_component_t)(CECS_COMPONENT_INVALID + 1u);
 
-/** The next entity to be assigned on creation */
-cecs_entity_t g_next_entity = (cecs_entity_t)(CECS_ENTITY_INVALID + 1u);
-
-#define MIN_ENTITIES_COUNT ((size_t)16384u)
+_Static_assert(
+    CECS_N_COMPONENTS % 64u == 0u,
+    "CECS_N_COMPONENTS must be a multiple of 64"
+);
 
 /** A signature represents the components implemented by a type as a bit set. */
 struct signature {
@@ -52,27 +69,46 @@ struct signature {
 };
 
 
-/** entity->signature pair */
-struct sig_by_entity_entry {
-    cecs_entity_t entity;
-    struct signature sig;
+/** Location of an entity's data, stored in the entity table by entity index */
+struct record_by_entity_entry {
+    /** Archetype whose table holds the entity's component data, or NULL if
+     * the entity index is not in use */
+    struct cecs_archetype *archetype;
+    /** Row of the entity within its archetype's table */
+    size_t row;
+    /** Generation of the entity currently using this index */
+    uint32_t generation;
 };
 
 
-/** Vector of entity->signature pairs */
-struct sig_by_entity_bucket {
+/** Vector of entity indices */
+struct index_vec {
     size_t count;
     size_t cap;
-    struct sig_by_entity_entry *pairs;
+    uint32_t *indices;
 };
 
-/** Minimum number of elements allocated for an entity->signature map bucket */
-#define SIG_BY_ENTITY_MIN_BUCKET_SIZE ((size_t)2u)
-/** Number of buckets in the entity->signature map */
-#define N_SIG_BY_ENTITY_BUCKETS MIN_ENTITIES_COUNT
-/** Map from entity ID to the signature it implements */
-struct sig_by_entity_bucket sigs_by_entity[N_SIG_BY_ENTITY_BUCKETS] = { 0u };
 
+/** Number of entity indices covered by one page of the entity table. Must be a
+ * power of two. */
+#define RECORD_PAGE_SIZE ((size_t)1024u)
+/** Minimum number of elements allocated for the free entity index vector */
+#define FREE_INDICES_MIN_SIZE ((size_t)1024u)
+
+/** Table of records indexed by entity index. The table is split into pages
+ * that are only allocated once an index in their range is used. Destroyed
+ * entities leave their index on a free list to be reused, with its
+ * generation bumped so stale handles to the old entity can be detected. */
+struct record_by_entity_map {
+    /** Number of page pointers allocated in `pages` */
+    size_t n_pages;
+    /** Pages of records, by entity index */
+    struct record_by_entity_entry **pages;
+    /** Indices of destroyed entities, to be reused before fresh ones */
+    struct index_vec free_indices;
+    /** The next never-used entity index */
+    uint32_t next_index;
+};
 
 /** Vector of entity IDs */
 struct entity_vec {
@@ -82,872 +118,4791 @@ struct entity_vec {
 };
 
 
-/** Vector of free indices to be used when adding new entities to components */
-struct index_vec {
-    size_t count;
-    size_t cap;
-    size_t *indices;
+/** Registered component ID->size */
+struct component_by_id {
+    /* This component's ID */
+    cecs_component_t id;
+    /* Size in bytes of this component's data struct */
+    size_t size;
+    /* Name of the component's type, which identifies it in snapshots */
+    const char *name;
 };
 
 
-/** Entity ID->index into component data array */
-struct index_by_entity_pair {
-    cecs_entity_t entity;
-    size_t index;
+/** Number of buckets in the componet ID->data map */
+#define N_COMPONENT_BY_ID_BUCKETS ((size_t)(CECS_N_COMPONENTS))
+/** Map from component ID to component registration */
+struct component_by_id components_by_id[N_COMPONENT_BY_ID_BUCKETS] = { 0u };
+
+
+/** Packed array of one component's data for every entity in an archetype */
+struct column {
+    /* ID of the component stored in this column */
+    cecs_component_t id;
+    /* Size in bytes of one element of the column */
+    size_t size;
+    /* Array of component data, one element per row of the archetype */
+    void *data;
+    /* Tick at which each chunk of the column was last written, one element
+     * per CECS_CHUNK_ROWS rows */
+    cecs_tick_t *changed;
+};
+
+#define COLUMN_DATA_PTR(column, row) \
+    ((void *)(((uint8_t *)(column)->data) + ((row) * (column)->size)))
+
+/** Number of chunks needed to cover the given number of rows */
+#define CHUNKS_FOR_ROWS(rows) (((rows) + CECS_CHUNK_ROWS - 1u) / CECS_CHUNK_ROWS)
+
+/** Index of the chunk holding the given row */
+#define CHUNK_OF_ROW(row) ((row) / CECS_CHUNK_ROWS)
+
+/** Archetypes reached from an archetype by adding or removing one component */
+struct archetype_edge {
+    /* The component added or removed */
+    cecs_component_t id;
+    /* Archetype with the component added, or NULL if not yet resolved */
+    struct cecs_archetype *add;
+    /* Archetype with the component removed, or NULL if not yet resolved */
+    struct cecs_archetype *remove;
 };
 
-/** Vector of entity ID->index pairs */
-struct index_by_entity_bucket {
+/** Vector of archetype edges */
+struct archetype_edge_vec {
     size_t count;
     size_t cap;
-    /* Stores the singulate pair when count == 1 */
-    struct index_by_entity_pair value;
-    struct index_by_entity_pair *pairs;
+    struct archetype_edge *edges;
 };
 
-/** Minimum number of elements allocated for an entity->index map bucket */
-#define INDEX_BY_ENTITY_MIN_BUCKET_SIZE ((size_t)2u)
-/** Number of buckets in the entity ID->index map */
-#define N_INDEX_BY_ENTITY_BUCKETS MIN_ENTITIES_COUNT
+/** Minimum number of elements allocated for an archetype's edge vector */
+#define ARCHETYPE_EDGES_MIN_SIZE ((size_t)8u)
 
-
-/** ID->component data and entity vector pairs */
-struct component_by_id {
-    /* This component's ID */
+/** Enabled state of one component for every row of an archetype. Only
+ * components that have been disabled on some row of the archetype get one. */
+struct enabled_mask {
+    /* The component whose enabled state is tracked */
     cecs_component_t id;
-    /* Size in bytes of this component's data struct */
-    size_t size;
-    /* Array of entity component data */
-    void *data;
-    /* Number of entities that can be stored in this component before resizing */
-    size_t cap;
-    /* Number of entities implementing this component */
-    size_t count;
-    /* Map of entity->index into the component data array */
-    struct index_by_entity_bucket indices_by_entity[N_INDEX_BY_ENTITY_BUCKETS];
-    /* Vector of indices that are unused in the component data array */
-    struct index_vec free_indices;
+    /* One bit per row of the table, set if the component is enabled */
+    uint64_t *bits;
 };
 
+/** Vector of enabled masks */
+struct enabled_mask_vec {
+    size_t count;
+    size_t cap;
+    struct enabled_mask *masks;
+};
 
-/** Minimum number of elements allocated for component data by index */
-#define COMPONENT_MIN_ENTITIES_COUNT MIN_ENTITIES_COUNT
-/** Number of buckets in the componet ID->data map */
-#define N_COMPONENT_BY_ID_BUCKETS ((size_t)(CECS_N_COMPONENTS))
-/** Map from component ID to component data and implementing entities vector */
-struct component_by_id components_by_id[N_COMPONENT_BY_ID_BUCKETS] = { 0u };
+/** Minimum number of elements allocated for an archetype's enabled masks */
+#define ENABLED_MASKS_MIN_SIZE ((size_t)4u)
 
-#define COMPONENT_DATA_PTR(component, index) \
-    ((void *)(((uint8_t *)(component)->data) + ((index) * (component)->size)))
+/** Number of words in an enabled mask covering the given number of rows */
+#define ENABLED_MASK_WORDS(rows) (((rows) + 63u) / 64u)
 
 /** An archetype is a unique composition of components. */
-struct archetype {
+struct cecs_archetype {
+    /** World the archetype belongs to */
+    struct cecs_world *world;
+    /** Position of the archetype in the world's creation-ordered list */
+    size_t index;
     /** Component signature implemented by this archetype */
     struct signature sig;
     /** Number of entities implementing this archetype */
     size_t count;
-    /** Number of entities able to be stored in the entities array before resizing */
+    /** Number of rows able to be stored in the table before resizing */
     size_t cap;
-    /** Array of entities implementing this archetype */
+    /** Array of entities implementing this archetype, indexed by row */
     cecs_entity_t *entities;
+    /** Components of `sig` that hold data. Zero-sized components are tags,
+     * which live in the signature alone. */
+    struct signature column_sig;
+    /** Number of columns, which is the number of components in `column_sig` */
+    size_t n_columns;
+    /** One column per component in `column_sig`, ordered by component ID */
+    struct column *columns;
+    /** Cached transitions to the archetypes one component away */
+    struct archetype_edge_vec edges;
+    /** Per-row enabled state of the components disabled on any row */
+    struct enabled_mask_vec enabled;
+    /** Tick at which a row was last added to each chunk of the table, one
+     * element per CECS_CHUNK_ROWS rows */
+    cecs_tick_t *added;
+    /** Tick at which a component was last enabled or disabled on a row of
+     * each chunk, which tags have no column to record */
+    cecs_tick_t *toggled;
 };
 
-/** Signature->Archetype to be stored in the sig->archetype map */
-struct archetype_by_sig_pair {
-    struct signature sig;
-    struct archetype archetype;
+/** Slot of an open-addressing hash map. The key lives in the value, so only
+ * its hash is kept for fast rejects. A NULL value marks an empty slot. */
+struct hash_map_slot {
+    uint64_t hash;
+    void *value;
 };
 
-/** Vector of signature->archetype pairs, to be stored in the sig->archetype map */
-struct archetype_by_sig_bucket {
+/** Open-addressing hash map with linear probing from a 64-bit hash to a value
+ * holding its own key. Grows to keep at most half its slots in use, so probe
+ * lengths stay short however many values it holds. */
+struct hash_map {
     size_t count;
+    /** Number of slots, which is 0 or a power of 2 */
     size_t cap;
-    struct archetype_by_sig_pair *pairs;
+    struct hash_map_slot *slots;
 };
 
+/** Minimum number of slots allocated for a hash map */
+#define HASH_MAP_MIN_SIZE ((size_t)64u)
+
+/** Returns true if the given hash map value holds the specified key */
+typedef bool (*hash_map_eq_fn)(const void *value, const void *key);
+
 /** Vector of pointers to archetypes, which are stored in the sig->archetype map */
 struct achetype_vec {
     size_t count;
     size_t cap;
-    struct archetype **elements;
+    struct cecs_archetype **elements;
+};
+
+/** A persistent query caches the archetypes implementing its signature, and is
+ * updated whenever a new archetype is created */
+struct cecs_query {
+    /** World whose archetypes are matched */
+    struct cecs_world *world;
+    /** Components that matching archetypes must implement */
+    struct signature sig;
+    /** Components that matching archetypes must not implement */
+    struct signature without;
+    /** Components of which matching archetypes must implement at least one,
+     * unless there are none */
+    struct signature any_of;
+    bool has_any_of;
+    /** Archetypes matching the query's terms */
+    struct achetype_vec archetypes;
+};
+
+/** Vector of pointers to persistent queries */
+struct query_vec {
+    size_t count;
+    size_t cap;
+    struct cecs_query **elements;
 };
 
-/** Minimum number of elements to allocate for an entity vector for a given archetype */
-#define ARCHETYPE_ENTITIES_VEC_MIN_SIZE MIN_ENTITIES_COUNT
+/** Minimum number of elements allocated for the vector of persistent queries */
+#define QUERIES_VEC_MIN_SIZE ((size_t)16u)
+
+/** Minimum number of rows to allocate for the table of a given archetype.
+ * Most archetypes, such as those passed through by chains of adds and removes,
+ * hold few entities, so tables start small and double as they fill. Bigger
+ * tables are sized up front with cecs_reserve(). */
+#define ARCHETYPE_MIN_ROWS ((size_t)64u)
 /** Minimum number of elements allocated for a vector of archetypes.
  * Used to return a vector of archetypes that match a given signature. */
 #define ARCHETYPES_VEC_MIN_SIZE ((size_t)32u)
-/** Minimum number of elements allocated for a signature->archetype map bucket */
-#define ARCHETYPES_BY_SIG_MIN_BUCKET_SIZE ((size_t)64u)
-/** Number of buckets in the signature->archetype map */
-#define N_ARCHETYPE_BY_SIG_BUCKETS ((size_t)64u)
-/** Map from signature to the archetype it represents */
-struct archetype_by_sig_bucket archetypes_by_sig[N_ARCHETYPE_BY_SIG_BUCKETS] = { 0u };
 
+/** Fixed-size block allocator. Blocks are carved out of slabs obtained from
+ * the allocator hooks, and freed blocks are kept on a free list for reuse, so
+ * objects that come and go don't fragment the heap. */
+struct pool {
+    /** Size of each block, rounded up to keep blocks aligned */
+    size_t block_size;
+    /** Slabs allocated so far, linked through their first word */
+    void *slabs;
+    /** Free blocks, linked through their first word */
+    void *free_blocks;
+};
+
+/** Number of blocks carved out of each slab of a pool */
+#define POOL_SLAB_BLOCKS ((size_t)64u)
+
+/** Alignment of every block handed out by pools and arenas */
+#define MEMORY_ALIGN ((size_t)16u)
 
-/** Vector of entities in a bucket in the entity set */
-struct cecs_entity_set_bucket {
+/** Round the given size up to a multiple of MEMORY_ALIGN */
+#define ALIGN_SIZE(size) (((size) + MEMORY_ALIGN - 1u) & ~(MEMORY_ALIGN - 1u))
+
+/** Initializer for a pool of blocks of the given type */
+#define POOL_INIT(type) { .block_size = ALIGN_SIZE(sizeof(type)) }
+
+/** Block of a frame arena, followed by its data */
+struct arena_block {
+    struct arena_block *next;
+    /** Number of bytes of data following the header */
+    size_t cap;
+};
+
+/** Size of the header preceding a frame arena block's data */
+#define ARENA_HEADER_SIZE ALIGN_SIZE(sizeof(struct arena_block))
+
+/** Minimum number of bytes of data in a frame arena block */
+#define ARENA_MIN_SIZE ((size_t)64u * 1024u)
+
+/** Bump-pointer allocator for temporaries that live until the end of a frame.
+ * Resetting it keeps its memory, merged into one block, for the next frame. */
+struct frame_arena {
+    /** Blocks in the order they are filled */
+    struct arena_block *blocks;
+    /** Block currently being allocated from */
+    struct arena_block *current;
+    /** Bytes of `current` handed out */
+    size_t used;
+    /** Held while allocating, so systems running in parallel can share the
+     * arena */
+    atomic_flag lock;
+};
+
+/** A component removed from an entity, kept for "removed since" queries */
+struct removed_entry {
+    cecs_entity_t entity;
+    cecs_component_t id;
+    cecs_tick_t tick;
+};
+
+/** Log of removed components, in tick order */
+struct removed_vec {
     size_t count;
     size_t cap;
-    /* Holds the value of the bucket when count == 1 */
-    cecs_entity_t value;
-    cecs_entity_t *entities;
+    struct removed_entry *entries;
 };
 
-/** Number of buckets in an entity set */
-#define N_ENTITY_SET_BUCKETS ((size_t)16384u)
-/** Set of unique entity IDs */
-struct cecs_entity_set {
-    struct cecs_entity_set_bucket buckets[N_ENTITY_SET_BUCKETS];
+/** Minimum number of elements allocated for the log of removed components */
+#define REMOVED_LOG_MIN_SIZE ((size_t)256u)
+
+
+/** A world owns all the entities, archetypes and queries of one simulation.
+ * Component registrations are shared between worlds. */
+struct cecs_world {
+    /** Map from entity ID to the archetype row holding its data */
+    struct record_by_entity_map records_by_entity;
+    /** Map from signature to the archetype it represents */
+    struct hash_map archetypes_by_sig;
+    /** Every archetype, in the order they were created */
+    struct achetype_vec archetypes;
+    /** Cache the vector of archetypes returned by a query so we don't have to
+     * allocate on every query */
+    struct achetype_vec archetypes_vec_cache;
+    /** All persistent queries, which must be told about new archetypes */
+    struct query_vec queries;
+    /** Archetype implementing no components, which is the root of the
+     * archetype graph that new entities are built from */
+    struct cecs_archetype *root_archetype;
+    /** For each component ID, the archetypes implementing that component */
+    struct achetype_vec archetypes_by_component[CECS_N_COMPONENTS];
+    /** Current tick, stamped on every change made to the world */
+    cecs_tick_t tick;
+    /** Components whose removals are logged */
+    struct signature removed_tracked;
+    /** Whether any component's removals or any destroys are logged */
+    bool tracks_removed;
+    /** Whether destroyed entities are logged, with CECS_COMPONENT_INVALID */
+    bool tracks_destroyed;
+    /** Log of removals of the components in `removed_tracked` */
+    struct removed_vec removed;
+    /** Storage for the world's archetypes and persistent queries */
+    struct pool archetype_pool;
+    struct pool query_pool;
+    /** Temporaries released at the start of every frame */
+    struct frame_arena frame;
+    /** Index of the next archetype to be visited by incremental compaction */
+    size_t compact_cursor;
 };
 
+/** The world used by the API functions that don't name one */
+struct cecs_world g_default_world = {
+    .records_by_entity = { .next_index = 1u },
+    .tick              = 1u,
+    .archetype_pool    = POOL_INIT(struct cecs_archetype),
+    .query_pool        = POOL_INIT(struct cecs_query),
+    .frame             = { .lock = ATOMIC_FLAG_INIT },
+};
 
-/** Minmum number of elements allocated for an entity set bucket */
-#define ENTITY_SET_MIN_BUCKET_SIZE ((size_t)8u)
-/** Cache the set used to return query result so we don't have to allocate
- * buckets on every query */
-struct cecs_entity_set query_result_cache;
 
-/** Cache the vector of archetypes returned by a query so we don't have to
- * allocate on every query */
-struct achetype_vec archetypes_vec_cache;
+/** Kinds of command recorded in a command buffer */
+enum cmd_kind {
+    CMD_CREATE,
+    CMD_ADD,
+    CMD_REMOVE,
+    CMD_SET,
+    CMD_DESTROY
+};
 
+/** A deferred structural change or write to one entity */
+struct cmd {
+    /** Entity the command applies to, which may be a placeholder */
+    cecs_entity_t entity;
+    /** Component added, removed or set */
+    cecs_component_t id;
+    /** Offset of the data to set in the buffer's data arena */
+    size_t data;
+    enum cmd_kind kind;
+};
 
-/** Grow the given vector to the minimum size if empty, or double its size */
-#define GROW_VEC_IF_NEEDED(vec, min_size, entries, type)                                \
-    if ((vec)->count >= (vec)->cap) {                                                   \
-        if ((vec)->cap == 0u) {                                                         \
-            (vec)->cap     = (min_size);                                                \
-            (vec)->entries = realloc((vec)->entries, (vec)->cap * sizeof(type));        \
-            memset((uint8_t *)(vec)->entries, 0u, (vec)->cap * sizeof(type));           \
-        } else {                                                                        \
-            (vec)->entries = realloc((vec)->entries, ((vec)->cap * 2u) * sizeof(type)); \
-            memset(                                                                     \
-                ((uint8_t *)(vec)->entries) + (vec)->cap * sizeof(type),                \
-                0u,                                                                     \
-                (vec)->cap * sizeof(type)                                               \
-            );                                                                          \
-            (vec)->cap *= 2u;                                                           \
-        }                                                                               \
-    }
+/** Vector of commands */
+struct cmd_vec {
+    size_t count;
+    size_t cap;
+    struct cmd *cmds;
+};
 
+/** Arena holding copies of the data passed to set commands */
+struct cmd_data_vec {
+    size_t count;
+    size_t cap;
+    uint8_t *bytes;
+};
 
-/** Find the entry in vector `bucket` whose `identifier` matches `search` and
- * return it in `result` */
-#define FIND_ENTRY_IN_VEC(vec, identifier, search, result) \
-    for (size_t _i = 0u; _i < (vec)->count; ++_i) {        \
-        if ((vec)->pairs[_i].identifier == (search)) {     \
-            (result) = &(vec)->pairs[_i];                  \
-        }                                                  \
-    }
+/** A command with the entity it applies to resolved, sorted so each entity's
+ * commands are contiguous and in recording order */
+struct cmd_ref {
+    cecs_entity_t entity;
+    size_t i_cmd;
+};
 
+/** Vector of resolved commands */
+struct cmd_ref_vec {
+    size_t count;
+    size_t cap;
+    struct cmd_ref *refs;
+};
 
-/** Returns true if the two signatures are equivalent */
-static bool __always_inline sigs_are_equal(const struct signature *lhs, const struct signature *rhs)
-{
-    for (cecs_component_t i = 0u; i < CECS_MAX_COMPONENT_INDEX; ++i) {
-        if (lhs->components[i] != rhs->components[i]) {
-            return false;
-        }
-    }
+/** The single structural change that results from all of an entity's
+ * commands in a buffer */
+struct cmd_plan {
+    cecs_entity_t entity;
+    /** Archetype the entity ends up in, or NULL if it is destroyed */
+    struct cecs_archetype *to;
+    /** Whether the entity was created by the buffer, so has no row yet */
+    bool created;
+    /** Index of the entity's first command, which orders the moves into one
+     * archetype */
+    size_t i_cmd;
+};
 
-    return true;
-}
+/** Vector of planned structural changes */
+struct cmd_plan_vec {
+    size_t count;
+    size_t cap;
+    struct cmd_plan *plans;
+};
 
+/** Minimum number of elements allocated for the vectors of a command buffer */
+#define CMD_BUFFER_MIN_SIZE ((size_t)64u)
+
+/** A command buffer records structural changes to be applied later in one
+ * batch. Entities created by the buffer are given placeholder handles, with
+ * the reserved index 0 and a generation that counts the buffer's creates. */
+struct cecs_cmd_buffer {
+    /** Commands in recording order */
+    struct cmd_vec cmds;
+    /** Data copied by set commands */
+    struct cmd_data_vec data;
+    /** Number of entities created by the buffer, i.e. placeholders handed out */
+    size_t n_creates;
+    /** Real handles of the created entities, by placeholder, once applied */
+    struct entity_vec created;
+    /** Set once the buffer has been applied, until the next command is
+     * recorded, while placeholders can still be resolved */
+    bool applied;
+    /** Scratch space for applying the buffer */
+    struct cmd_ref_vec refs;
+    struct cmd_plan_vec plans;
+};
 
-/** Returns true if `look_for` is entirely represented by `in` */
-static bool __always_inline sig_is_in(const struct signature *look_for, const struct signature *in)
-{
-    for (cecs_component_t i = 0u; i < CECS_MAX_COMPONENT_INDEX; ++i) {
-        if ((look_for->components[i] & in->components[i]) != look_for->components[i]) {
-            return false;
-        }
-    }
 
-    return true;
+/** Default allocator hooks, backed by the C library */
+static void *default_alloc(const size_t size, void *ctx)
+{
+    (void)ctx;
+    return malloc(size);
 }
 
+static void *default_realloc(void *ptr, const size_t size, void *ctx)
+{
+    (void)ctx;
+    return realloc(ptr, size);
+}
 
-/** Return the boolean OR union of the two signatures */
-static void __always_inline sig_union(struct signature *target, const struct signature *with)
+static void default_free(void *ptr, void *ctx)
 {
-    for (cecs_component_t i = 0u; i < CECS_MAX_COMPONENT_INDEX; ++i) {
-        target->components[i] |= with->components[i];
-    }
+    (void)ctx;
+    free(ptr);
 }
 
+/** Allocator used for all the memory CECS allocates */
+static cecs_allocator_t g_allocator = {
+    .alloc = default_alloc, .realloc = default_realloc, .free = default_free, .ctx = NULL
+};
+
 
-/** Return `target` less all the components in `to_remove` */
-static void __always_inline sig_remove(struct signature *target, const struct signature *to_remove)
+/** Set the hooks used for all the memory CECS allocates */
+void cecs_set_allocator(const cecs_allocator_t *allocator)
 {
-    for (cecs_component_t i = 0u; i < CECS_MAX_COMPONENT_INDEX; ++i) {
-        target->components[i] &= ~to_remove->components[i];
+    if (!allocator) {
+        g_allocator = (cecs_allocator_t){
+            .alloc = default_alloc, .realloc = default_realloc, .free = default_free, .ctx = NULL
+        };
+        return;
     }
+
+    assert(allocator->alloc && allocator->realloc && allocator->free && "Allocator is missing a hook");
+    g_allocator = *allocator;
 }
 
 
-/** Generate a signature reprensenting all the components in the given vector */
-static struct signature components_to_sig(const cecs_component_t n, va_list components)
+/** Abort if an allocation failed. A failure part way through a structural
+ * change would leave the tables inconsistent, so there is no recovering. */
+static __always_inline void *check_alloc(void *ptr, const size_t size)
 {
-    struct signature sig;
-    memset(&sig, 0u, sizeof(sig));
-
-    for (size_t i = 0u; i < n; ++i) {
-        cecs_component_t id = va_arg(components, cecs_component_t);
-        assert(id > 0 && "Component was not registered with CECS_COMPONENT()");
-        CECS_ADD_COMPONENT(&sig, id);
+    if (!ptr && size > 0u) {
+        fprintf(stderr, "cecs: out of memory allocating %zu bytes\n", size);
+        abort();
     }
 
-    return sig;
+    return ptr;
 }
 
 
-/** Get all the archetypes that contain the given signature.
- * The caller is responsible for freeing the returned vector. */
-static struct achetype_vec *get_archetypes_by_sig(const struct signature *sig)
+/** Allocate memory through the allocator hooks */
+void *cecs_alloc(const size_t size)
 {
-    struct achetype_vec *vec = &archetypes_vec_cache;
-    /* Clear previous results */
-    vec->count = 0u;
+    return check_alloc(g_allocator.alloc(size, g_allocator.ctx), size);
+}
 
-    /* Iterate every archetype in the archetype-by-sig map and check if its
-     * signature contains the queried signature. */
-    for (size_t i_bucket = 0u; i_bucket < N_ARCHETYPE_BY_SIG_BUCKETS; ++i_bucket) {
-        struct archetype_by_sig_bucket *bucket = &archetypes_by_sig[i_bucket];
-        for (size_t i_entry = 0u; i_entry < bucket->count; ++i_entry) {
-            struct archetype_by_sig_pair *pair = &bucket->pairs[i_entry];
-            if (sig_is_in(sig, &pair->sig)) {
-                GROW_VEC_IF_NEEDED(vec, ARCHETYPES_VEC_MIN_SIZE, elements, struct archetype *);
-                vec->elements[vec->count++] = &pair->archetype;
-            }
-        }
-    }
 
-    return vec;
+/** Resize memory through the allocator hooks */
+void *cecs_realloc(void *ptr, const size_t size)
+{
+    return check_alloc(g_allocator.realloc(ptr, size, g_allocator.ctx), size);
 }
 
 
-static __always_inline size_t hash_sig(const struct signature *sig, const size_t max)
+/** Free memory through the allocator hooks */
+void cecs_free(void *ptr)
 {
-    cecs_component_t hash = 0u;
-    for (size_t i = 0u; i < CECS_MAX_COMPONENT_INDEX; ++i) {
-        hash ^= (sig->components[i] >> 30u);
-        hash *= 0xbf58476d1ce4e5b9u;
-        hash ^= (sig->components[i] >> 27u);
-        hash *= 0x94d049bb133111ebu;
-        hash ^= (sig->components[i] >> 31u);
+    if (ptr) {
+        g_allocator.free(ptr, g_allocator.ctx);
     }
-    return (size_t)(hash % max);
 }
 
 
-/** Populate the sig->archetype map by assigning the value pointed to by the
- * given archetype pointer to the map value */
-static struct archetype *set_archetype_by_sig(const struct signature *sig, const struct archetype *archetype)
+/** Allocate zeroed memory for `n` elements of the given size */
+static void *alloc_zeroed(const size_t n, const size_t size)
 {
-    const size_t i_bucket = hash_sig(sig, N_ARCHETYPE_BY_SIG_BUCKETS);
-    struct archetype_by_sig_bucket *bucket = &archetypes_by_sig[i_bucket];
+    assert((size == 0u || n <= SIZE_MAX / size) && "Allocation size overflows");
+
+    void *ptr = cecs_alloc(n * size);
+    memset(ptr, 0u, n * size);
+
+    return ptr;
+}
 
-    /* If entity already exists in bucket, just overwrite its value */
-    for (size_t i = 0u; i < bucket->count; ++i) {
-        struct archetype_by_sig_pair *pair = &bucket->pairs[i];
-        if (sigs_are_equal(&pair->sig, sig)) {
-            pair->archetype = *archetype;
-            return &pair->archetype;
+
+/** Allocate a zeroed block from the given pool */
+static void *pool_alloc(struct pool *pool)
+{
+    if (!pool->free_blocks) {
+        /* The slab's first block links it into the pool's slab list */
+        uint8_t *slab = cecs_alloc(pool->block_size * (POOL_SLAB_BLOCKS + 1u));
+        *(void **)slab = pool->slabs;
+        pool->slabs    = slab;
+
+        for (size_t i = 1u; i <= POOL_SLAB_BLOCKS; ++i) {
+            void *block       = slab + i * pool->block_size;
+            *(void **)block   = pool->free_blocks;
+            pool->free_blocks = block;
         }
     }
 
-    /* Entity wasn't found in bucket. Check if we need to expand the bucket first
-     */
-    GROW_VEC_IF_NEEDED(bucket, ARCHETYPES_BY_SIG_MIN_BUCKET_SIZE, pairs, struct archetype_by_sig_pair);
+    void *block       = pool->free_blocks;
+    pool->free_blocks = *(void **)block;
+    memset(block, 0u, pool->block_size);
 
-    /* Add a new pair to the bucket */
-    struct archetype_by_sig_pair *pair = &bucket->pairs[bucket->count++];
+    return block;
+}
 
-    pair->sig       = *sig;
-    pair->archetype = *archetype;
 
-    return &pair->archetype;
+/** Return a block to the given pool */
+static void pool_free(struct pool *pool, void *block)
+{
+    *(void **)block   = pool->free_blocks;
+    pool->free_blocks = block;
 }
 
 
-/** Return the archetype implementing the given signature */
-static struct archetype *get_archetype_by_sig(const struct signature *sig)
+/** Free every slab of the given pool, including blocks still in use */
+static void pool_destroy(struct pool *pool)
 {
-    const size_t i_bucket = hash_sig(sig, N_ARCHETYPE_BY_SIG_BUCKETS);
-    struct archetype_by_sig_bucket *bucket = &archetypes_by_sig[i_bucket];
-
-    for (size_t i = 0u; i < bucket->count; ++i) {
-        if (sigs_are_equal(&bucket->pairs[i].sig, sig)) {
-            return &bucket->pairs[i].archetype;
-        }
+    while (pool->slabs) {
+        void *next = *(void **)pool->slabs;
+        cecs_free(pool->slabs);
+        pool->slabs = next;
     }
-
-    return NULL;
+    pool->free_blocks = NULL;
 }
 
 
-/** Get the archetype implementing the given signature, or add an empty one and
- * return that */
-static struct archetype *get_or_add_archetype_by_sig(const struct signature *sig)
-{
-    struct archetype *existing = get_archetype_by_sig(sig);
-    if (existing) {
-        return existing;
-    }
+/** Get a pointer to the data of the given arena block */
+#define ARENA_BLOCK_DATA(block) ((uint8_t *)(block) + ARENA_HEADER_SIZE)
+
 
-    struct archetype atype;
-    memset(&atype, 0u, sizeof(atype));
-    atype.sig = *sig;
+/** Allocate an arena block with room for the given number of bytes */
+static struct arena_block *alloc_arena_block(const size_t cap)
+{
+    struct arena_block *block = cecs_alloc(ARENA_HEADER_SIZE + cap);
+    block->next               = NULL;
+    block->cap                = cap;
 
-    return set_archetype_by_sig(sig, &atype);
+    return block;
 }
 
 
-/** Populate the entity->signature map */
-static void set_sig_by_entity(const cecs_entity_t entity, struct signature *sig)
+/** Allocate temporary memory from the given frame arena */
+static void *arena_alloc(struct frame_arena *arena, const size_t size)
 {
-    const size_t i_bucket = (size_t)(entity % N_SIG_BY_ENTITY_BUCKETS);
-    struct sig_by_entity_bucket *bucket = &sigs_by_entity[i_bucket];
+    const size_t aligned = ALIGN_SIZE(size);
+
+    /* Move on to later blocks, allocating one after the last if none fit */
+    while (!arena->current || arena->used + aligned > arena->current->cap) {
+        struct arena_block *next = arena->current ? arena->current->next : arena->blocks;
+        if (!next) {
+            const size_t last = arena->current ? arena->current->cap : 0u;
+            size_t cap        = last * 2u > ARENA_MIN_SIZE ? last * 2u : ARENA_MIN_SIZE;
+            if (cap < aligned) {
+                cap = aligned;
+            }
 
-    /* If entity already exists in bucket, just overwrite its value */
-    for (size_t i = 0u; i < bucket->count; ++i) {
-        struct sig_by_entity_entry *entry = &bucket->pairs[i];
-        if (entry->entity == entity) {
-            entry->sig = *sig;
-            return;
+            next = alloc_arena_block(cap);
+            if (arena->current) {
+                arena->current->next = next;
+            } else {
+                arena->blocks = next;
+            }
         }
+
+        arena->current = next;
+        arena->used    = 0u;
     }
 
-    /* Entity wasn't found in bucket; add a new entry to the bucket bucket */
-    GROW_VEC_IF_NEEDED(bucket, SIG_BY_ENTITY_MIN_BUCKET_SIZE, pairs, struct sig_by_entity_entry);
-    struct sig_by_entity_entry *entry = &bucket->pairs[bucket->count++];
+    void *ptr = ARENA_BLOCK_DATA(arena->current) + arena->used;
+    arena->used += aligned;
 
-    entry->entity = entity;
-    entry->sig    = *sig;
+    return ptr;
 }
 
 
-/** Get the signature implemented by the given entity */
-static struct signature *get_sig_by_entity(const cecs_entity_t entity)
+/** Release everything allocated from the given frame arena. If the last frame
+ * spilled into more than one block they are merged, so a steady workload
+ * settles on a single block. */
+static void arena_reset(struct frame_arena *arena)
 {
-    const size_t i_bucket = (size_t)(entity % N_SIG_BY_ENTITY_BUCKETS);
+    if (arena->blocks && arena->blocks->next) {
+        size_t cap = 0u;
+        for (struct arena_block *block = arena->blocks; block;) {
+            struct arena_block *next = block->next;
+            cap += block->cap;
+            cecs_free(block);
+            block = next;
+        }
+
+        arena->blocks = alloc_arena_block(cap);
+    }
 
-    struct sig_by_entity_bucket *bucket = &sigs_by_entity[i_bucket];
+    arena->current = NULL;
+    arena->used    = 0u;
+}
 
-    struct sig_by_entity_entry *entry = NULL;
-    FIND_ENTRY_IN_VEC(bucket, entity, entity, entry);
 
-    if (entry) {
-        return &entry->sig;
-    } else {
-        return NULL;
+/** Free every block of the given frame arena */
+static void arena_destroy(struct frame_arena *arena)
+{
+    while (arena->blocks) {
+        struct arena_block *next = arena->blocks->next;
+        cecs_free(arena->blocks);
+        arena->blocks = next;
     }
+    arena->current = NULL;
+    arena->used    = 0u;
 }
 
-/** Get the component data for the given component ID */
-static __always_inline struct component_by_id *get_component_by_id(const cecs_component_t id)
-{
-    assert(id > 0 && "Component was not registered with CECS_COMPONENT()");
 
-    return &components_by_id[(size_t)id];
-}
+/** Grow the given vector to the minimum size if empty, or double its size */
+#define GROW_VEC_IF_NEEDED(vec, min_size, entries, type)                                     \
+    if ((vec)->count >= (vec)->cap) {                                                        \
+        if ((vec)->cap == 0u) {                                                              \
+            (vec)->cap     = (min_size);                                                     \
+            (vec)->entries = cecs_realloc((vec)->entries, (vec)->cap * sizeof(type));        \
+            memset((uint8_t *)(vec)->entries, 0u, (vec)->cap * sizeof(type));                \
+        } else {                                                                             \
+            (vec)->entries = cecs_realloc((vec)->entries, ((vec)->cap * 2u) * sizeof(type)); \
+            memset(                                                                          \
+                ((uint8_t *)(vec)->entries) + (vec)->cap * sizeof(type),                     \
+                0u,                                                                          \
+                (vec)->cap * sizeof(type)                                                    \
+            );                                                                               \
+            (vec)->cap *= 2u;                                                                \
+        }                                                                                    \
+    }
 
 
-/** Add a block of component data for the given entity */
-static void add_entity_to_component(const cecs_component_t id, const cecs_entity_t entity)
-{
-    struct component_by_id *component = get_component_by_id(id);
+/** Find the entry in vector `bucket` whose `identifier` matches `search` and
+ * return it in `result` */
+#define FIND_ENTRY_IN_VEC(vec, identifier, search, result) \
+    for (size_t _i = 0u; _i < (vec)->count; ++_i) {        \
+        if ((vec)->pairs[_i].identifier == (search)) {     \
+            (result) = &(vec)->pairs[_i];                  \
+        }                                                  \
+    }
 
-    const size_t i_index_bucket = (size_t)(entity % N_INDEX_BY_ENTITY_BUCKETS);
-    struct index_by_entity_bucket *index_bucket
-        = &component->indices_by_entity[i_index_bucket];
 
-    size_t index = (size_t)0u;
+/** Number of words of the signature bit field array that can hold registered
+ * components. Words past this are always zero, so signature operations can
+ * stop here instead of covering all of CECS_N_COMPONENTS. */
+size_t g_sig_words = (size_t)1u;
 
-    /* Get an index into the component data component for this entity. */
-    if (component->free_indices.count > 0) {
-        /* There is a free slot due to another entity being removed from the
-         * component; use that. */
-        index = component->free_indices.indices[--component->free_indices.count];
-    } else {
-        /* No free slots, add a slot to the data component */
-        index = component->count++;
-    }
 
-    if (index_bucket->count == 0u) {
-        /* Bucket is empty, put the index-by-entity pair in the singulate value */
-        index_bucket->value.entity = entity;
-        index_bucket->value.index  = index;
-        index_bucket->count        = 1u;
+#if defined(__AVX2__)
+/** Number of signature words processed per vector instruction */
+#define SIG_LANES ((size_t)4u)
+#elif defined(__SSE2__)
+/** Number of signature words processed per vector instruction */
+#define SIG_LANES ((size_t)2u)
+#else
+/** Number of signature words processed per iteration */
+#define SIG_LANES ((size_t)1u)
+#endif
 
-    } else {
-        struct index_by_entity_pair *index_pair = NULL;
-        if (index_bucket->pairs) {
-            /* Bucket vector is already allocated, check it for duplicates */
-            FIND_ENTRY_IN_VEC(index_bucket, entity, entity, index_pair);
-            /* Don't allow duplicates */
-            if (index_pair) {
-                return;
-            }
-        } else {
-            /* Bucket vector is not yet allocated, check if the singulate value
-             * is a duplicate */
-            if (index_bucket->value.entity == entity) {
-                return;
-            }
-        }
+/** Bits to rotate each successive group of SIG_LANES words by before folding
+ * them into the hash */
+#define SIG_HASH_ROTATION ((size_t)23u)
 
-        /* No duplicates, found, add entity to component */
-        GROW_VEC_IF_NEEDED(index_bucket, INDEX_BY_ENTITY_MIN_BUCKET_SIZE, pairs, struct index_by_entity_pair);
 
-        if (index_bucket->count == 1u) {
-            /* Transitioning from 1 to 2 elements. Put the singulate value in the vector */
-            index_bucket->pairs[0u] = index_bucket->value;
+/** Returns true if the two signatures are equivalent */
+static __always_inline bool sigs_are_equal(const struct signature *lhs, const struct signature *rhs)
+{
+    size_t i = 0u;
+
+#if defined(__AVX2__)
+    for (; i + SIG_LANES <= g_sig_words; i += SIG_LANES) {
+        const __m256i l = _mm256_loadu_si256((const __m256i *)&lhs->components[i]);
+        const __m256i r = _mm256_loadu_si256((const __m256i *)&rhs->components[i]);
+        const __m256i x = _mm256_xor_si256(l, r);
+        if (!_mm256_testz_si256(x, x)) {
+            return false;
+        }
+    }
+#elif defined(__SSE2__)
+    for (; i + SIG_LANES <= g_sig_words; i += SIG_LANES) {
+        const __m128i l = _mm_loadu_si128((const __m128i *)&lhs->components[i]);
+        const __m128i r = _mm_loadu_si128((const __m128i *)&rhs->components[i]);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(l, r)) != 0xFFFF) {
+            return false;
         }
-
-        /* Add the new pair to the end of the bucket */
-        index_pair         = &index_bucket->pairs[index_bucket->count++];
-        index_pair->entity = entity;
-        index_pair->index  = index;
     }
-
-    /* Grow the component table if needed */
-    if (component->count >= component->cap) {
-        if (component->cap == 0u) {
-            /* Allocate for the first time */
-            component->cap = COMPONENT_MIN_ENTITIES_COUNT;
-            component->data
-                = realloc(component->data, component->cap * component->size);
-            assert(component->data && "Out of memory");
-#ifdef CECS_ZERO_NEW_COMPONENT_DATA
-            memset(component->data, 0u, component->cap * component->size);
 #endif
 
-        } else {
-            /* Double the size and zero out the new data capacity */
-            component->data
-                = realloc(component->data, component->cap * 2u * component->size);
-            assert(component->data && "Out of memory");
-#ifdef CECS_ZERO_NEW_COMPONENT_DATA
-            memset(
-                ((uint8_t *)component->data) + component->cap * component->size,
-                0u,
-                component->cap * component->size
-            );
-#endif
-            component->cap *= 2u;
+    for (; i < g_sig_words; ++i) {
+        if (lhs->components[i] != rhs->components[i]) {
+            return false;
         }
     }
+
+    return true;
 }
 
 
-static void remove_entity_from_component(const cecs_component_t id, const cecs_entity_t entity)
+/** Returns true if `look_for` is entirely represented by `in` */
+static __always_inline bool sig_is_in(const struct signature *look_for, const struct signature *in)
 {
-    struct component_by_id *component = get_component_by_id(id);
-
-    const size_t i_index_bucket = (size_t)(entity % N_INDEX_BY_ENTITY_BUCKETS);
-    struct index_by_entity_bucket *index_bucket
-        = &component->indices_by_entity[i_index_bucket];
-
-    if (index_bucket->count == 0u) {
-        /* Component doesn't belong to any entities */
-        return;
+    size_t i = 0u;
+
+#if defined(__AVX2__)
+    for (; i + SIG_LANES <= g_sig_words; i += SIG_LANES) {
+        const __m256i f = _mm256_loadu_si256((const __m256i *)&look_for->components[i]);
+        const __m256i n = _mm256_loadu_si256((const __m256i *)&in->components[i]);
+        /* Carry flag is set if `f & ~n` is zero */
+        if (!_mm256_testc_si256(n, f)) {
+            return false;
+        }
     }
-
-    if (index_bucket->count == 1u) {
-        /* Entity is stored in component's singulate value */
-        if (index_bucket->value.entity == entity) {
-            index_bucket->count = 0u;
-            return;
-        } else {
-            /* Entity doesn't have this component */
-            return;
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + SIG_LANES <= g_sig_words; i += SIG_LANES) {
+        const __m128i f = _mm_loadu_si128((const __m128i *)&look_for->components[i]);
+        const __m128i n = _mm_loadu_si128((const __m128i *)&in->components[i]);
+        const __m128i missing = _mm_andnot_si128(n, f);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(missing, zero)) != 0xFFFF) {
+            return false;
         }
     }
+#endif
 
-    struct index_by_entity_pair *index_pair = NULL;
-    /* Component bucket has entity vector, search it for the entity */
-    FIND_ENTRY_IN_VEC(index_bucket, entity, entity, index_pair);
-
-    if (!index_pair) {
-        /* Entity doesn't have component */
-        return;
+    for (; i < g_sig_words; ++i) {
+        if ((look_for->components[i] & in->components[i]) != look_for->components[i]) {
+            return false;
+        }
     }
 
-    /* Grow the free indices vector if needed */
-    GROW_VEC_IF_NEEDED(&component->free_indices, 32u, indices, size_t);
-    /* Add the removed entity's data index to the free vector */
-    component->free_indices.indices[component->free_indices.count++]
-        = index_pair->index;
-
-    if (index_bucket->count == 2u) {
-        /* After decreasing the count of the bucket, move the last element into
-         * the singulate value. */
-        index_bucket->value = index_bucket->pairs[0u];
-        index_bucket->count = 1u;
-    } else if (index_bucket->count > 1u) {
-        /* Move the last entry in the bucket into this position, overwriting the
-         * removed entity, and decrement the bucket's count */
-        memcpy(index_pair, &index_bucket->pairs[--index_bucket->count], sizeof(struct index_by_entity_pair));
-    } else {
-        /* We don't need to fill any gaps in the bucket, just set its count to zero */
-        index_bucket->count = 0u;
-    }
+    return true;
 }
 
 
-/** Add the given entity to the specified archetype so we can easily find all
- * entities implementing that archetype */
-static void add_entity_to_archetype(const cecs_entity_t entity, struct archetype *archetype)
+/** Returns true if `lhs` and `rhs` have any component in common */
+static __always_inline bool sig_intersects(const struct signature *lhs, const struct signature *rhs)
 {
-    GROW_VEC_IF_NEEDED(archetype, ARCHETYPE_ENTITIES_VEC_MIN_SIZE, entities, sizeof(cecs_entity_t));
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        if (lhs->components[i] & rhs->components[i]) {
+            return true;
+        }
+    }
 
-    archetype->entities[archetype->count++] = entity;
+    return false;
 }
 
 
-/** Increment the given entity set iterator */
-cecs_entity_t cecs_iter_next(cecs_iter_t *it)
+/** Rotate the given word left by the specified number of bits */
+static __always_inline cecs_component_t rotl_word(const cecs_component_t word, const size_t bits)
 {
-    /* Check if we're at the end of the bucket before inspecting the current bucket */
-    if (it->i_bucket == N_ENTITY_SET_BUCKETS) {
-        return CECS_ENTITY_INVALID;
+    const size_t r = bits % 64u;
+    return r == 0u ? word : (word << r) | (word >> (64u - r));
+}
+
+
+/** Hash the given signature. Word `i` is rotated according to `i / SIG_LANES`
+ * and folded into lane `i % SIG_LANES`, and the lanes are mixed at the end.
+ * Zero words contribute nothing, so the hash of a signature doesn't change
+ * as more components are registered and `g_sig_words` grows. */
+static __always_inline uint64_t hash_sig(const struct signature *sig)
+{
+    cecs_component_t lanes[SIG_LANES];
+    size_t i = 0u;
+
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + SIG_LANES <= g_sig_words; i += SIG_LANES) {
+        const __m256i w     = _mm256_loadu_si256((const __m256i *)&sig->components[i]);
+        const size_t r      = ((i / SIG_LANES) * SIG_HASH_ROTATION) % 64u;
+        const __m128i left  = _mm_cvtsi32_si128((int)r);
+        const __m128i right = _mm_cvtsi32_si128((int)(64u - r));
+        /* Shifting right by 64 yields zero, so a rotation by 0 is the word */
+        acc = _mm256_xor_si256(acc, _mm256_or_si256(_mm256_sll_epi64(w, left), _mm256_srl_epi64(w, right)));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + SIG_LANES <= g_sig_words; i += SIG_LANES) {
+        const __m128i w     = _mm_loadu_si128((const __m128i *)&sig->components[i]);
+        const size_t r      = ((i / SIG_LANES) * SIG_HASH_ROTATION) % 64u;
+        const __m128i left  = _mm_cvtsi32_si128((int)r);
+        const __m128i right = _mm_cvtsi32_si128((int)(64u - r));
+        /* Shifting right by 64 yields zero, so a rotation by 0 is the word */
+        acc = _mm_xor_si128(acc, _mm_or_si128(_mm_sll_epi64(w, left), _mm_srl_epi64(w, right)));
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+#else
+    lanes[0u] = 0u;
+#endif
+
+    for (; i < g_sig_words; ++i) {
+        lanes[i % SIG_LANES] ^= rotl_word(sig->components[i], (i / SIG_LANES) * SIG_HASH_ROTATION);
+    }
+
+    /* Mix the lanes in order with the splitmix64 finalizer */
+    cecs_component_t hash = 0u;
+    for (size_t k = 0u; k < SIG_LANES; ++k) {
+        hash ^= lanes[k];
+        hash ^= (hash >> 30u);
+        hash *= 0xbf58476d1ce4e5b9u;
+        hash ^= (hash >> 27u);
+        hash *= 0x94d049bb133111ebu;
+        hash ^= (hash >> 31u);
+    }
+
+    return hash;
+}
+
+
+/** Generate a signature reprensenting all the components in the given vector */
+static struct signature components_to_sig(const cecs_component_t n, va_list components)
+{
+    struct signature sig;
+    memset(&sig, 0u, sizeof(sig));
+
+    for (size_t i = 0u; i < n; ++i) {
+        cecs_component_t id = va_arg(components, cecs_component_t);
+        assert(id > 0 && "Component was not registered with CECS_COMPONENT()");
+        CECS_ADD_COMPONENT(&sig, id);
+    }
+
+    return sig;
+}
+
+
+/** Returns true if an archetype with the given signature matches the terms of
+ * the persistent query */
+static __always_inline bool query_matches_sig(const struct cecs_query *query, const struct signature *sig)
+{
+    return sig_is_in(&query->sig, sig) && !sig_intersects(&query->without, sig)
+        && (!query->has_any_of || sig_intersects(&query->any_of, sig));
+}
+
+
+/** Get the component of the given signature implemented by the fewest
+ * archetypes, or CECS_COMPONENT_INVALID if the signature is empty */
+static cecs_component_t get_rarest_component(const struct cecs_world *world, const struct signature *sig)
+{
+    cecs_component_t rarest = CECS_COMPONENT_INVALID;
+    size_t n_rarest         = SIZE_MAX;
+
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        for (cecs_component_t bits = sig->components[i]; bits; bits &= bits - 1u) {
+            const cecs_component_t id
+                = (cecs_component_t)(i * 64u) + (cecs_component_t)__builtin_ctzll(bits);
+            const size_t count = world->archetypes_by_component[id].count;
+            if (count < n_rarest) {
+                rarest   = id;
+                n_rarest = count;
+            }
+        }
+    }
+
+    return rarest;
+}
+
+
+/** Get all the archetypes that contain the given signature.
+ * The returned vector is reused by the next call. */
+static struct achetype_vec *get_archetypes_by_sig(struct cecs_world *world, const struct signature *sig)
+{
+    struct achetype_vec *vec = &world->archetypes_vec_cache;
+    /* Clear previous results */
+    vec->count = 0u;
+
+    /* Every matching archetype implements each of the components, so only the
+     * shortest of their archetype lists needs checking */
+    const cecs_component_t rarest = get_rarest_component(world, sig);
+    if (rarest != CECS_COMPONENT_INVALID) {
+        const struct achetype_vec *candidates = &world->archetypes_by_component[rarest];
+        for (size_t i = 0u; i < candidates->count; ++i) {
+            if (sig_is_in(sig, &candidates->elements[i]->sig)) {
+                GROW_VEC_IF_NEEDED(vec, ARCHETYPES_VEC_MIN_SIZE, elements, struct cecs_archetype *);
+                vec->elements[vec->count++] = candidates->elements[i];
+            }
+        }
+
+        return vec;
+    }
+
+    /* The empty signature is in every archetype */
+    for (size_t i = 0u; i < world->archetypes.count; ++i) {
+        GROW_VEC_IF_NEEDED(vec, ARCHETYPES_VEC_MIN_SIZE, elements, struct cecs_archetype *);
+        vec->elements[vec->count++] = world->archetypes.elements[i];
+    }
+
+    return vec;
+}
+
+
+/** Return the value of the given hash map holding the specified key, or NULL
+ * if there is none */
+static __always_inline void *hash_map_find(const struct hash_map *map, const uint64_t hash, const void *key, hash_map_eq_fn eq)
+{
+    if (map->cap == 0u) {
+        return NULL;
+    }
+
+    const size_t mask = map->cap - 1u;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1u) & mask) {
+        const struct hash_map_slot *slot = &map->slots[i];
+        if (!slot->value) {
+            /* Keys are never removed, so an empty slot ends the probe */
+            return NULL;
+        }
+        if (slot->hash == hash && eq(slot->value, key)) {
+            return slot->value;
+        }
+    }
+}
+
+
+/** Store the given value in the first free slot of its probe sequence */
+static void hash_map_place(struct hash_map_slot *slots, const size_t cap, const uint64_t hash, void *value)
+{
+    const size_t mask = cap - 1u;
+    size_t i          = (size_t)hash & mask;
+    while (slots[i].value) {
+        i = (i + 1u) & mask;
+    }
+
+    slots[i].hash  = hash;
+    slots[i].value = value;
+}
+
+
+/** Insert a value into the given hash map, which must not already hold its
+ * key, growing the map if it would become more than half full */
+static void hash_map_insert(struct hash_map *map, const uint64_t hash, void *value)
+{
+    if ((map->count + 1u) * 2u > map->cap) {
+        const size_t cap            = map->cap ? map->cap * 2u : HASH_MAP_MIN_SIZE;
+        struct hash_map_slot *slots = alloc_zeroed(cap, sizeof(struct hash_map_slot));
+
+        for (size_t i = 0u; i < map->cap; ++i) {
+            if (map->slots[i].value) {
+                hash_map_place(slots, cap, map->slots[i].hash, map->slots[i].value);
+            }
+        }
+
+        cecs_free(map->slots);
+        map->slots = slots;
+        map->cap   = cap;
+    }
+
+    hash_map_place(map->slots, map->cap, hash, value);
+    ++map->count;
+}
+
+
+/** Measure the occupancy and probe lengths of the given hash map */
+static void hash_map_stats(const struct hash_map *map, cecs_map_stats_t *stats)
+{
+    stats->count        = map->count;
+    stats->capacity     = map->cap;
+    stats->total_probes = 0u;
+    stats->max_probe    = 0u;
+
+    const size_t mask = map->cap - 1u;
+    for (size_t i = 0u; i < map->cap; ++i) {
+        if (!map->slots[i].value) {
+            continue;
+        }
+
+        /* Slots probed to find the value, counting its home slot */
+        const size_t probe = ((i - (size_t)map->slots[i].hash) & mask) + 1u;
+        stats->total_probes += probe;
+        if (probe > stats->max_probe) {
+            stats->max_probe = probe;
+        }
+    }
+}
+
+
+/** Returns true if the given archetype implements the specified signature
+ * exactly */
+static bool archetype_has_sig(const void *archetype, const void *sig)
+{
+    return sigs_are_equal(&((const struct cecs_archetype *)archetype)->sig, sig);
+}
+
+
+/** Populate the sig->archetype map by storing the given archetype pointer as
+ * the map value */
+static struct cecs_archetype *set_archetype_by_sig(struct cecs_world *world, const struct signature *sig, struct cecs_archetype *archetype)
+{
+    hash_map_insert(&world->archetypes_by_sig, hash_sig(sig), archetype);
+
+    GROW_VEC_IF_NEEDED(&world->archetypes, ARCHETYPES_VEC_MIN_SIZE, elements, struct cecs_archetype *);
+    archetype->index = world->archetypes.count;
+    world->archetypes.elements[world->archetypes.count++] = archetype;
+
+    return archetype;
+}
+
+
+/** Return the archetype implementing the given signature */
+static struct cecs_archetype *get_archetype_by_sig(struct cecs_world *world, const struct signature *sig)
+{
+    return hash_map_find(&world->archetypes_by_sig, hash_sig(sig), sig, archetype_has_sig);
+}
+
+
+/** Get the component data for the given component ID */
+static __always_inline struct component_by_id *get_component_by_id(const cecs_component_t id)
+{
+    assert(id > 0 && "Component was not registered with CECS_COMPONENT()");
+
+    return &components_by_id[(size_t)id];
+}
+
+
+/** Get the archetype implementing the given signature, or add an empty one and
+ * return that */
+static struct cecs_archetype *get_or_add_archetype_by_sig(struct cecs_world *world, const struct signature *sig)
+{
+    struct cecs_archetype *existing = get_archetype_by_sig(world, sig);
+    if (existing) {
+        return existing;
+    }
+
+    /* Archetypes are allocated individually so entity records can point at
+     * them while the sig->archetype map grows */
+    struct cecs_archetype *archetype = pool_alloc(&world->archetype_pool);
+    archetype->world = world;
+    archetype->sig   = *sig;
+
+    /* Only components with data get a column */
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        for (cecs_component_t bits = sig->components[i]; bits; bits &= bits - 1u) {
+            const cecs_component_t id
+                = (cecs_component_t)(i * 64u) + (cecs_component_t)__builtin_ctzll(bits);
+            if (get_component_by_id(id)->size > 0u) {
+                CECS_ADD_COMPONENT(&archetype->column_sig, id);
+            }
+
+            struct achetype_vec *by_component = &world->archetypes_by_component[id];
+            GROW_VEC_IF_NEEDED(by_component, ARCHETYPES_VEC_MIN_SIZE, elements, struct cecs_archetype *);
+            by_component->elements[by_component->count++] = archetype;
+        }
+    }
+
+    /* Build one column per component with data, in ascending ID order so a
+     * component's column index is its rank within `column_sig` */
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        archetype->n_columns += (size_t)__builtin_popcountll(archetype->column_sig.components[i]);
+    }
+
+    if (archetype->n_columns > 0u) {
+        archetype->columns = alloc_zeroed(archetype->n_columns, sizeof(struct column));
+    }
+
+    size_t i_column = 0u;
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        /* Visit the set bits of each word from lowest to highest */
+        for (cecs_component_t bits = archetype->column_sig.components[i]; bits; bits &= bits - 1u) {
+            const cecs_component_t id
+                = (cecs_component_t)(i * 64u) + (cecs_component_t)__builtin_ctzll(bits);
+
+            struct column *column = &archetype->columns[i_column++];
+            column->id            = id;
+            column->size          = get_component_by_id(id)->size;
+        }
+    }
+
+    /* Let the persistent queries that match the new archetype track it */
+    for (size_t i = 0u; i < world->queries.count; ++i) {
+        struct cecs_query *query = world->queries.elements[i];
+        if (query_matches_sig(query, sig)) {
+            GROW_VEC_IF_NEEDED(&query->archetypes, ARCHETYPES_VEC_MIN_SIZE, elements, struct cecs_archetype *);
+            query->archetypes.elements[query->archetypes.count++] = archetype;
+        }
+    }
+
+    return set_archetype_by_sig(world, sig, archetype);
+}
+
+
+/** Return the edge of the given archetype for the specified component, adding
+ * an unresolved one if it doesn't exist */
+static struct archetype_edge *get_or_add_edge(struct cecs_archetype *archetype, const cecs_component_t id)
+{
+    struct archetype_edge_vec *vec = &archetype->edges;
+    for (size_t i = 0u; i < vec->count; ++i) {
+        if (vec->edges[i].id == id) {
+            return &vec->edges[i];
+        }
+    }
+
+    GROW_VEC_IF_NEEDED(vec, ARCHETYPE_EDGES_MIN_SIZE, edges, struct archetype_edge);
+    struct archetype_edge *edge = &vec->edges[vec->count++];
+    edge->id                    = id;
+    edge->add                   = NULL;
+    edge->remove                = NULL;
+
+    return edge;
+}
+
+
+/** Return the archetype implementing the components of `from` plus the given
+ * component, following the cached edge if it has been resolved before */
+static struct cecs_archetype *get_archetype_with(struct cecs_world *world, struct cecs_archetype *from, const cecs_component_t id)
+{
+    assert(id > 0 && "Component was not registered with CECS_COMPONENT()");
+
+    if (CECS_HAS_COMPONENT(&from->sig, id)) {
+        return from;
+    }
+
+    struct archetype_edge *edge = get_or_add_edge(from, id);
+    if (!edge->add) {
+        struct signature sig = from->sig;
+        CECS_ADD_COMPONENT(&sig, id);
+
+        struct cecs_archetype *to = get_or_add_archetype_by_sig(world, &sig);
+        edge->add                 = to;
+        /* Removing the component again leads back here */
+        get_or_add_edge(to, id)->remove = from;
+    }
+
+    return edge->add;
+}
+
+
+/** Return the archetype implementing the components of `from` less the given
+ * component, following the cached edge if it has been resolved before */
+static struct cecs_archetype *get_archetype_without(struct cecs_world *world, struct cecs_archetype *from, const cecs_component_t id)
+{
+    assert(id > 0 && "Component was not registered with CECS_COMPONENT()");
+
+    if (!CECS_HAS_COMPONENT(&from->sig, id)) {
+        return from;
+    }
+
+    struct archetype_edge *edge = get_or_add_edge(from, id);
+    if (!edge->remove) {
+        struct signature sig = from->sig;
+        CECS_REMOVE_COMPONENT(&sig, id);
+
+        struct cecs_archetype *to = get_or_add_archetype_by_sig(world, &sig);
+        edge->remove              = to;
+        /* Adding the component again leads back here */
+        get_or_add_edge(to, id)->add = from;
+    }
+
+    return edge->remove;
+}
+
+
+/** Return the archetype implementing no components */
+static struct cecs_archetype *get_root_archetype(struct cecs_world *world)
+{
+    if (!world->root_archetype) {
+        struct signature sig;
+        memset(&sig, 0u, sizeof(sig));
+        world->root_archetype = get_or_add_archetype_by_sig(world, &sig);
+    }
+
+    return world->root_archetype;
+}
+
+
+/** Return the column of the given archetype holding the specified component,
+ * or NULL if the archetype doesn't implement it */
+static __always_inline struct column *get_column(const struct cecs_archetype *archetype, const cecs_component_t id)
+{
+    if (!CECS_HAS_COMPONENT(&archetype->column_sig, id)) {
+        return NULL;
+    }
+
+    /* The column index is the number of components with data with a lower ID
+     * than the one requested */
+    const size_t i_word = (size_t)CECS_COMPONENT_TO_INDEX(id);
+    size_t i_column     = 0u;
+    for (size_t i = 0u; i < i_word; ++i) {
+        i_column += (size_t)__builtin_popcountll(archetype->column_sig.components[i]);
+    }
+    i_column += (size_t)__builtin_popcountll(
+        archetype->column_sig.components[i_word] & (CECS_COMPONENT_TO_BITS(id) - 1u)
+    );
+
+    return &archetype->columns[i_column];
+}
+
+
+/** Return the record for the given entity index, allocating its page if
+ * requested and needed. Returns NULL if the page doesn't exist and wasn't
+ * allocated. */
+static __always_inline struct record_by_entity_entry *get_record_slot(struct cecs_world *world, const uint32_t index, const bool allocate)
+{
+    const size_t i_page = (size_t)index / RECORD_PAGE_SIZE;
+    struct record_by_entity_map *map = &world->records_by_entity;
+
+    if (i_page >= map->n_pages || !map->pages[i_page]) {
+        if (!allocate) {
+            return NULL;
+        }
+
+        if (i_page >= map->n_pages) {
+            /* Grow the page directory to cover the index, leaving the new
+             * pages unallocated */
+            size_t n_pages = (map->n_pages == 0u) ? (size_t)1u : map->n_pages;
+            while (n_pages <= i_page) {
+                n_pages *= 2u;
+            }
+            map->pages = cecs_realloc(map->pages, n_pages * sizeof(struct record_by_entity_entry *));
+            memset(map->pages + map->n_pages, 0u, (n_pages - map->n_pages) * sizeof(struct record_by_entity_entry *));
+            map->n_pages = n_pages;
+        }
+
+        map->pages[i_page] = alloc_zeroed(RECORD_PAGE_SIZE, sizeof(struct record_by_entity_entry));
+    }
+
+    return &map->pages[i_page][(size_t)index & (RECORD_PAGE_SIZE - 1u)];
+}
+
+
+/** Populate the entity->record map */
+static void set_record_by_entity(struct cecs_world *world, const cecs_entity_t entity, struct cecs_archetype *archetype, const size_t row)
+{
+    struct record_by_entity_entry *entry = get_record_slot(world, CECS_ENTITY_INDEX(entity), true);
+
+    entry->archetype  = archetype;
+    entry->row        = row;
+    entry->generation = CECS_ENTITY_GENERATION(entity);
+}
+
+
+/** Get the archetype row holding the data of the given entity, or NULL if the
+ * entity doesn't exist or the handle is stale */
+static struct record_by_entity_entry *get_record_by_entity(struct cecs_world *world, const cecs_entity_t entity)
+{
+    struct record_by_entity_entry *entry = get_record_slot(world, CECS_ENTITY_INDEX(entity), false);
+
+    if (!entry || !entry->archetype || entry->generation != CECS_ENTITY_GENERATION(entity)) {
+        return NULL;
+    }
+
+    return entry;
+}
+
+
+/** Return a handle for a new entity, reusing the index of a destroyed entity
+ * if there is one */
+static cecs_entity_t new_entity(struct cecs_world *world)
+{
+    struct record_by_entity_map *map = &world->records_by_entity;
+
+    if (map->free_indices.count > 0u) {
+        /* The generation was bumped when the previous entity was destroyed */
+        const uint32_t index = map->free_indices.indices[--map->free_indices.count];
+        return CECS_ENTITY(index, get_record_slot(world, index, false)->generation);
+    }
+
+    assert(map->next_index < UINT32_MAX && "Out of entity indices");
+
+    return CECS_ENTITY(map->next_index++, 0u);
+}
+
+
+/** Resize the given array, freeing it if the new size is 0 */
+static __always_inline void *resize_array(void *ptr, const size_t size)
+{
+    if (size == 0u) {
+        cecs_free(ptr);
+        return NULL;
+    }
+
+    return cecs_realloc(ptr, size);
+}
+
+
+/** Resize the table of the given archetype to hold exactly `cap` rows, which
+ * must be at least its row count, reallocating each column once */
+static void resize_archetype_rows(struct cecs_archetype *archetype, const size_t cap)
+{
+    assert(cap >= archetype->count && "Table can't shrink below its rows");
+
+    archetype->entities = resize_array(archetype->entities, cap * sizeof(cecs_entity_t));
+
+    const size_t n_chunks     = CHUNKS_FOR_ROWS(cap);
+    const size_t n_old_chunks = CHUNKS_FOR_ROWS(archetype->cap);
+
+    archetype->added   = resize_array(archetype->added, n_chunks * sizeof(cecs_tick_t));
+    archetype->toggled = resize_array(archetype->toggled, n_chunks * sizeof(cecs_tick_t));
+    if (n_chunks > n_old_chunks) {
+        memset(&archetype->added[n_old_chunks], 0u, (n_chunks - n_old_chunks) * sizeof(cecs_tick_t));
+        memset(&archetype->toggled[n_old_chunks], 0u, (n_chunks - n_old_chunks) * sizeof(cecs_tick_t));
+    }
+
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        struct column *column = &archetype->columns[i];
+
+        column->changed = resize_array(column->changed, n_chunks * sizeof(cecs_tick_t));
+        if (n_chunks > n_old_chunks) {
+            memset(&column->changed[n_old_chunks], 0u, (n_chunks - n_old_chunks) * sizeof(cecs_tick_t));
+        }
+
+        column->data = resize_array(column->data, cap * column->size);
+#ifdef CECS_ZERO_NEW_COMPONENT_DATA
+        if (cap > archetype->cap) {
+            memset(
+                COLUMN_DATA_PTR(column, archetype->cap),
+                0u,
+                (cap - archetype->cap) * column->size
+            );
+        }
+#endif
+    }
+
+    if (cap == 0u) {
+        /* No rows are left to be disabled */
+        for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+            cecs_free(archetype->enabled.masks[i].bits);
+        }
+        archetype->enabled.count = 0u;
+    }
+
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        struct enabled_mask *mask = &archetype->enabled.masks[i];
+        mask->bits = cecs_realloc(mask->bits, ENABLED_MASK_WORDS(cap) * sizeof(uint64_t));
+    }
+
+    archetype->cap = cap;
+}
+
+
+/** Grow the table of the given archetype so it can hold at least `n_rows` rows,
+ * reallocating each column at most once */
+static void reserve_archetype_rows(struct cecs_archetype *archetype, const size_t n_rows)
+{
+    if (n_rows <= archetype->cap) {
+        return;
+    }
+
+    size_t cap = (archetype->cap == 0u) ? ARCHETYPE_MIN_ROWS : archetype->cap * 2u;
+    while (cap < n_rows) {
+        cap *= 2u;
+    }
+
+    resize_archetype_rows(archetype, cap);
+}
+
+
+/** Grow the table of the given archetype so it can hold at least one more row */
+static __always_inline void grow_archetype_if_needed(struct cecs_archetype *archetype)
+{
+    reserve_archetype_rows(archetype, archetype->count + 1u);
+}
+
+
+/** Get the enabled mask of the given archetype for the specified component,
+ * or NULL if the component is enabled on every row */
+static __always_inline struct enabled_mask *get_enabled_mask(const struct cecs_archetype *archetype, const cecs_component_t id)
+{
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        if (archetype->enabled.masks[i].id == id) {
+            return &archetype->enabled.masks[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/** Returns whether the given bit of an enabled mask is set */
+#define ENABLED_BIT(bits, row) (((bits)[(row) / 64u] >> ((row) % 64u)) & 1u)
+
+
+/** Set or clear the given bit of an enabled mask */
+static __always_inline void set_enabled_bit(uint64_t *bits, const size_t row, const bool enabled)
+{
+    const uint64_t bit = (uint64_t)1u << (row % 64u);
+    if (enabled) {
+        bits[row / 64u] |= bit;
+    } else {
+        bits[row / 64u] &= ~bit;
+    }
+}
+
+
+/** Set whether the given component is enabled on a row of the specified
+ * archetype, adding a mask for it if it's being disabled for the first time */
+static void set_row_enabled(struct cecs_archetype *archetype, const cecs_component_t id, const size_t row, const bool enabled)
+{
+    struct enabled_mask *mask = get_enabled_mask(archetype, id);
+    if (!mask) {
+        if (enabled) {
+            /* Already enabled on every row */
+            return;
+        }
+
+        struct enabled_mask_vec *masks = &archetype->enabled;
+        GROW_VEC_IF_NEEDED(masks, ENABLED_MASKS_MIN_SIZE, masks, struct enabled_mask);
+
+        mask       = &masks->masks[masks->count++];
+        mask->id   = id;
+        mask->bits = cecs_alloc(ENABLED_MASK_WORDS(archetype->cap) * sizeof(uint64_t));
+        memset(mask->bits, 0xFF, ENABLED_MASK_WORDS(archetype->cap) * sizeof(uint64_t));
+    }
+
+    set_enabled_bit(mask->bits, row, enabled);
+}
+
+
+/** Carry the disabled components of a row of one archetype over to a row of
+ * another, for the components both implement */
+static void copy_row_enabled(struct cecs_archetype *from, const size_t from_row, struct cecs_archetype *to, const size_t to_row)
+{
+    for (size_t i = 0u; i < from->enabled.count; ++i) {
+        const struct enabled_mask *mask = &from->enabled.masks[i];
+        if (!ENABLED_BIT(mask->bits, from_row) && CECS_HAS_COMPONENT(&to->sig, mask->id)) {
+            set_row_enabled(to, mask->id, to_row, false);
+        }
+    }
+}
+
+
+/** Stamp the chunks covering the given rows of the archetype as added to and
+ * written at the current tick */
+static void mark_rows_added(struct cecs_archetype *archetype, const size_t first_row, const size_t n_rows)
+{
+    const cecs_tick_t tick = archetype->world->tick;
+    const size_t end       = CHUNK_OF_ROW(first_row + n_rows - 1u);
+
+    for (size_t i_chunk = CHUNK_OF_ROW(first_row); i_chunk <= end; ++i_chunk) {
+        archetype->added[i_chunk] = tick;
+        for (size_t i = 0u; i < archetype->n_columns; ++i) {
+            archetype->columns[i].changed[i_chunk] = tick;
+        }
+    }
+}
+
+
+/** Stamp the chunk of the column holding the given row as written at the
+ * current tick */
+static __always_inline void mark_changed(const struct cecs_archetype *archetype, struct column *column, const size_t row)
+{
+    column->changed[CHUNK_OF_ROW(row)] = archetype->world->tick;
+}
+
+
+/** Stamp the chunk of the archetype holding the given row as having a
+ * component enabled or disabled at the current tick */
+static __always_inline void mark_toggled(struct cecs_archetype *archetype, const size_t row)
+{
+    archetype->toggled[CHUNK_OF_ROW(row)] = archetype->world->tick;
+}
+
+
+/** Log the removal of the tracked components in `from` but not in `to` from
+ * the given entities. `to` may be NULL if the entities are destroyed, which
+ * is logged too if destroys are tracked. */
+static void log_removed(struct cecs_world *world, const struct cecs_archetype *from, const struct cecs_archetype *to, const cecs_entity_t *entities, const size_t n_entities)
+{
+    if (!world->tracks_removed) {
+        return;
+    }
+
+    if (!to && world->tracks_destroyed) {
+        for (size_t i = 0u; i < n_entities; ++i) {
+            struct removed_vec *log = &world->removed;
+            GROW_VEC_IF_NEEDED(log, REMOVED_LOG_MIN_SIZE, entries, struct removed_entry);
+            log->entries[log->count++] = (struct removed_entry){
+                .entity = entities[i], .id = CECS_COMPONENT_INVALID, .tick = world->tick
+            };
+        }
+    }
+
+    for (size_t i_word = 0u; i_word < g_sig_words; ++i_word) {
+        cecs_component_t removed = from->sig.components[i_word] & world->removed_tracked.components[i_word];
+        if (to) {
+            removed &= ~to->sig.components[i_word];
+        }
+
+        for (; removed; removed &= removed - 1u) {
+            const cecs_component_t id
+                = (cecs_component_t)(i_word * 64u) + (cecs_component_t)__builtin_ctzll(removed);
+
+            for (size_t i = 0u; i < n_entities; ++i) {
+                struct removed_vec *log = &world->removed;
+                GROW_VEC_IF_NEEDED(log, REMOVED_LOG_MIN_SIZE, entries, struct removed_entry);
+                log->entries[log->count++] = (struct removed_entry){
+                    .entity = entities[i], .id = id, .tick = world->tick
+                };
+            }
+        }
+    }
+}
+
+
+/** Append a row for the given entity to the table of the specified archetype
+ * and return its index. The row's component data is left uninitialized, its
+ * components are enabled, and its chunk is stamped as added to and written. */
+static size_t add_entity_to_archetype(const cecs_entity_t entity, struct cecs_archetype *archetype)
+{
+    grow_archetype_if_needed(archetype);
+
+    const size_t row = archetype->count++;
+    archetype->entities[row] = entity;
+
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        set_enabled_bit(archetype->enabled.masks[i].bits, row, true);
+    }
+
+    mark_rows_added(archetype, row, 1u);
+
+    return row;
+}
+
+
+/** Bring the ticks of the chunk holding row `from` of the given archetype to
+ * the chunk holding row `to`, after moving the row, so changes to it are still
+ * seen in its new chunk */
+static void carry_chunk_ticks(struct cecs_archetype *archetype, const size_t to, const size_t from)
+{
+    const size_t to_chunk   = CHUNK_OF_ROW(to);
+    const size_t from_chunk = CHUNK_OF_ROW(from);
+    if (to_chunk == from_chunk) {
+        return;
+    }
+
+    if (archetype->added[from_chunk] > archetype->added[to_chunk]) {
+        archetype->added[to_chunk] = archetype->added[from_chunk];
+    }
+    if (archetype->toggled[from_chunk] > archetype->toggled[to_chunk]) {
+        archetype->toggled[to_chunk] = archetype->toggled[from_chunk];
+    }
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        cecs_tick_t *changed = archetype->columns[i].changed;
+        if (changed[from_chunk] > changed[to_chunk]) {
+            changed[to_chunk] = changed[from_chunk];
+        }
+    }
+}
+
+
+/** Remove the given row from the table of the specified archetype by moving
+ * the last row into its place */
+static void remove_row_from_archetype(struct cecs_world *world, struct cecs_archetype *archetype, const size_t row)
+{
+    const size_t last = --archetype->count;
+    if (row == last) {
+        return;
+    }
+
+    const cecs_entity_t moved = archetype->entities[last];
+    archetype->entities[row]  = moved;
+
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        struct column *column = &archetype->columns[i];
+        memcpy(COLUMN_DATA_PTR(column, row), COLUMN_DATA_PTR(column, last), column->size);
+    }
+
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        uint64_t *bits = archetype->enabled.masks[i].bits;
+        set_enabled_bit(bits, row, ENABLED_BIT(bits, last));
+    }
+
+    carry_chunk_ticks(archetype, row, last);
+
+    /* The entity that was in the last row now lives in the removed row */
+    set_record_by_entity(world, moved, archetype, row);
+}
+
+
+/** Move the given entity from its current archetype into the specified one,
+ * carrying over the data of every component both archetypes implement */
+static void move_entity_to_archetype(struct cecs_world *world, const cecs_entity_t entity, struct record_by_entity_entry *record, struct cecs_archetype *to)
+{
+    struct cecs_archetype *from = record->archetype;
+    const size_t from_row  = record->row;
+    const size_t to_row    = add_entity_to_archetype(entity, to);
+
+    for (size_t i = 0u; i < to->n_columns; ++i) {
+        struct column *column      = &to->columns[i];
+        struct column *from_column = get_column(from, column->id);
+        if (from_column) {
+            memcpy(COLUMN_DATA_PTR(column, to_row), COLUMN_DATA_PTR(from_column, from_row), column->size);
+        }
+#ifdef CECS_ZERO_NEW_COMPONENT_DATA
+        else {
+            memset(COLUMN_DATA_PTR(column, to_row), 0u, column->size);
+        }
+#endif
+    }
+
+    copy_row_enabled(from, from_row, to, to_row);
+    log_removed(world, from, to, &entity, 1u);
+
+    /* Record the new location before the swap-remove, which may rewrite the
+     * record of whichever entity fills the vacated row */
+    set_record_by_entity(world, entity, to, to_row);
+    remove_row_from_archetype(world, from, from_row);
+}
+
+
+/** Move every row of one archetype's table to the end of another's, carrying
+ * over the data of every component both archetypes implement. Costs one copy
+ * per column plus a record update per entity. */
+static void move_archetype_rows(struct cecs_world *world, struct cecs_archetype *from, struct cecs_archetype *to)
+{
+    const size_t count = from->count;
+    if (count == 0u) {
+        return;
+    }
+
+    reserve_archetype_rows(to, to->count + count);
+    const size_t first_row = to->count;
+
+    memcpy(&to->entities[first_row], from->entities, count * sizeof(cecs_entity_t));
+
+    for (size_t i = 0u; i < to->n_columns; ++i) {
+        struct column *column      = &to->columns[i];
+        struct column *from_column = get_column(from, column->id);
+        if (from_column) {
+            memcpy(COLUMN_DATA_PTR(column, first_row), from_column->data, count * column->size);
+        }
+#ifdef CECS_ZERO_NEW_COMPONENT_DATA
+        else {
+            memset(COLUMN_DATA_PTR(column, first_row), 0u, count * column->size);
+        }
+#endif
+    }
+
+    for (size_t row = 0u; row < count; ++row) {
+        set_record_by_entity(world, to->entities[first_row + row], to, first_row + row);
+        for (size_t i = 0u; i < to->enabled.count; ++i) {
+            set_enabled_bit(to->enabled.masks[i].bits, first_row + row, true);
+        }
+        copy_row_enabled(from, row, to, first_row + row);
+    }
+
+    mark_rows_added(to, first_row, count);
+    log_removed(world, from, to, from->entities, count);
+
+    to->count += count;
+    from->count = 0u;
+}
+
+
+/** Get the world used by the API functions that don't name one */
+cecs_world_t *cecs_default_world(void)
+{
+    return &g_default_world;
+}
+
+
+/** Set up the given zeroed world to hold no entities */
+static void init_world(struct cecs_world *world)
+{
+    /* Index 0 is reserved so no entity handle equals CECS_ENTITY_INVALID */
+    world->records_by_entity.next_index = 1u;
+    /* Tick 0 is reserved for chunks that were never written */
+    world->tick = 1u;
+
+    world->archetype_pool = (struct pool)POOL_INIT(struct cecs_archetype);
+    world->query_pool     = (struct pool)POOL_INIT(struct cecs_query);
+    atomic_flag_clear(&world->frame.lock);
+}
+
+
+/** Create a new, empty world */
+cecs_world_t *cecs_world_create(void)
+{
+    struct cecs_world *world = alloc_zeroed(1u, sizeof(struct cecs_world));
+    init_world(world);
+
+    return world;
+}
+
+
+/** Free the table, columns and edges of the given archetype */
+static void free_archetype(struct cecs_archetype *archetype)
+{
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        cecs_free(archetype->columns[i].data);
+        cecs_free(archetype->columns[i].changed);
+    }
+
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        cecs_free(archetype->enabled.masks[i].bits);
+    }
+
+    cecs_free(archetype->enabled.masks);
+    cecs_free(archetype->added);
+    cecs_free(archetype->toggled);
+    cecs_free(archetype->columns);
+    cecs_free(archetype->entities);
+    cecs_free(archetype->edges.edges);
+    pool_free(&archetype->world->archetype_pool, archetype);
+}
+
+
+/** Free everything owned by the given world, but not the world itself */
+static void release_world(struct cecs_world *world)
+{
+    for (size_t i = 0u; i < world->archetypes.count; ++i) {
+        free_archetype(world->archetypes.elements[i]);
+    }
+    cecs_free(world->archetypes.elements);
+    cecs_free(world->archetypes_by_sig.slots);
+
+    struct record_by_entity_map *map = &world->records_by_entity;
+    for (size_t i = 0u; i < map->n_pages; ++i) {
+        cecs_free(map->pages[i]);
+    }
+    cecs_free(map->pages);
+    cecs_free(map->free_indices.indices);
+
+    for (size_t i = 0u; i < world->queries.count; ++i) {
+        cecs_free(world->queries.elements[i]->archetypes.elements);
+    }
+    cecs_free(world->queries.elements);
+    cecs_free(world->archetypes_vec_cache.elements);
+    cecs_free(world->removed.entries);
+
+    for (size_t i = 0u; i < CECS_N_COMPONENTS; ++i) {
+        cecs_free(world->archetypes_by_component[i].elements);
+    }
+
+    pool_destroy(&world->archetype_pool);
+    pool_destroy(&world->query_pool);
+    arena_destroy(&world->frame);
+}
+
+
+/** Destroy the given world, releasing its entities, archetypes and persistent
+ * queries */
+void cecs_world_destroy(cecs_world_t *world)
+{
+    assert(world != &g_default_world && "The default world can't be destroyed");
+
+    release_world(world);
+    cecs_free(world);
+}
+
+
+/** Release everything CECS has allocated outside the worlds created with
+ * cecs_world_create() */
+void cecs_shutdown(void)
+{
+    cecs_parallel_shutdown();
+
+    /* The default world starts over empty */
+    release_world(&g_default_world);
+    memset(&g_default_world, 0u, sizeof(g_default_world));
+    init_world(&g_default_world);
+}
+
+
+/** Shrink the given vector's allocation to its element count */
+#define SHRINK_VEC(vec, entries, type)                                            \
+    if ((vec)->count < (vec)->cap) {                                              \
+        (vec)->entries = resize_array((vec)->entries, (vec)->count * sizeof(type)); \
+        (vec)->cap     = (vec)->count;                                            \
+    }
+
+
+/** Reserve room for `n_rows` entities in the table of the archetype with the
+ * given components */
+void _cecs_reserve(cecs_world_t *world, const size_t n_rows, const cecs_component_t n, ...)
+{
+    va_list components;
+    va_start(components, n);
+    const struct signature sig = components_to_sig(n, components);
+    va_end(components);
+
+    struct cecs_archetype *archetype = get_or_add_archetype_by_sig(world, &sig);
+    if (n_rows > archetype->cap) {
+        /* Reserve exactly what was asked for rather than the next doubling */
+        resize_archetype_rows(archetype, n_rows);
+    }
+}
+
+
+/** Shrink the tables and bookkeeping of the given world to fit their contents */
+void cecs_shrink(cecs_world_t *world)
+{
+    for (size_t i = 0u; i < world->archetypes.count; ++i) {
+        struct cecs_archetype *archetype = world->archetypes.elements[i];
+        if (archetype->count < archetype->cap) {
+            resize_archetype_rows(archetype, archetype->count);
+        }
+    }
+
+    SHRINK_VEC(&world->records_by_entity.free_indices, indices, uint32_t);
+    SHRINK_VEC(&world->removed, entries, struct removed_entry);
+
+    /* Scratch space is rebuilt on demand */
+    cecs_free(world->archetypes_vec_cache.elements);
+    memset(&world->archetypes_vec_cache, 0u, sizeof(world->archetypes_vec_cache));
+    arena_destroy(&world->frame);
+}
+
+
+/** Sort entity indices in descending order */
+static int compare_indices_descending(const void *lhs, const void *rhs)
+{
+    const uint32_t a = *(const uint32_t *)lhs;
+    const uint32_t b = *(const uint32_t *)rhs;
+
+    return (a < b) - (a > b);
+}
+
+
+/** Returns true if the given entity indices are in descending order, so a pass
+ * over an unchanged free list doesn't sort it again */
+static bool indices_sorted_descending(const struct index_vec *indices)
+{
+    for (size_t i = 1u; i < indices->count; ++i) {
+        if (indices->indices[i - 1u] < indices->indices[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** Shrink the table of the given archetype if it has been left mostly empty,
+ * to its row count rounded up to a power of two, and no less than
+ * ARCHETYPE_MIN_ROWS, so the table doesn't immediately have to grow again */
+static void compact_archetype(struct cecs_archetype *archetype)
+{
+    if (archetype->count == 0u) {
+        if (archetype->cap > 0u) {
+            resize_archetype_rows(archetype, 0u);
+        }
+        return;
+    }
+
+    if (archetype->count > archetype->cap / 4u) {
+        return;
+    }
+
+    size_t cap = ARCHETYPE_MIN_ROWS;
+    while (cap < archetype->count) {
+        cap *= 2u;
+    }
+
+    if (cap < archetype->cap) {
+        resize_archetype_rows(archetype, cap);
+    }
+}
+
+
+/** Current time in microseconds on a clock that never steps, for measuring
+ * time budgets */
+static uint64_t now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+
+/** Compact the given world's storage for up to `budget_us` microseconds,
+ * resuming where the previous call left off */
+bool cecs_compact(cecs_world_t *world, const uint64_t budget_us)
+{
+    const uint64_t start = now_us();
+
+    /* Take at least one step per call so a tiny budget still progresses. Each
+     * archetype is a step, and sorting the free list is the last one of a
+     * pass, so it is only started while there's budget left. */
+    do {
+        if (world->compact_cursor < world->archetypes.count) {
+            compact_archetype(world->archetypes.elements[world->compact_cursor++]);
+            continue;
+        }
+
+        /* Hand out the lowest free entity indices first, so new entities
+         * fill the front of the record table rather than its tail */
+        struct index_vec *free_indices = &world->records_by_entity.free_indices;
+        if (!indices_sorted_descending(free_indices)) {
+            qsort(free_indices->indices, free_indices->count, sizeof(uint32_t), compare_indices_descending);
+        }
+
+        world->compact_cursor = 0u;
+        return true;
+    } while (now_us() - start < budget_us);
+
+    return false;
+}
+
+
+/** Number of element shifts per row the insertion sort in sort_rows() may
+ * spend before the rows are deemed too far out of order for it */
+#define SORT_INSERTION_SHIFTS_PER_ROW ((size_t)8u)
+
+
+/** Stable merge sort of the row indices in `order` by the column data they
+ * refer to, using `scratch` which must be as long as `order` */
+static void merge_sort_rows(size_t *order, size_t *scratch, const size_t count, const struct column *column, cecs_compare_fn compare)
+{
+    for (size_t width = 1u; width < count; width *= 2u) {
+        for (size_t lo = 0u; lo < count; lo += 2u * width) {
+            const size_t mid = (lo + width < count) ? lo + width : count;
+            const size_t hi  = (mid + width < count) ? mid + width : count;
+
+            size_t a = lo, b = mid, out = lo;
+            while (a < mid && b < hi) {
+                if (compare(COLUMN_DATA_PTR(column, order[b]), COLUMN_DATA_PTR(column, order[a])) < 0) {
+                    scratch[out++] = order[b++];
+                }
+                else {
+                    scratch[out++] = order[a++];
+                }
+            }
+            while (a < mid) {
+                scratch[out++] = order[a++];
+            }
+            while (b < hi) {
+                scratch[out++] = order[b++];
+            }
+        }
+        memcpy(order, scratch, count * sizeof(size_t));
+    }
+}
+
+
+/** Fill `order` with the rows of the given archetype sorted by their data in
+ * the given column, so row `order[i]` belongs at `i`. Nearly sorted tables
+ * are finished by insertion sort in close to linear time; tables too far out
+ * of order for that fall back to a merge sort. Returns false if the rows are
+ * already in order. */
+static bool sort_rows(const struct cecs_archetype *archetype, const struct column *column, cecs_compare_fn compare, size_t *order)
+{
+    const size_t count = archetype->count;
+    for (size_t i = 0u; i < count; ++i) {
+        order[i] = i;
+    }
+
+    const size_t max_shifts = count * SORT_INSERTION_SHIFTS_PER_ROW;
+    size_t shifts = 0u;
+    for (size_t i = 1u; i < count && shifts <= max_shifts; ++i) {
+        const size_t row = order[i];
+        const void *key  = COLUMN_DATA_PTR(column, row);
+
+        size_t j = i;
+        while (j > 0u && compare(key, COLUMN_DATA_PTR(column, order[j - 1u])) < 0) {
+            order[j] = order[j - 1u];
+            --j;
+        }
+        order[j] = row;
+        shifts += i - j;
+    }
+
+    if (shifts == 0u) {
+        return false;
+    }
+
+    if (shifts > max_shifts) {
+        size_t *scratch = cecs_alloc(count * sizeof(size_t));
+        merge_sort_rows(order, scratch, count, column, compare);
+        cecs_free(scratch);
+    }
+
+    return true;
+}
+
+
+/** Copy row `from` of the given archetype's table over row `to` */
+static void copy_row(struct cecs_archetype *archetype, const size_t to, const size_t from)
+{
+    archetype->entities[to] = archetype->entities[from];
+
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        struct column *column = &archetype->columns[i];
+        memcpy(COLUMN_DATA_PTR(column, to), COLUMN_DATA_PTR(column, from), column->size);
+    }
+
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        uint64_t *bits = archetype->enabled.masks[i].bits;
+        set_enabled_bit(bits, to, ENABLED_BIT(bits, from));
+    }
+
+    carry_chunk_ticks(archetype, to, from);
+}
+
+
+/** Save row `row` of the given archetype's table to `saved`, which holds an
+ * entity followed by one element of each column */
+static void save_row(const struct cecs_archetype *archetype, const size_t row, uint8_t *saved, bool *saved_enabled)
+{
+    memcpy(saved, &archetype->entities[row], sizeof(cecs_entity_t));
+    saved += sizeof(cecs_entity_t);
+
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        const struct column *column = &archetype->columns[i];
+        memcpy(saved, COLUMN_DATA_PTR(column, row), column->size);
+        saved += column->size;
+    }
+
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        saved_enabled[i] = ENABLED_BIT(archetype->enabled.masks[i].bits, row);
+    }
+}
+
+
+/** Restore a row saved by save_row() into row `row` of the given archetype */
+static void restore_row(struct cecs_archetype *archetype, const size_t row, const uint8_t *saved, const bool *saved_enabled)
+{
+    memcpy(&archetype->entities[row], saved, sizeof(cecs_entity_t));
+    saved += sizeof(cecs_entity_t);
+
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        struct column *column = &archetype->columns[i];
+        memcpy(COLUMN_DATA_PTR(column, row), saved, column->size);
+        saved += column->size;
+    }
+
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        set_enabled_bit(archetype->enabled.masks[i].bits, row, saved_enabled[i]);
+    }
+}
+
+
+/** Reorder the rows of the given archetype's table by the data of the given
+ * column, moving the entities and every column together */
+static void sort_archetype(struct cecs_world *world, struct cecs_archetype *archetype, const struct column *column, cecs_compare_fn compare)
+{
+    if (archetype->count < 2u) {
+        return;
+    }
+
+    size_t *order = cecs_alloc(archetype->count * sizeof(size_t));
+    if (!sort_rows(archetype, column, compare, order)) {
+        cecs_free(order);
+        return;
+    }
+
+    size_t row_size = sizeof(cecs_entity_t);
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        row_size += archetype->columns[i].size;
+    }
+    uint8_t *saved      = cecs_alloc(row_size);
+    bool *saved_enabled = cecs_alloc((archetype->enabled.count + 1u) * sizeof(bool));
+
+    /* Apply the permutation one cycle at a time, so only one row is ever held
+     * outside the table. Rows are marked done by pointing them at themselves. */
+    for (size_t start = 0u; start < archetype->count; ++start) {
+        if (order[start] == start) {
+            continue;
+        }
+
+        save_row(archetype, start, saved, saved_enabled);
+
+        size_t to = start;
+        while (order[to] != start) {
+            const size_t from = order[to];
+            copy_row(archetype, to, from);
+            order[to] = to;
+            to        = from;
+        }
+        restore_row(archetype, to, saved, saved_enabled);
+        carry_chunk_ticks(archetype, to, start);
+        order[to] = to;
+    }
+
+    for (size_t row = 0u; row < archetype->count; ++row) {
+        get_record_slot(world, CECS_ENTITY_INDEX(archetype->entities[row]), false)->row = row;
+    }
+
+    cecs_free(saved_enabled);
+    cecs_free(saved);
+    cecs_free(order);
+}
+
+
+/** Sort the rows of every archetype in the given world implementing the
+ * specified component by its data */
+void _cecs_sort_by(cecs_world_t *world, const cecs_component_t id, cecs_compare_fn compare)
+{
+    const struct achetype_vec *archetypes = &world->archetypes_by_component[id];
+    for (size_t i = 0u; i < archetypes->count; ++i) {
+        struct cecs_archetype *archetype = archetypes->elements[i];
+        const struct column *column      = get_column(archetype, id);
+        assert(column && "Can't sort by a component without data");
+
+        sort_archetype(world, archetype, column, compare);
+    }
+}
+
+
+/** Add `count` bytes used and `cap` bytes allocated to the given usage */
+static __always_inline void add_usage(cecs_memory_usage_t *usage, const size_t count, const size_t cap)
+{
+    usage->used += count;
+    usage->allocated += cap;
+}
+
+
+/** Add the memory held by the given archetype's table, other than its
+ * component data, to the usage */
+static void add_table_usage(const struct cecs_archetype *archetype, cecs_memory_usage_t *usage)
+{
+    add_usage(usage, archetype->count * sizeof(cecs_entity_t), archetype->cap * sizeof(cecs_entity_t));
+
+    /* Column headers, chunk ticks, enabled masks and edges are needed whole */
+    size_t bookkeeping = archetype->n_columns * sizeof(struct column);
+    bookkeeping += CHUNKS_FOR_ROWS(archetype->cap) * sizeof(cecs_tick_t) * (archetype->n_columns + 1u);
+    bookkeeping += archetype->enabled.count * ENABLED_MASK_WORDS(archetype->cap) * sizeof(uint64_t);
+    bookkeeping += archetype->enabled.cap * sizeof(struct enabled_mask);
+    bookkeeping += archetype->edges.cap * sizeof(struct archetype_edge);
+    add_usage(usage, bookkeeping, bookkeeping);
+}
+
+
+/** Add the memory held by the given archetype's component data to the usage */
+static void add_column_usage(const struct cecs_archetype *archetype, cecs_memory_usage_t *usage)
+{
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        const size_t size = archetype->columns[i].size;
+        add_usage(usage, archetype->count * size, archetype->cap * size);
+    }
+}
+
+
+/** Measure the memory held by the table of the given archetype */
+void cecs_archetype_memory(const struct cecs_archetype *archetype, cecs_memory_usage_t *usage)
+{
+    memset(usage, 0u, sizeof(*usage));
+    add_table_usage(archetype, usage);
+    add_column_usage(archetype, usage);
+}
+
+
+/** Measure the memory held by the given component's columns in the given world */
+void _cecs_component_memory(cecs_world_t *world, const cecs_component_t id, cecs_memory_usage_t *usage)
+{
+    memset(usage, 0u, sizeof(*usage));
+
+    const struct achetype_vec *archetypes = &world->archetypes_by_component[id];
+    for (size_t i = 0u; i < archetypes->count; ++i) {
+        const struct cecs_archetype *archetype = archetypes->elements[i];
+        const struct column *column            = get_column(archetype, id);
+        if (column) {
+            add_usage(usage, archetype->count * column->size, archetype->cap * column->size);
+        }
+    }
+}
+
+
+/** Count the slabs of the given pool */
+static size_t count_pool_slabs(const struct pool *pool)
+{
+    size_t n_slabs = 0u;
+    for (void *slab = pool->slabs; slab; slab = *(void **)slab) {
+        ++n_slabs;
+    }
+
+    return n_slabs;
+}
+
+
+/** Measure the memory held by the given world */
+void cecs_memory_stats(cecs_world_t *world, cecs_memory_stats_t *stats)
+{
+    memset(stats, 0u, sizeof(*stats));
+
+    for (size_t i = 0u; i < world->archetypes.count; ++i) {
+        add_table_usage(world->archetypes.elements[i], &stats->tables);
+        add_column_usage(world->archetypes.elements[i], &stats->columns);
+    }
+
+    const struct record_by_entity_map *map = &world->records_by_entity;
+    add_usage(&stats->entity_index, 0u, map->n_pages * sizeof(struct record_by_entity_entry *));
+    for (size_t i = 0u; i < map->n_pages; ++i) {
+        if (map->pages[i]) {
+            const size_t page_size = RECORD_PAGE_SIZE * sizeof(struct record_by_entity_entry);
+            add_usage(&stats->entity_index, page_size, page_size);
+        }
+    }
+    add_usage(
+        &stats->free_list,
+        map->free_indices.count * sizeof(uint32_t),
+        map->free_indices.cap * sizeof(uint32_t)
+    );
+
+    const struct hash_map *by_sig = &world->archetypes_by_sig;
+    add_usage(&stats->archetype_index, by_sig->count * sizeof(struct hash_map_slot), by_sig->cap * sizeof(struct hash_map_slot));
+    add_usage(
+        &stats->archetype_index,
+        world->archetypes.count * sizeof(struct cecs_archetype *),
+        world->archetypes.cap * sizeof(struct cecs_archetype *)
+    );
+    for (size_t i = 0u; i < CECS_N_COMPONENTS; ++i) {
+        const struct achetype_vec *vec = &world->archetypes_by_component[i];
+        add_usage(&stats->archetype_index, vec->count * sizeof(struct cecs_archetype *), vec->cap * sizeof(struct cecs_archetype *));
+    }
+
+    for (size_t i = 0u; i < world->queries.count; ++i) {
+        const struct achetype_vec *vec = &world->queries.elements[i]->archetypes;
+        add_usage(&stats->queries, vec->count * sizeof(struct cecs_archetype *), vec->cap * sizeof(struct cecs_archetype *));
+    }
+    add_usage(&stats->queries, world->queries.count * sizeof(struct cecs_query *), world->queries.cap * sizeof(struct cecs_query *));
+
+    /* Pools hand out blocks from whole slabs, counting the slab's link block */
+    const struct pool *pools[] = { &world->archetype_pool, &world->query_pool };
+    const size_t live[]        = { world->archetypes.count, world->queries.count };
+    for (size_t i = 0u; i < 2u; ++i) {
+        const size_t slab_size = pools[i]->block_size * (POOL_SLAB_BLOCKS + 1u);
+        add_usage(&stats->pools, live[i] * pools[i]->block_size, count_pool_slabs(pools[i]) * slab_size);
+    }
+
+    /* Blocks before the current one are full, and later ones are empty */
+    bool past_current = !world->frame.current;
+    for (const struct arena_block *block = world->frame.blocks; block; block = block->next) {
+        size_t used = 0u;
+        if (block == world->frame.current) {
+            used         = world->frame.used;
+            past_current = true;
+        } else if (!past_current) {
+            used = block->cap;
+        }
+        add_usage(&stats->frame_arena, used, ARENA_HEADER_SIZE + block->cap);
+    }
+
+    add_usage(
+        &stats->removed_log,
+        world->removed.count * sizeof(struct removed_entry),
+        world->removed.cap * sizeof(struct removed_entry)
+    );
+    add_usage(
+        &stats->scratch,
+        world->archetypes_vec_cache.count * sizeof(struct cecs_archetype *),
+        world->archetypes_vec_cache.cap * sizeof(struct cecs_archetype *)
+    );
+
+    const cecs_memory_usage_t *parts[] = {
+        &stats->columns,     &stats->tables,          &stats->entity_index,
+        &stats->free_list,   &stats->archetype_index, &stats->queries,
+        &stats->pools,       &stats->frame_arena,     &stats->removed_log,
+        &stats->scratch,
+    };
+    for (size_t i = 0u; i < sizeof(parts) / sizeof(parts[0]); ++i) {
+        add_usage(&stats->total, parts[i]->used, parts[i]->allocated);
+    }
+}
+
+
+/** Initialize a chunk iterator over the archetypes that implement the given
+ * vector of components */
+static void init_chunk_iter(cecs_world_t *world, cecs_chunk_iter_t *it, const cecs_component_t n, va_list components)
+{
+    assert(
+        n <= CECS_MAX_QUERY_COMPONENTS
+        && "Too many components in query. Increase CECS_MAX_QUERY_COMPONENTS."
+    );
+
+    it->world     = world;
+    it->query     = NULL;
+    it->n         = n;
+    it->i_entry   = 0u;
+    it->row       = 0u;
+    it->filter    = CECS_FILTER_NONE;
+    it->filter_id = CECS_COMPONENT_INVALID;
+    it->since     = 0u;
+
+    /* Walk the archetypes of whichever component has the fewest of them */
+    it->lead            = CECS_COMPONENT_INVALID;
+    size_t n_archetypes = SIZE_MAX;
+    for (size_t i = 0u; i < n; ++i) {
+        it->components[i] = va_arg(components, cecs_component_t);
+        assert(it->components[i] > 0 && "Component was not registered with CECS_COMPONENT()");
+
+        const size_t count = world->archetypes_by_component[it->components[i]].count;
+        if (count < n_archetypes) {
+            it->lead     = it->components[i];
+            n_archetypes = count;
+        }
+    }
+}
+
+
+/** Get a chunk iterator over the archetypes that implement the given
+ * components */
+void _cecs_query_chunks(cecs_world_t *world, cecs_chunk_iter_t *it, const cecs_component_t n, ...)
+{
+    va_list components;
+    va_start(components, n);
+    init_chunk_iter(world, it, n, components);
+    va_end(components);
+}
+
+
+/** Returns true if the given archetype implements all the components named by
+ * the chunk iterator */
+static __always_inline bool archetype_matches_chunk_iter(const struct cecs_archetype *archetype, const cecs_chunk_iter_t *it)
+{
+    for (size_t i = 0u; i < it->n; ++i) {
+        if (!CECS_HAS_COMPONENT(&archetype->sig, it->components[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** Fill `chunk` with the block of rows of the given archetype at the
+ * iterator's position and advance past it. Returns false if the archetype has
+ * no rows left. */
+static __always_inline bool next_chunk_in_archetype(cecs_chunk_iter_t *it, struct cecs_archetype *archetype, cecs_chunk_t *chunk)
+{
+    if (it->filter == CECS_FILTER_CHANGED && !CECS_HAS_COMPONENT(&archetype->sig, it->filter_id)) {
+        /* An optional component the archetype lacks was never written */
+        return false;
+    }
+
+    if (it->filter != CECS_FILTER_NONE) {
+        /* Tags have no column, so only their additions are tracked */
+        const struct column *column = (it->filter == CECS_FILTER_CHANGED)
+            ? get_column(archetype, it->filter_id) : NULL;
+        const cecs_tick_t *ticks = column ? column->changed : archetype->added;
+
+        /* Skip whole chunks that weren't touched since the filter's tick */
+        while (it->row < archetype->count && ticks[CHUNK_OF_ROW(it->row)] < it->since) {
+            it->row += CECS_CHUNK_ROWS;
+        }
+    }
+
+    if (it->row >= archetype->count) {
+        return false;
+    }
+
+    const size_t remaining = archetype->count - it->row;
+
+    chunk->archetype = archetype;
+    chunk->row       = it->row;
+    chunk->count     = remaining < CECS_CHUNK_ROWS ? remaining : CECS_CHUNK_ROWS;
+    chunk->entities  = &archetype->entities[it->row];
+
+    it->row += chunk->count;
+    return true;
+}
+
+
+/** Get the archetypes the chunk iterator checks */
+static __always_inline const struct achetype_vec *get_chunk_iter_candidates(const cecs_chunk_iter_t *it)
+{
+    if (it->query) {
+        /* The query already knows its archetypes */
+        return &it->query->archetypes;
+    }
+
+    if (it->lead != CECS_COMPONENT_INVALID) {
+        return &it->world->archetypes_by_component[it->lead];
+    }
+
+    return &it->world->archetypes;
+}
+
+
+/** Advance the chunk iterator to the next block of rows in a matching archetype */
+bool cecs_chunk_next(cecs_chunk_iter_t *it, cecs_chunk_t *chunk)
+{
+    /* `i_entry` indexes the candidates */
+    const struct achetype_vec *candidates = get_chunk_iter_candidates(it);
+    for (; it->i_entry < candidates->count; ++it->i_entry, it->row = 0u) {
+        struct cecs_archetype *archetype = candidates->elements[it->i_entry];
+        if (archetype_matches_chunk_iter(archetype, it)
+            && next_chunk_in_archetype(it, archetype, chunk)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** Rewind the given entity iterator to before its first chunk */
+static void reset_iter(cecs_iter_t *it)
+{
+    memset(&it->chunk, 0u, sizeof(it->chunk));
+    it->i_entity = 0u;
+    it->entity   = CECS_ENTITY_INVALID;
+}
+
+
+/** Get an iterator over the entities that implement the given components.
+ * Returns the number of entities in the iterator.
+ */
+cecs_entity_t _cecs_query(cecs_world_t *world, cecs_iter_t *it, const cecs_component_t n, ...)
+{
+    va_list components;
+    va_start(components, n);
+    init_chunk_iter(world, &it->chunks, n, components);
+    va_end(components);
+
+    reset_iter(it);
+
+    /* Entities are iterated straight out of the archetype tables, and each
+     * entity is in exactly one archetype, so counting them is a sum over the
+     * matching archetypes */
+    cecs_entity_t n_entities = 0u;
+
+    const struct achetype_vec *candidates = get_chunk_iter_candidates(&it->chunks);
+    for (size_t i = 0u; i < candidates->count; ++i) {
+        if (archetype_matches_chunk_iter(candidates->elements[i], &it->chunks)) {
+            n_entities += candidates->elements[i]->count;
+        }
+    }
+
+    return n_entities;
+}
+
+
+/** Returns true if the chunk iterator names the given component */
+static __always_inline bool chunk_iter_has_component(const cecs_chunk_iter_t *it, const cecs_component_t id)
+{
+    if (it->query) {
+        return CECS_HAS_COMPONENT(&it->query->sig, id);
+    }
+
+    for (size_t i = 0u; i < it->n; ++i) {
+        if (it->components[i] == id) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** Returns true if every component named by the chunk iterator is enabled on
+ * the given row of the archetype */
+static __always_inline bool row_is_enabled_for_iter(const cecs_chunk_iter_t *it, const struct cecs_archetype *archetype, const size_t row)
+{
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        const struct enabled_mask *mask = &archetype->enabled.masks[i];
+        if (!ENABLED_BIT(mask->bits, row) && chunk_iter_has_component(it, mask->id)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** Increment the given entity iterator */
+cecs_entity_t cecs_iter_next(cecs_iter_t *it)
+{
+    for (;;) {
+        const struct cecs_archetype *archetype = it->chunk.archetype;
+        size_t row                             = it->chunk.row + it->i_entity;
+
+        if (it->i_entity > 0u && row - 1u < archetype->count
+            && archetype->entities[row - 1u] != it->entity) {
+            /* The entity last returned left the archetype and the last row was
+             * swapped into its place; that row hasn't been visited yet */
+            --it->i_entity;
+            --row;
+        }
+
+        /* Rows removed from the end of the archetype shorten the chunk */
+        size_t end = it->chunk.row + it->chunk.count;
+        if (it->chunk.count > 0u && end > archetype->count) {
+            end = archetype->count;
+        }
+
+        if (it->chunk.count > 0u && row < end) {
+            ++it->i_entity;
+            it->entity = archetype->entities[row];
+
+            if (archetype->enabled.count > 0u && !row_is_enabled_for_iter(&it->chunks, archetype, row)) {
+                /* Skip rows where a queried component is disabled. The row
+                 * still counts as visited for the swap-removal check above. */
+                continue;
+            }
+
+            return it->entity;
+        }
+
+        /* Chunk is exhausted; move on to the next one */
+        if (!cecs_chunk_next(&it->chunks, &it->chunk)) {
+            return CECS_ENTITY_INVALID;
+        }
+        it->i_entity = 0u;
+    }
+}
+
+
+/** Get a pointer to the first element of the chunk's column for the given
+ * component */
+void *_cecs_chunk_column(const cecs_chunk_t *chunk, const cecs_component_t id)
+{
+    struct column *column = get_column(chunk->archetype, id);
+    if (!column) {
+        /* Chunk doesn't have component, or it's a tag */
+        return NULL;
+    }
+
+    mark_changed(chunk->archetype, column, chunk->row);
+
+    return COLUMN_DATA_PTR(column, chunk->row);
+}
+
+
+/** Get a read-only pointer to the first element of the chunk's column for the
+ * given component */
+const void *_cecs_chunk_column_const(const cecs_chunk_t *chunk, const cecs_component_t id)
+{
+    const struct column *column = get_column(chunk->archetype, id);
+    if (!column) {
+        /* Chunk doesn't have component, or it's a tag */
+        return NULL;
+    }
+
+    return COLUMN_DATA_PTR(column, chunk->row);
+}
+
+
+/** Get the enabled bits of the chunk's rows for the given component */
+const uint64_t *_cecs_chunk_enabled(const cecs_chunk_t *chunk, const cecs_component_t id)
+{
+    const struct enabled_mask *mask = get_enabled_mask(chunk->archetype, id);
+    if (!mask) {
+        /* Enabled on every row */
+        return NULL;
+    }
+
+    /* Chunks start on a multiple of CECS_CHUNK_ROWS, so on a word boundary */
+    return &mask->bits[chunk->row / 64u];
+}
+
+
+/** Allocate a persistent query over the given world, requiring no components */
+static struct cecs_query *alloc_query(struct cecs_world *world)
+{
+    struct cecs_query *query = pool_alloc(&world->query_pool);
+    query->world             = world;
+
+    return query;
+}
+
+
+/** Seed the given query with the archetypes matching its terms and start
+ * tracking the ones created later */
+static struct cecs_query *register_query(struct cecs_query *query)
+{
+    struct cecs_world *world = query->world;
+
+    /* Archetypes only need testing against the other terms once they are
+     * known to implement the required components */
+    const struct achetype_vec *archetypes = get_archetypes_by_sig(world, &query->sig);
+    for (size_t i = 0u; i < archetypes->count; ++i) {
+        if (!query_matches_sig(query, &archetypes->elements[i]->sig)) {
+            continue;
+        }
+
+        GROW_VEC_IF_NEEDED(&query->archetypes, ARCHETYPES_VEC_MIN_SIZE, elements, struct cecs_archetype *);
+        query->archetypes.elements[query->archetypes.count++] = archetypes->elements[i];
+    }
+
+    GROW_VEC_IF_NEEDED(&world->queries, QUERIES_VEC_MIN_SIZE, elements, struct cecs_query *);
+    world->queries.elements[world->queries.count++] = query;
+
+    return query;
+}
+
+
+/** Create a persistent query over the archetypes implementing the given
+ * components */
+cecs_query_t *_cecs_query_create(cecs_world_t *world, const cecs_component_t n, ...)
+{
+    struct cecs_query *query = alloc_query(world);
+
+    va_list components;
+    va_start(components, n);
+    query->sig = components_to_sig(n, components);
+    va_end(components);
+
+    return register_query(query);
+}
+
+
+/** Read a term of a query from the varargs, given as a count followed by that
+ * many component IDs, into a signature. Returns the number of components. */
+static size_t read_query_term(struct signature *sig, va_list *args)
+{
+    const cecs_component_t n = va_arg(*args, cecs_component_t);
+    for (size_t i = 0u; i < n; ++i) {
+        const cecs_component_t id = va_arg(*args, cecs_component_t);
+        assert(id > 0 && "Component was not registered with CECS_COMPONENT()");
+        CECS_ADD_COMPONENT(sig, id);
+    }
+
+    return (size_t)n;
+}
+
+
+/** Create a persistent query from its required, excluded, optional and any-of
+ * terms */
+cecs_query_t *_cecs_query_create_terms(cecs_world_t *world, ...)
+{
+    struct cecs_query *query = alloc_query(world);
+
+    va_list args;
+    va_start(args, world);
+    read_query_term(&query->sig, &args);
+    read_query_term(&query->without, &args);
+
+    /* Optional components don't affect matching; their columns are simply
+     * NULL in chunks that don't have them */
+    struct signature optional;
+    memset(&optional, 0u, sizeof(optional));
+    read_query_term(&optional, &args);
+    assert(
+        !sig_intersects(&optional, &query->without)
+        && "A component can't be both optional and excluded"
+    );
+
+    query->has_any_of = read_query_term(&query->any_of, &args) > 0u;
+    va_end(args);
+
+    assert(
+        !sig_intersects(&query->sig, &query->without)
+        && "A component can't be both required and excluded"
+    );
+
+    return register_query(query);
+}
+
+
+/** Destroy the given persistent query so it is no longer updated */
+void cecs_query_destroy(cecs_query_t *query)
+{
+    struct query_vec *queries = &query->world->queries;
+    for (size_t i = 0u; i < queries->count; ++i) {
+        if (queries->elements[i] == query) {
+            /* Put the last query in the vector into the destroyed one's slot */
+            queries->elements[i] = queries->elements[--queries->count];
+            break;
+        }
+    }
+
+    cecs_free(query->archetypes.elements);
+    pool_free(&query->world->query_pool, query);
+}
+
+
+/** Move every entity matching the given persistent query to the archetype
+ * reached by following the add or remove edges of the given components.
+ * Returns the number of entities moved. */
+static size_t move_query_entities(cecs_query_t *query, const bool add, const cecs_component_t n, va_list components)
+{
+    struct cecs_world *world = query->world;
+
+    cecs_component_t ids[CECS_MAX_QUERY_COMPONENTS];
+    assert(n <= CECS_MAX_QUERY_COMPONENTS && "Too many components");
+    for (size_t i = 0u; i < n; ++i) {
+        ids[i] = va_arg(components, cecs_component_t);
+    }
+
+    /* Archetypes created by the moves are appended to the query when they
+     * match it, but they only hold rows that were already moved */
+    const size_t n_archetypes = query->archetypes.count;
+
+    size_t moved = 0u;
+    for (size_t i_archetype = 0u; i_archetype < n_archetypes; ++i_archetype) {
+        struct cecs_archetype *from = query->archetypes.elements[i_archetype];
+        struct cecs_archetype *to   = from;
+        for (size_t i = 0u; i < n; ++i) {
+            to = add ? get_archetype_with(world, to, ids[i]) : get_archetype_without(world, to, ids[i]);
+        }
+
+        if (to == from) {
+            /* Nothing to do */
+            continue;
+        }
+
+        moved += from->count;
+        move_archetype_rows(world, from, to);
+    }
+
+    return moved;
+}
+
+
+/** Add the given components to every entity matching the persistent query */
+size_t _cecs_query_add(cecs_query_t *query, const cecs_component_t n, ...)
+{
+    va_list components;
+    va_start(components, n);
+    const size_t moved = move_query_entities(query, true, n, components);
+    va_end(components);
+
+    return moved;
+}
+
+
+/** Remove the given components from every entity matching the persistent
+ * query */
+size_t _cecs_query_remove(cecs_query_t *query, const cecs_component_t n, ...)
+{
+    va_list components;
+    va_start(components, n);
+    const size_t moved = move_query_entities(query, false, n, components);
+    va_end(components);
+
+    return moved;
+}
+
+
+/** Destroy every entity matching the given persistent query */
+size_t cecs_query_destroy_entities(cecs_query_t *query)
+{
+    struct cecs_world *world       = query->world;
+    struct index_vec *free_indices = &world->records_by_entity.free_indices;
+
+    size_t destroyed = 0u;
+    for (size_t i_archetype = 0u; i_archetype < query->archetypes.count; ++i_archetype) {
+        struct cecs_archetype *archetype = query->archetypes.elements[i_archetype];
+        log_removed(world, archetype, NULL, archetype->entities, archetype->count);
+
+        /* The whole table is released, so no rows need to be swapped in */
+        for (size_t row = 0u; row < archetype->count; ++row) {
+            const cecs_entity_t entity            = archetype->entities[row];
+            struct record_by_entity_entry *record = get_record_slot(world, CECS_ENTITY_INDEX(entity), false);
+
+            record->archetype = NULL;
+            ++record->generation;
+
+            GROW_VEC_IF_NEEDED(free_indices, FREE_INDICES_MIN_SIZE, indices, uint32_t);
+            free_indices->indices[free_indices->count++] = CECS_ENTITY_INDEX(entity);
+        }
+
+        destroyed += archetype->count;
+        archetype->count = 0u;
+    }
+
+    return destroyed;
+}
+
+
+/** Count the entities matching the given persistent query */
+size_t cecs_query_count(const cecs_query_t *query)
+{
+    size_t count = 0u;
+    for (size_t i = 0u; i < query->archetypes.count; ++i) {
+        count += query->archetypes.elements[i]->count;
+    }
+
+    return count;
+}
+
+
+/** Get an iterator over the entities matching the given persistent query */
+void cecs_query_iter(const cecs_query_t *query, cecs_iter_t *it)
+{
+    cecs_query_iter_chunks(query, &it->chunks);
+
+    reset_iter(it);
+}
+
+
+/** Get a chunk iterator over the archetypes matching the given persistent
+ * query */
+void cecs_query_iter_chunks(const cecs_query_t *query, cecs_chunk_iter_t *it)
+{
+    it->world     = query->world;
+    it->query     = query;
+    it->n         = 0u;
+    it->lead      = CECS_COMPONENT_INVALID;
+    it->i_entry   = 0u;
+    it->row       = 0u;
+    it->filter    = CECS_FILTER_NONE;
+    it->filter_id = CECS_COMPONENT_INVALID;
+    it->since     = 0u;
+}
+
+
+/** Get a chunk iterator over the chunks of the persistent query where the
+ * given component was written at or after the specified tick */
+void _cecs_query_iter_chunks_changed(const cecs_query_t *query, cecs_chunk_iter_t *it, const cecs_component_t id, const cecs_tick_t since)
+{
+    cecs_query_iter_chunks(query, it);
+    it->filter    = CECS_FILTER_CHANGED;
+    it->filter_id = id;
+    it->since     = since;
+}
+
+
+/** Get a chunk iterator over the chunks of the persistent query that had rows
+ * added at or after the specified tick */
+void cecs_query_iter_chunks_added(const cecs_query_t *query, cecs_chunk_iter_t *it, const cecs_tick_t since)
+{
+    cecs_query_iter_chunks(query, it);
+    it->filter = CECS_FILTER_ADDED;
+    it->since  = since;
+}
+
+
+/** Get an iterator over the entities in the chunks of the persistent query
+ * where the given component was written at or after the specified tick */
+void _cecs_query_iter_changed(const cecs_query_t *query, cecs_iter_t *it, const cecs_component_t id, const cecs_tick_t since)
+{
+    _cecs_query_iter_chunks_changed(query, &it->chunks, id, since);
+
+    reset_iter(it);
+}
+
+
+/** Get an iterator over the entities in the chunks of the persistent query
+ * that had rows added at or after the specified tick */
+void cecs_query_iter_added(const cecs_query_t *query, cecs_iter_t *it, const cecs_tick_t since)
+{
+    cecs_query_iter_chunks_added(query, &it->chunks, since);
+
+    reset_iter(it);
+}
+
+
+/** Get a pointer to the component data for the given entity and component
+ * pair, stamping it as written if requested */
+static __always_inline void *get_component_data(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id, const bool write)
+{
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+    if (!record) {
+        /* Entity doesn't exist */
+        return NULL;
+    }
+
+    struct column *column = get_column(record->archetype, id);
+    if (!column) {
+        /* Entity doesn't have component */
+        return NULL;
+    }
+
+    if (write) {
+        mark_changed(record->archetype, column, record->row);
+    }
+
+    return COLUMN_DATA_PTR(column, record->row);
+}
+
+
+/** Get a pointer to the component data for the given entity and component
+ * pair, which counts as a write for change detection */
+void *_cecs_get(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id)
+{
+    return get_component_data(world, entity, id, true);
+}
+
+
+/** Get a read-only pointer to the component data for the given entity and
+ * component pair */
+const void *_cecs_get_const(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id)
+{
+    return get_component_data(world, entity, id, false);
+}
+
+
+/** Returns true if the given entity implements the specified component */
+bool _cecs_has(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id)
+{
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+
+    return record && CECS_HAS_COMPONENT(&record->archetype->sig, id);
+}
+
+
+/** Create a new entity implementing the given components */
+cecs_entity_t _cecs_create(cecs_world_t *world, const cecs_component_t n, ...)
+{
+    /* Walk the archetype graph from the root to find the entity's archetype */
+    struct cecs_archetype *archetype = get_root_archetype(world);
+
+    va_list components;
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        archetype = get_archetype_with(world, archetype, va_arg(components, cecs_component_t));
+    }
+    va_end(components);
+
+    const cecs_entity_t entity = new_entity(world);
+
+    /* Add the entity to a new row of its archetype and record where it lives */
+    set_record_by_entity(world, entity, archetype, add_entity_to_archetype(entity, archetype));
+
+    return entity;
+}
+
+
+/** Create `count` entities implementing the given components in one table
+ * reservation, optionally copying their initial data */
+void _cecs_create_n(cecs_world_t *world, const size_t count, cecs_entity_t *entities, const void *const *data, const cecs_component_t n, ...)
+{
+    struct cecs_archetype *archetype = get_root_archetype(world);
+
+    va_list components;
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        archetype = get_archetype_with(world, archetype, va_arg(components, cecs_component_t));
+    }
+    va_end(components);
+
+    /* Grow the table once for every new row, then fill the rows in order */
+    reserve_archetype_rows(archetype, archetype->count + count);
+    const size_t first_row = archetype->count;
+
+    for (size_t i = 0u; i < count; ++i) {
+        const cecs_entity_t entity = new_entity(world);
+        archetype->entities[first_row + i] = entity;
+        set_record_by_entity(world, entity, archetype, first_row + i);
+        if (entities) {
+            entities[i] = entity;
+        }
+        for (size_t k = 0u; k < archetype->enabled.count; ++k) {
+            set_enabled_bit(archetype->enabled.masks[k].bits, first_row + i, true);
+        }
+    }
+    if (count > 0u) {
+        mark_rows_added(archetype, first_row, count);
+    }
+    archetype->count += count;
+
+    if (!data) {
+        return;
+    }
+
+    /* The new rows are contiguous, so each component's data is one copy */
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        struct column *column = get_column(archetype, va_arg(components, cecs_component_t));
+        if (data[i] && column) {
+            memcpy(COLUMN_DATA_PTR(column, first_row), data[i], count * column->size);
+        }
+    }
+    va_end(components);
+}
+
+
+/** Add the specified components to the given entity */
+void _cecs_add(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t n, ...)
+{
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+    if (!record) {
+        /* Entity doesn't exist */
+        return;
+    }
+
+    struct cecs_archetype *archetype = record->archetype;
+
+    /* Follow the "add" edges from the entity's current archetype */
+    va_list components;
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        archetype = get_archetype_with(world, archetype, va_arg(components, cecs_component_t));
+    }
+    va_end(components);
+
+    if (archetype == record->archetype) {
+        /* Nothing to do */
+        return;
+    }
+
+    /* Move the entity and its data to its new archetype */
+    move_entity_to_archetype(world, entity, record, archetype);
+}
+
+
+/** Remove the specified components from the given entity */
+void _cecs_remove(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t n, ...)
+{
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+    if (!record) {
+        /* Entity doesn't exist */
+        return;
+    }
+
+    struct cecs_archetype *archetype = record->archetype;
+
+    /* Follow the "remove" edges from the entity's current archetype */
+    va_list components;
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        archetype = get_archetype_without(world, archetype, va_arg(components, cecs_component_t));
+    }
+    va_end(components);
+
+    if (archetype == record->archetype) {
+        /* Nothing to do */
+        return;
+    }
+
+    /* Move the entity and the data it keeps to its new archetype */
+    move_entity_to_archetype(world, entity, record, archetype);
+}
+
+
+/** Destroy the given entity, releasing its row and its index for reuse */
+bool cecs_destroy_in(cecs_world_t *world, const cecs_entity_t entity)
+{
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+    if (!record) {
+        /* Entity doesn't exist */
+        return false;
+    }
+
+    struct cecs_archetype *archetype = record->archetype;
+    const size_t row                 = record->row;
+
+    log_removed(world, archetype, NULL, &entity, 1u);
+
+    /* Invalidate every outstanding handle to the entity before releasing its
+     * row, which may rewrite the record of the entity moved into it */
+    record->archetype = NULL;
+    ++record->generation;
+    remove_row_from_archetype(world, archetype, row);
+
+    struct index_vec *free_indices = &world->records_by_entity.free_indices;
+    GROW_VEC_IF_NEEDED(free_indices, FREE_INDICES_MIN_SIZE, indices, uint32_t);
+    free_indices->indices[free_indices->count++] = CECS_ENTITY_INDEX(entity);
+
+    return true;
+}
+
+
+/** Returns true if the given entity handle refers to a live entity */
+bool cecs_is_alive_in(cecs_world_t *world, const cecs_entity_t entity)
+{
+    return get_record_by_entity(world, entity) != NULL;
+}
+
+
+/** Enable or disable the given component of the specified entity */
+bool _cecs_set_enabled(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id, const bool enabled)
+{
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+    if (!record || !CECS_HAS_COMPONENT(&record->archetype->sig, id)) {
+        /* Entity doesn't exist or doesn't have component */
+        return false;
+    }
+
+    set_row_enabled(record->archetype, id, record->row, enabled);
+    mark_toggled(record->archetype, record->row);
+
+    /* Toggling a component counts as writing it */
+    struct column *column = get_column(record->archetype, id);
+    if (column) {
+        mark_changed(record->archetype, column, record->row);
+    }
+
+    return true;
+}
+
+
+/** Returns true if the given entity has the specified component enabled */
+bool _cecs_is_enabled(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id)
+{
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+    if (!record || !CECS_HAS_COMPONENT(&record->archetype->sig, id)) {
+        /* Entity doesn't exist or doesn't have component */
+        return false;
+    }
+
+    const struct enabled_mask *mask = get_enabled_mask(record->archetype, id);
+
+    return !mask || ENABLED_BIT(mask->bits, record->row);
+}
+
+
+/** Measure the occupancy and probe lengths of the given world's
+ * signature->archetype map */
+void cecs_archetype_map_stats(const cecs_world_t *world, cecs_map_stats_t *stats)
+{
+    hash_map_stats(&world->archetypes_by_sig, stats);
+}
+
+
+/** Allocate temporary memory that lives until the given world's frame arena is
+ * reset */
+void *cecs_frame_alloc(cecs_world_t *world, const size_t size)
+{
+    /* Allocations are a few instructions unless a block runs out, so the
+     * lock is spun on rather than slept on */
+    while (atomic_flag_test_and_set_explicit(&world->frame.lock, memory_order_acquire)) {
+    }
+
+    void *ptr = arena_alloc(&world->frame, size);
+    atomic_flag_clear_explicit(&world->frame.lock, memory_order_release);
+
+    return ptr;
+}
+
+
+/** Release everything allocated from the given world's frame arena */
+void cecs_frame_reset(cecs_world_t *world)
+{
+    arena_reset(&world->frame);
+}
+
+
+/** Get the current tick of the given world */
+cecs_tick_t cecs_world_tick(const cecs_world_t *world)
+{
+    return world->tick;
+}
+
+
+/** Advance the tick of the given world and return the new tick */
+cecs_tick_t cecs_world_advance_tick(cecs_world_t *world)
+{
+    return ++world->tick;
+}
+
+
+/** Start logging removals of the given component in the given world */
+void _cecs_track_removed(cecs_world_t *world, const cecs_component_t id)
+{
+    CECS_ADD_COMPONENT(&world->removed_tracked, id);
+    world->tracks_removed = true;
+}
+
+
+/** Start logging the entities destroyed in the given world, for
+ * cecs_query_destroyed() */
+void cecs_track_destroyed(cecs_world_t *world)
+{
+    world->tracks_destroyed = true;
+    world->tracks_removed   = true;
+}
+
+
+/** Returns the index of the first entry of the removed log at or after the
+ * given tick */
+static size_t find_removed_since(const struct removed_vec *log, const cecs_tick_t since)
+{
+    /* The log is appended to in tick order */
+    size_t lo = 0u;
+    size_t hi = log->count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2u;
+        if (log->entries[mid].tick < since) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+/** Get an iterator over the entities the given component was removed from at
+ * or after the specified tick */
+void _cecs_query_removed(cecs_world_t *world, cecs_removed_iter_t *it, const cecs_component_t id, const cecs_tick_t since)
+{
+    it->world = world;
+    it->id    = id;
+    it->i     = find_removed_since(&world->removed, since);
+}
+
+
+/** Get an iterator over the entities destroyed in the given world at or after
+ * the given tick */
+void cecs_query_destroyed(cecs_world_t *world, cecs_removed_iter_t *it, const cecs_tick_t since)
+{
+    /* Destroys are logged as removals of the invalid component */
+    _cecs_query_removed(world, it, CECS_COMPONENT_INVALID, since);
+}
+
+
+/** Get the next entity from a removed iterator, or CECS_ENTITY_INVALID at the
+ * end */
+cecs_entity_t cecs_removed_next(cecs_removed_iter_t *it)
+{
+    const struct removed_vec *log = &it->world->removed;
+    for (; it->i < log->count; ++it->i) {
+        if (log->entries[it->i].id == it->id) {
+            return log->entries[it->i++].entity;
+        }
+    }
+
+    return CECS_ENTITY_INVALID;
+}
+
+
+/** Drop the entries of the removed log from before the given tick */
+void cecs_trim_removed(cecs_world_t *world, const cecs_tick_t before)
+{
+    struct removed_vec *log = &world->removed;
+    const size_t first      = find_removed_since(log, before);
+
+    memmove(log->entries, &log->entries[first], (log->count - first) * sizeof(struct removed_entry));
+    log->count -= first;
+}
+
+
+/** Register the given component as having the specified size and name */
+void cecs_register_component(const cecs_component_t id, const size_t size, const char *name)
+{
+    assert(
+        id < CECS_N_COMPONENTS
+        && "Component ID is out of range. Increase CECS_N_COMPONENTS."
+    );
+
+    struct component_by_id *component = get_component_by_id(id);
+
+    component->id   = id;
+    component->size = size;
+    component->name = name;
+
+    /* Widen signature operations to cover the new component */
+    if ((size_t)CECS_COMPONENT_TO_INDEX(id) >= g_sig_words) {
+        g_sig_words = (size_t)CECS_COMPONENT_TO_INDEX(id) + 1u;
+    }
+}
+
+
+/** Populate the component data for the given entity, component pair */
+bool _cecs_set(cecs_world_t *world, const cecs_entity_t entity, const cecs_component_t id, void *data)
+{
+    void *component = _cecs_get(world, entity, id);
+    if (!component) {
+        /* Entity doesn't have component */
+        return false;
+    }
+
+    memcpy(component, data, get_component_by_id(id)->size);
+
+    return true;
+}
+
+
+/** Zero out the component data for the given entity, component pair */
+bool _cecs_zero(cecs_world_t *world, const cecs_entity_t entity, const size_t n, ...)
+{
+    bool changed = false;
+
+    struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+    if (!record) {
+        /* Entity doesn't exist */
+        return false;
+    }
+
+    va_list components;
+    va_start(components, n);
+
+    for (size_t k = 0u; k < n; ++k) {
+        struct column *column
+            = get_column(record->archetype, va_arg(components, cecs_component_t));
+
+        if (!column) {
+            /* Entity doesn't have component, or it's a tag */
+            continue;
+        }
+
+        mark_changed(record->archetype, column, record->row);
+        memset(COLUMN_DATA_PTR(column, record->row), 0u, column->size);
+        changed = true;
+    }
+
+    va_end(components);
+
+    return changed;
+}
+
+
+/** Create an empty command buffer */
+cecs_cmd_buffer_t *cecs_cmd_buffer_create(void)
+{
+    struct cecs_cmd_buffer *buffer = alloc_zeroed(1u, sizeof(struct cecs_cmd_buffer));
+
+    return buffer;
+}
+
+
+/** Destroy the given command buffer, discarding any commands not applied */
+void cecs_cmd_buffer_destroy(cecs_cmd_buffer_t *buffer)
+{
+    cecs_free(buffer->cmds.cmds);
+    cecs_free(buffer->data.bytes);
+    cecs_free(buffer->created.entities);
+    cecs_free(buffer->refs.refs);
+    cecs_free(buffer->plans.plans);
+    cecs_free(buffer);
+}
+
+
+/** Start a new batch in the given buffer if it was applied since the last
+ * command was recorded */
+static __always_inline void begin_cmd_batch(struct cecs_cmd_buffer *buffer)
+{
+    if (buffer->applied) {
+        /* Placeholders from the applied batch can no longer be resolved */
+        buffer->applied       = false;
+        buffer->n_creates     = 0u;
+        buffer->created.count = 0u;
+    }
+}
+
+
+/** Append a command to the given buffer */
+static struct cmd *push_cmd(struct cecs_cmd_buffer *buffer, const enum cmd_kind kind, const cecs_entity_t entity, const cecs_component_t id)
+{
+    begin_cmd_batch(buffer);
+
+    GROW_VEC_IF_NEEDED(&buffer->cmds, CMD_BUFFER_MIN_SIZE, cmds, struct cmd);
+
+    struct cmd *cmd = &buffer->cmds.cmds[buffer->cmds.count++];
+    cmd->kind       = kind;
+    cmd->entity     = entity;
+    cmd->id         = id;
+    cmd->data       = 0u;
+
+    return cmd;
+}
+
+
+/** Record the creation of an entity with the given components, returning a
+ * placeholder handle to use in later commands of the same buffer */
+cecs_entity_t _cecs_cmd_create(cecs_cmd_buffer_t *buffer, const cecs_component_t n, ...)
+{
+    begin_cmd_batch(buffer);
+
+    assert(buffer->n_creates < (size_t)UINT32_MAX && "Too many creates in one command buffer");
+    const cecs_entity_t placeholder = CECS_ENTITY(0u, buffer->n_creates + 1u);
+
+    push_cmd(buffer, CMD_CREATE, placeholder, CECS_COMPONENT_INVALID);
+    ++buffer->n_creates;
+
+    va_list components;
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        push_cmd(buffer, CMD_ADD, placeholder, va_arg(components, cecs_component_t));
+    }
+    va_end(components);
+
+    return placeholder;
+}
+
+
+/** Record adding the given components to the specified entity */
+void _cecs_cmd_add(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity, const cecs_component_t n, ...)
+{
+    va_list components;
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        push_cmd(buffer, CMD_ADD, entity, va_arg(components, cecs_component_t));
+    }
+    va_end(components);
+}
+
+
+/** Record removing the given components from the specified entity */
+void _cecs_cmd_remove(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity, const cecs_component_t n, ...)
+{
+    va_list components;
+    va_start(components, n);
+    for (size_t i = 0u; i < n; ++i) {
+        push_cmd(buffer, CMD_REMOVE, entity, va_arg(components, cecs_component_t));
+    }
+    va_end(components);
+}
+
+
+/** Record setting the given component data for the specified entity. The data
+ * is copied into the buffer. */
+void _cecs_cmd_set(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity, const cecs_component_t id, const void *data)
+{
+    struct cmd *cmd    = push_cmd(buffer, CMD_SET, entity, id);
+    const size_t size  = get_component_by_id(id)->size;
+    struct cmd_data_vec *arena = &buffer->data;
+
+    if (arena->count + size > arena->cap) {
+        size_t cap = (arena->cap == 0u) ? CMD_BUFFER_MIN_SIZE : arena->cap;
+        while (cap < arena->count + size) {
+            cap *= 2u;
+        }
+        arena->bytes = cecs_realloc(arena->bytes, cap);
+        arena->cap = cap;
+    }
+
+    cmd->data = arena->count;
+    if (size > 0u) {
+        memcpy(arena->bytes + arena->count, data, size);
+    }
+    arena->count += size;
+}
+
+
+/** Record destroying the specified entity */
+void cecs_cmd_destroy(cecs_cmd_buffer_t *buffer, const cecs_entity_t entity)
+{
+    push_cmd(buffer, CMD_DESTROY, entity, CECS_COMPONENT_INVALID);
+}
+
+
+/** Get the entity a handle used in the given buffer refers to: the entity
+ * created for it if it is a placeholder and the buffer has been applied, or
+ * the handle itself otherwise */
+cecs_entity_t cecs_cmd_buffer_resolve(const cecs_cmd_buffer_t *buffer, const cecs_entity_t entity)
+{
+    if (CECS_ENTITY_INDEX(entity) != 0u || entity == CECS_ENTITY_INVALID) {
+        return entity;
+    }
+
+    const size_t i_created = (size_t)CECS_ENTITY_GENERATION(entity) - 1u;
+    if (!buffer->applied || i_created >= buffer->created.count) {
+        return CECS_ENTITY_INVALID;
+    }
+
+    return buffer->created.entities[i_created];
+}
+
+
+/** Order resolved commands by entity, then by recording order */
+static int compare_cmd_refs(const void *lhs, const void *rhs)
+{
+    const struct cmd_ref *a = lhs;
+    const struct cmd_ref *b = rhs;
+
+    if (a->entity != b->entity) {
+        return a->entity < b->entity ? -1 : 1;
+    }
+
+    return a->i_cmd < b->i_cmd ? -1 : (a->i_cmd > b->i_cmd ? 1 : 0);
+}
+
+
+/** Order planned changes by target archetype, so moves into the same table
+ * are made together, and then by recording order */
+static int compare_cmd_plans(const void *lhs, const void *rhs)
+{
+    const struct cmd_plan *a = lhs;
+    const struct cmd_plan *b = rhs;
+
+    /* Destroys come first, then moves by the creation order of their
+     * archetype, so the result doesn't depend on where archetypes were
+     * allocated */
+    const size_t a_to = a->to ? a->to->index + 1u : 0u;
+    const size_t b_to = b->to ? b->to->index + 1u : 0u;
+    if (a_to != b_to) {
+        return a_to < b_to ? -1 : 1;
+    }
+
+    /* Keys are unique, so the order is total and qsort() needn't be stable */
+    return a->i_cmd < b->i_cmd ? -1 : (a->i_cmd > b->i_cmd ? 1 : 0);
+}
+
+
+/** Fold the commands of one entity, starting at `refs[0]`, into a single
+ * planned change. Returns the number of commands consumed. */
+static size_t plan_entity_cmds(struct cecs_world *world, struct cecs_cmd_buffer *buffer, const struct cmd_ref *refs, const size_t n_refs)
+{
+    const cecs_entity_t entity = refs[0].entity;
+
+    size_t n = 1u;
+    while (n < n_refs && refs[n].entity == entity) {
+        ++n;
+    }
+
+    const struct cmd *cmds = buffer->cmds.cmds;
+    const bool created     = cmds[refs[0].i_cmd].kind == CMD_CREATE;
+
+    struct cecs_archetype *from = NULL;
+    if (!created) {
+        struct record_by_entity_entry *record = get_record_by_entity(world, entity);
+        if (!record) {
+            /* Entity doesn't exist, so its commands are dropped */
+            return n;
+        }
+        from = record->archetype;
+    }
+
+    struct signature sig = { 0u };
+    if (from) {
+        sig = from->sig;
+    }
+
+    bool destroyed = false;
+    for (size_t i = 0u; i < n && !destroyed; ++i) {
+        const struct cmd *cmd = &cmds[refs[i].i_cmd];
+        switch (cmd->kind) {
+        case CMD_ADD:
+            CECS_ADD_COMPONENT(&sig, cmd->id);
+            break;
+        case CMD_REMOVE:
+            CECS_REMOVE_COMPONENT(&sig, cmd->id);
+            break;
+        case CMD_DESTROY:
+            destroyed = true;
+            break;
+        case CMD_CREATE:
+        case CMD_SET:
+        default:
+            break;
+        }
+    }
+
+    /* Entities created by the buffer are never destroyed here, since their
+     * commands were dropped along with the placeholder */
+    struct cecs_archetype *to = NULL;
+    if (!destroyed) {
+        to = get_or_add_archetype_by_sig(world, &sig);
+        if (to == from) {
+            /* Nothing to move */
+            return n;
+        }
+    }
+
+    struct cmd_plan_vec *plans = &buffer->plans;
+    GROW_VEC_IF_NEEDED(plans, CMD_BUFFER_MIN_SIZE, plans, struct cmd_plan);
+    plans->plans[plans->count++] = (struct cmd_plan){
+        .entity = entity, .to = to, .created = created, .i_cmd = refs[0].i_cmd
+    };
+
+    return n;
+}
+
+
+/** Apply the commands recorded in the given buffer to the specified world and
+ * empty the buffer */
+void cecs_cmd_buffer_apply(cecs_world_t *world, cecs_cmd_buffer_t *buffer)
+{
+    if (buffer->applied || buffer->cmds.count == 0u) {
+        /* Nothing was recorded since the last apply */
+        return;
+    }
+
+    /* Entities created and destroyed by the buffer never exist, so their
+     * placeholders are marked invalid before the others are handed out */
+    struct entity_vec *created = &buffer->created;
+    created->count = 0u;
+    for (size_t i = 0u; i < buffer->n_creates; ++i) {
+        GROW_VEC_IF_NEEDED(created, CMD_BUFFER_MIN_SIZE, entities, cecs_entity_t);
+        created->entities[created->count] = CECS_ENTITY(0u, created->count + 1u);
+        ++created->count;
+    }
+    for (size_t i = 0u; i < buffer->cmds.count; ++i) {
+        const struct cmd *cmd = &buffer->cmds.cmds[i];
+        if (cmd->kind == CMD_DESTROY && CECS_ENTITY_INDEX(cmd->entity) == 0u && cmd->entity != CECS_ENTITY_INVALID
+            && CECS_ENTITY_GENERATION(cmd->entity) <= created->count) {
+            created->entities[CECS_ENTITY_GENERATION(cmd->entity) - 1u] = CECS_ENTITY_INVALID;
+        }
+    }
+
+    /* Give each remaining placeholder a real entity handle */
+    for (size_t i = 0u; i < created->count; ++i) {
+        if (created->entities[i] != CECS_ENTITY_INVALID) {
+            created->entities[i] = new_entity(world);
+        }
+    }
+    buffer->applied = true;
+
+    /* Group the commands by the entity they resolve to */
+    struct cmd_ref_vec *refs = &buffer->refs;
+    refs->count = 0u;
+    for (size_t i = 0u; i < buffer->cmds.count; ++i) {
+        const cecs_entity_t entity = cecs_cmd_buffer_resolve(buffer, buffer->cmds.cmds[i].entity);
+        if (entity == CECS_ENTITY_INVALID) {
+            /* The entity was created and destroyed by the buffer */
+            continue;
+        }
+
+        GROW_VEC_IF_NEEDED(refs, CMD_BUFFER_MIN_SIZE, refs, struct cmd_ref);
+        refs->refs[refs->count++] = (struct cmd_ref){ .entity = entity, .i_cmd = i };
+    }
+    if (refs->count > 1u) {
+        qsort(refs->refs, refs->count, sizeof(struct cmd_ref), compare_cmd_refs);
+    }
+
+    /* Reduce each entity's commands to one move, then make the moves into
+     * each archetype together, growing its table once for all of them */
+    buffer->plans.count = 0u;
+    for (size_t i = 0u; i < refs->count;) {
+        i += plan_entity_cmds(world, buffer, &refs->refs[i], refs->count - i);
+    }
+    if (buffer->plans.count > 1u) {
+        qsort(buffer->plans.plans, buffer->plans.count, sizeof(struct cmd_plan), compare_cmd_plans);
+    }
+
+    for (size_t i = 0u; i < buffer->plans.count;) {
+        struct cecs_archetype *to = buffer->plans.plans[i].to;
+
+        size_t end = i + 1u;
+        while (end < buffer->plans.count && buffer->plans.plans[end].to == to) {
+            ++end;
+        }
+
+        if (to) {
+            reserve_archetype_rows(to, to->count + (end - i));
+        }
+
+        for (; i < end; ++i) {
+            const struct cmd_plan *plan = &buffer->plans.plans[i];
+            if (!to) {
+                cecs_destroy_in(world, plan->entity);
+            } else if (plan->created) {
+                set_record_by_entity(world, plan->entity, to, add_entity_to_archetype(plan->entity, to));
+            } else {
+                move_entity_to_archetype(world, plan->entity, get_record_by_entity(world, plan->entity), to);
+            }
+        }
+    }
+
+    /* Write component data once every entity is in its final archetype */
+    for (size_t i = 0u; i < refs->count; ++i) {
+        const struct cmd *cmd = &buffer->cmds.cmds[refs->refs[i].i_cmd];
+        if (cmd->kind == CMD_SET) {
+            _cecs_set(world, refs->refs[i].entity, cmd->id, (void *)(buffer->data.bytes + cmd->data));
+        }
+    }
+
+    buffer->cmds.count = 0u;
+    buffer->data.count = 0u;
+}
+
+
+/** Magic number identifying a world snapshot file */
+#define SNAPSHOT_MAGIC "CECSSNAP"
+
+/** Version of the snapshot format, bumped whenever the layout changes */
+#define SNAPSHOT_VERSION ((uint32_t)1u)
+
+/** Written as a native integer to detect snapshots from a machine of the
+ * other byte order */
+#define SNAPSHOT_BYTE_ORDER ((uint32_t)0x01020304u)
+
+/** Alignment of every section of a snapshot, so columns mapped straight from
+ * the file are aligned for any component type */
+#define SNAPSHOT_ALIGNMENT ((uint64_t)64u)
+
+#define SNAPSHOT_ALIGN(offset) \
+    (((offset) + SNAPSHOT_ALIGNMENT - 1u) & ~(SNAPSHOT_ALIGNMENT - 1u))
+
+/** Start of a snapshot file. Offsets are in bytes from the start of the file.
+ * Every field is a native integer, and every section starts on a multiple of
+ * SNAPSHOT_ALIGNMENT. */
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    /** Tick of the world when it was saved */
+    uint64_t tick;
+    /** Number of entity indices ever used, including the reserved index 0 */
+    uint64_t n_indices;
+    /** Offset of the generation of each entity index, as uint32_t */
+    uint64_t generations_offset;
+    /** Number and offset of the free entity indices, as uint32_t */
+    uint64_t n_free;
+    uint64_t free_offset;
+    /** Number and offset of the struct snapshot_component entries */
+    uint64_t n_components;
+    uint64_t components_offset;
+    /** Offset and size of the NUL-terminated component names */
+    uint64_t names_offset;
+    uint64_t names_size;
+    /** Number and offset of the struct snapshot_archetype entries */
+    uint64_t n_archetypes;
+    uint64_t archetypes_offset;
+};
+
+/** A component used by the saved archetypes, matched by name on load */
+struct snapshot_component {
+    /** Offset of the component's name within the names section */
+    uint64_t name;
+    uint64_t size;
+};
+
+/** A saved archetype with at least one entity */
+struct snapshot_archetype {
+    /** Number of rows */
+    uint64_t count;
+    /** Number and offset of the snapshot component indices of the archetype's
+     * components, as uint64_t */
+    uint64_t n_components;
+    uint64_t components_offset;
+    /** Offset of the entity of each row */
+    uint64_t entities_offset;
+    /** Number and offset of the struct snapshot_array entries holding a
+     * column of data for each component with data */
+    uint64_t n_columns;
+    uint64_t columns_offset;
+    /** Number and offset of the struct snapshot_array entries holding an
+     * enabled mask, one bit per row, for each component disabled on any row */
+    uint64_t n_masks;
+    uint64_t masks_offset;
+};
+
+/** An array of per-row data belonging to one component of an archetype */
+struct snapshot_array {
+    /** Snapshot component index */
+    uint64_t component;
+    uint64_t offset;
+};
+
+/** Output stream of a snapshot being written */
+struct snapshot_writer {
+    FILE *file;
+    /** Offset of the next byte written */
+    uint64_t offset;
+};
+
+
+/** Append the given bytes to the snapshot, padded to the section alignment.
+ * Returns the offset they were written at. */
+static uint64_t snapshot_write(struct snapshot_writer *writer, const void *data, const size_t size)
+{
+    static const uint8_t padding[SNAPSHOT_ALIGNMENT] = { 0u };
+
+    const uint64_t offset = writer->offset;
+    if (size > 0u) {
+        fwrite(data, 1u, size, writer->file);
+    }
+
+    const uint64_t end = SNAPSHOT_ALIGN(offset + size);
+    fwrite(padding, 1u, (size_t)(end - (offset + size)), writer->file);
+    writer->offset = end;
+
+    return offset;
+}
+
+
+/** Suffix of the temporary file a snapshot is written to before it replaces
+ * the target */
+#define SNAPSHOT_TMP_SUFFIX ".tmp"
+
+
+/** Write a snapshot of the given world to the specified file, returning false
+ * if any write failed */
+static bool snapshot_write_world(struct cecs_world *world, FILE *file)
+{
+    struct snapshot_writer writer = { .file = file };
+    struct snapshot_header header;
+    memset(&header, 0u, sizeof(header));
+
+    /* Reserve room for the header, which is rewritten once the offsets of the
+     * sections are known */
+    snapshot_write(&writer, &header, sizeof(header));
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version    = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.tick       = world->tick;
+
+    /* Entity indices, live or free, with their generations */
+    const struct record_by_entity_map *records = &world->records_by_entity;
+    header.n_indices     = records->next_index;
+    uint32_t *generations = cecs_alloc(records->next_index * sizeof(uint32_t));
+    for (uint32_t i = 0u; i < records->next_index; ++i) {
+        const struct record_by_entity_entry *entry = get_record_slot(world, i, false);
+        generations[i] = entry ? entry->generation : 0u;
+    }
+    header.generations_offset = snapshot_write(&writer, generations, records->next_index * sizeof(uint32_t));
+    cecs_free(generations);
+
+    header.n_free      = records->free_indices.count;
+    header.free_offset = snapshot_write(&writer, records->free_indices.indices, records->free_indices.count * sizeof(uint32_t));
+
+    /* Number the components used by non-empty archetypes in order of ID */
+    uint64_t *snapshot_ids = alloc_zeroed(CECS_N_COMPONENTS, sizeof(uint64_t));
+    struct snapshot_component *components = cecs_alloc(CECS_N_COMPONENTS * sizeof(struct snapshot_component));
+    char *names       = NULL;
+    size_t names_size = 0u;
+    for (cecs_component_t id = 1u; id < CECS_NEXT_COMPONENT_ID; ++id) {
+        bool used = false;
+        const struct achetype_vec *archetypes = &world->archetypes_by_component[id];
+        for (size_t i = 0u; i < archetypes->count && !used; ++i) {
+            used = archetypes->elements[i]->count > 0u;
+        }
+        if (!used) {
+            continue;
+        }
+
+        const struct component_by_id *component = get_component_by_id(id);
+        const size_t length                     = strlen(component->name) + 1u;
+        names = cecs_realloc(names, names_size + length);
+        memcpy(&names[names_size], component->name, length);
+
+        components[header.n_components] = (struct snapshot_component){
+            .name = names_size,
+            .size = component->size,
+        };
+        names_size += length;
+
+        snapshot_ids[id] = header.n_components++;
+    }
+
+    header.components_offset = snapshot_write(&writer, components, header.n_components * sizeof(struct snapshot_component));
+    header.names_offset      = snapshot_write(&writer, names, names_size);
+    header.names_size        = names_size;
+    cecs_free(names);
+    cecs_free(components);
+
+    /* Write each non-empty archetype's table, then the archetype entries
+     * pointing at them */
+    struct snapshot_archetype *archetypes
+        = alloc_zeroed(world->archetypes.count + 1u, sizeof(struct snapshot_archetype));
+    struct snapshot_array *arrays = NULL;
+    uint64_t *ids                 = cecs_alloc(CECS_N_COMPONENTS * sizeof(uint64_t));
+
+    for (size_t i = 0u; i < world->archetypes.count; ++i) {
+        const struct cecs_archetype *archetype = world->archetypes.elements[i];
+        if (archetype->count == 0u) {
+            continue;
+        }
+
+        struct snapshot_archetype *entry = &archetypes[header.n_archetypes++];
+        entry->count                     = archetype->count;
+
+        for (size_t i_word = 0u; i_word < g_sig_words; ++i_word) {
+            for (cecs_component_t bits = archetype->sig.components[i_word]; bits; bits &= bits - 1u) {
+                const cecs_component_t id
+                    = (cecs_component_t)(i_word * 64u) + (cecs_component_t)__builtin_ctzll(bits);
+                ids[entry->n_components++] = snapshot_ids[id];
+            }
+        }
+        entry->components_offset = snapshot_write(&writer, ids, entry->n_components * sizeof(uint64_t));
+        entry->entities_offset   = snapshot_write(&writer, archetype->entities, archetype->count * sizeof(cecs_entity_t));
+
+        arrays = cecs_realloc(arrays, (archetype->n_columns + archetype->enabled.count + 1u) * sizeof(struct snapshot_array));
+
+        entry->n_columns = archetype->n_columns;
+        for (size_t i_column = 0u; i_column < archetype->n_columns; ++i_column) {
+            const struct column *column = &archetype->columns[i_column];
+            arrays[i_column]            = (struct snapshot_array){
+                .component = snapshot_ids[column->id],
+                .offset    = snapshot_write(&writer, column->data, archetype->count * column->size),
+            };
+        }
+        entry->columns_offset = snapshot_write(&writer, arrays, archetype->n_columns * sizeof(struct snapshot_array));
+
+        entry->n_masks = archetype->enabled.count;
+        for (size_t i_mask = 0u; i_mask < archetype->enabled.count; ++i_mask) {
+            const struct enabled_mask *mask = &archetype->enabled.masks[i_mask];
+            arrays[i_mask]                  = (struct snapshot_array){
+                .component = snapshot_ids[mask->id],
+                .offset    = snapshot_write(&writer, mask->bits, ENABLED_MASK_WORDS(archetype->count) * sizeof(uint64_t)),
+            };
+        }
+        entry->masks_offset = snapshot_write(&writer, arrays, archetype->enabled.count * sizeof(struct snapshot_array));
+    }
+
+    header.archetypes_offset = snapshot_write(&writer, archetypes, header.n_archetypes * sizeof(struct snapshot_archetype));
+
+    cecs_free(ids);
+    cecs_free(arrays);
+    cecs_free(archetypes);
+    cecs_free(snapshot_ids);
+
+    rewind(file);
+    fwrite(&header, sizeof(header), 1u, file);
+
+    return ferror(file) == 0;
+}
+
+
+/** Save the given world to a snapshot file at the specified path, returning
+ * false if it couldn't be written. The snapshot is written to a temporary file
+ * beside the target and renamed over it once on disk, so a save that fails
+ * partway leaves the previous snapshot intact. */
+bool cecs_snapshot_save_in(cecs_world_t *world, const char *path)
+{
+    const size_t length = strlen(path);
+    char *tmp_path      = cecs_alloc(length + sizeof(SNAPSHOT_TMP_SUFFIX));
+    memcpy(tmp_path, path, length);
+    memcpy(&tmp_path[length], SNAPSHOT_TMP_SUFFIX, sizeof(SNAPSHOT_TMP_SUFFIX));
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        cecs_free(tmp_path);
+        return false;
+    }
+
+    bool ok = snapshot_write_world(world, file);
+    ok      = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok      = (fclose(file) == 0) && ok;
+    ok      = ok && rename(tmp_path, path) == 0;
+    if (!ok) {
+        remove(tmp_path);
+    }
+
+    cecs_free(tmp_path);
+
+    return ok;
+}
+
+
+/** Returns true if `count` elements of `size` bytes starting at `offset` lie
+ * within a snapshot of `file_size` bytes */
+static bool snapshot_range_ok(const uint64_t file_size, const uint64_t offset, const uint64_t count, const uint64_t size)
+{
+    if (offset > file_size || offset % SNAPSHOT_ALIGNMENT != 0u) {
+        return false;
+    }
+
+    return size == 0u || count <= (file_size - offset) / size;
+}
+
+
+/** Build the signature of a saved archetype from the runtime IDs of the
+ * snapshot's components. Returns false if the archetype is malformed. */
+static bool snapshot_archetype_sig(const uint8_t *base, const uint64_t file_size, const struct snapshot_header *header, const struct snapshot_archetype *entry, const cecs_component_t *runtime_ids, struct signature *sig)
+{
+    memset(sig, 0u, sizeof(*sig));
+
+    if (entry->count == 0u
+        || !snapshot_range_ok(file_size, entry->components_offset, entry->n_components, sizeof(uint64_t))
+        || !snapshot_range_ok(file_size, entry->entities_offset, entry->count, sizeof(cecs_entity_t))
+        || !snapshot_range_ok(file_size, entry->columns_offset, entry->n_columns, sizeof(struct snapshot_array))
+        || !snapshot_range_ok(file_size, entry->masks_offset, entry->n_masks, sizeof(struct snapshot_array))) {
+        return false;
+    }
+
+    const uint64_t *components = (const uint64_t *)(base + entry->components_offset);
+    for (uint64_t i = 0u; i < entry->n_components; ++i) {
+        if (components[i] >= header->n_components) {
+            return false;
+        }
+        CECS_ADD_COMPONENT(sig, runtime_ids[components[i]]);
+    }
+
+    return true;
+}
+
+
+/** Check that the tables of a saved archetype can be copied into the given
+ * archetype, whose signature was built by snapshot_archetype_sig(). Each
+ * column and mask must belong to a different component, each entity must carry
+ * its index's saved generation, and no index may be used twice; `used` flags
+ * the indices seen so far. */
+static bool snapshot_archetype_ok(const uint8_t *base, const uint64_t file_size, const struct snapshot_header *header, const struct snapshot_archetype *entry, const cecs_component_t *runtime_ids, const struct signature *sig, uint8_t *used)
+{
+    size_t n_columns = 0u;
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        for (cecs_component_t bits = sig->components[i]; bits; bits &= bits - 1u) {
+            const cecs_component_t id = (cecs_component_t)(i * 64u) + (cecs_component_t)__builtin_ctzll(bits);
+            n_columns += (get_component_by_id(id)->size > 0u) ? 1u : 0u;
+        }
+    }
+    if (entry->n_columns != n_columns) {
+        return false;
+    }
+
+    /* A component listed twice would leave another of the table's columns
+     * unwritten */
+    struct signature seen = { 0u };
+
+    const struct snapshot_array *columns = (const struct snapshot_array *)(base + entry->columns_offset);
+    for (uint64_t i = 0u; i < entry->n_columns; ++i) {
+        if (columns[i].component >= header->n_components) {
+            return false;
+        }
+        const cecs_component_t id = runtime_ids[columns[i].component];
+        const size_t size         = get_component_by_id(id)->size;
+        if (!CECS_HAS_COMPONENT(sig, id) || CECS_HAS_COMPONENT(&seen, id) || size == 0u
+            || !snapshot_range_ok(file_size, columns[i].offset, entry->count, size)) {
+            return false;
+        }
+        CECS_ADD_COMPONENT(&seen, id);
+    }
+
+    memset(&seen, 0u, sizeof(seen));
+    const struct snapshot_array *masks = (const struct snapshot_array *)(base + entry->masks_offset);
+    for (uint64_t i = 0u; i < entry->n_masks; ++i) {
+        if (masks[i].component >= header->n_components) {
+            return false;
+        }
+        const cecs_component_t id = runtime_ids[masks[i].component];
+        if (!CECS_HAS_COMPONENT(sig, id) || CECS_HAS_COMPONENT(&seen, id)
+            || !snapshot_range_ok(file_size, masks[i].offset, ENABLED_MASK_WORDS(entry->count), sizeof(uint64_t))) {
+            return false;
+        }
+        CECS_ADD_COMPONENT(&seen, id);
+    }
+
+    const cecs_entity_t *entities = (const cecs_entity_t *)(base + entry->entities_offset);
+    const uint32_t *generations   = (const uint32_t *)(base + header->generations_offset);
+    for (uint64_t row = 0u; row < entry->count; ++row) {
+        const uint32_t index = CECS_ENTITY_INDEX(entities[row]);
+        if (index == 0u || index >= header->n_indices || used[index]
+            || generations[index] != CECS_ENTITY_GENERATION(entities[row])) {
+            return false;
+        }
+        used[index] = 1u;
+    }
+
+    return true;
+}
+
+
+/** Check that the free list of a snapshot names each index at most once and
+ * none of the live ones, which `used` flags */
+static bool snapshot_free_list_ok(const uint8_t *base, const struct snapshot_header *header, uint8_t *used)
+{
+    const uint32_t *free_indices = (const uint32_t *)(base + header->free_offset);
+    for (uint64_t i = 0u; i < header->n_free; ++i) {
+        if (free_indices[i] == 0u || free_indices[i] >= header->n_indices || used[free_indices[i]]) {
+            return false;
+        }
+        used[free_indices[i]] = 1u;
+    }
+
+    return true;
+}
+
+
+/** Return the ID of the registered component with the given name, or
+ * CECS_COMPONENT_INVALID if there is none */
+static cecs_component_t find_component_by_name(const char *name)
+{
+    for (cecs_component_t id = 1u; id < CECS_NEXT_COMPONENT_ID; ++id) {
+        const struct component_by_id *component = get_component_by_id(id);
+        if (component->name && strcmp(component->name, name) == 0) {
+            return id;
+        }
+    }
+
+    return CECS_COMPONENT_INVALID;
+}
+
+
+/** Check the header, entity table and component registry of a mapped
+ * snapshot, and find the runtime ID of each of its components by name.
+ * Returns false if the snapshot is malformed or from an incompatible build. */
+static bool snapshot_registry_ok(const uint8_t *base, const uint64_t file_size, const struct snapshot_header *header, cecs_component_t *runtime_ids)
+{
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SNAPSHOT_VERSION
+        || header->byte_order != SNAPSHOT_BYTE_ORDER
+        || header->n_indices == 0u || header->n_indices > UINT32_MAX
+        || header->n_components >= CECS_N_COMPONENTS
+        || !snapshot_range_ok(file_size, header->generations_offset, header->n_indices, sizeof(uint32_t))
+        || !snapshot_range_ok(file_size, header->free_offset, header->n_free, sizeof(uint32_t))
+        || !snapshot_range_ok(file_size, header->components_offset, header->n_components, sizeof(struct snapshot_component))
+        || !snapshot_range_ok(file_size, header->names_offset, header->names_size, 1u)
+        || !snapshot_range_ok(file_size, header->archetypes_offset, header->n_archetypes, sizeof(struct snapshot_archetype))) {
+        return false;
+    }
+
+    const char *names = (const char *)(base + header->names_offset);
+    if (header->names_size > 0u && names[header->names_size - 1u] != '\0') {
+        return false;
+    }
+
+    const struct snapshot_component *components = (const struct snapshot_component *)(base + header->components_offset);
+    for (uint64_t i = 0u; i < header->n_components; ++i) {
+        if (components[i].name >= header->names_size) {
+            return false;
+        }
+
+        runtime_ids[i] = find_component_by_name(&names[components[i].name]);
+
+        /* Every saved component must be registered, with the same layout */
+        if (runtime_ids[i] == CECS_COMPONENT_INVALID || get_component_by_id(runtime_ids[i])->size != components[i].size) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** Populate the given world, which must never have had an entity, from a
+ * mapped snapshot that has been checked */
+static void snapshot_restore(struct cecs_world *world, const uint8_t *base, const struct snapshot_header *header, const cecs_component_t *runtime_ids)
+{
+    if (header->tick > world->tick) {
+        world->tick = header->tick;
+    }
+
+    /* Restore every index with its generation, so handles saved elsewhere
+     * refer to the same entities and stale ones stay stale */
+    struct record_by_entity_map *records = &world->records_by_entity;
+    const uint32_t *generations          = (const uint32_t *)(base + header->generations_offset);
+    for (uint32_t i = 1u; i < (uint32_t)header->n_indices; ++i) {
+        get_record_slot(world, i, true)->generation = generations[i];
+    }
+    records->next_index = (uint32_t)header->n_indices;
+
+    if (header->n_free > records->free_indices.cap) {
+        records->free_indices.indices = cecs_realloc(records->free_indices.indices, header->n_free * sizeof(uint32_t));
+        records->free_indices.cap     = header->n_free;
+    }
+    if (header->n_free > 0u) {
+        memcpy(records->free_indices.indices, base + header->free_offset, header->n_free * sizeof(uint32_t));
     }
+    records->free_indices.count = header->n_free;
+
+    const struct snapshot_archetype *entries = (const struct snapshot_archetype *)(base + header->archetypes_offset);
+    for (uint64_t i = 0u; i < header->n_archetypes; ++i) {
+        const struct snapshot_archetype *entry = &entries[i];
+        const size_t count                     = (size_t)entry->count;
+
+        struct signature sig;
+        snapshot_archetype_sig(base, UINT64_MAX, header, entry, runtime_ids, &sig);
+        struct cecs_archetype *archetype = get_or_add_archetype_by_sig(world, &sig);
+        if (count > archetype->cap) {
+            resize_archetype_rows(archetype, count);
+        }
+
+        /* Whole columns are copied out of the mapping; nothing is done per
+         * component of each entity */
+        memcpy(archetype->entities, base + entry->entities_offset, count * sizeof(cecs_entity_t));
 
-    const struct cecs_entity_set_bucket *bucket = &it->set->buckets[it->i_bucket];
-    if (it->i_entity >= it->set->buckets[it->i_bucket].count) {
-        /* Skip empty buckets until we reach a non-empty one or the end of the set */
-        while ((++it->i_bucket < N_ENTITY_SET_BUCKETS)
-               && (it->set->buckets[it->i_bucket].count == 0)) {
+        const struct snapshot_array *columns = (const struct snapshot_array *)(base + entry->columns_offset);
+        for (uint64_t i_column = 0u; i_column < entry->n_columns; ++i_column) {
+            struct column *column = get_column(archetype, runtime_ids[columns[i_column].component]);
+            memcpy(column->data, base + columns[i_column].offset, count * column->size);
         }
 
-        /* Restart at the beginning of the new bucket */
-        it->i_entity = (size_t)0u;
+        const struct snapshot_array *masks = (const struct snapshot_array *)(base + entry->masks_offset);
+        for (uint64_t i_mask = 0u; i_mask < entry->n_masks; ++i_mask) {
+            struct enabled_mask_vec *vec = &archetype->enabled;
+            GROW_VEC_IF_NEEDED(vec, ENABLED_MASKS_MIN_SIZE, masks, struct enabled_mask);
+
+            struct enabled_mask *mask = &vec->masks[vec->count++];
+            mask->id                  = runtime_ids[masks[i_mask].component];
+            mask->bits                = cecs_alloc(ENABLED_MASK_WORDS(archetype->cap) * sizeof(uint64_t));
+            memset(mask->bits, 0xFF, ENABLED_MASK_WORDS(archetype->cap) * sizeof(uint64_t));
+            memcpy(mask->bits, base + masks[i_mask].offset, ENABLED_MASK_WORDS(count) * sizeof(uint64_t));
+        }
+
+        archetype->count = count;
+        mark_rows_added(archetype, 0u, count);
+
+        for (size_t row = 0u; row < count; ++row) {
+            struct record_by_entity_entry *record = get_record_slot(world, CECS_ENTITY_INDEX(archetype->entities[row]), false);
+            record->archetype                     = archetype;
+            record->row                           = row;
+        }
     }
+}
 
-    /* Check if we skipped empty buckets all the way to the end of the bucket,
-       or if the bucket we skipped to is empty (redundant?) */
-    if (it->i_bucket == N_ENTITY_SET_BUCKETS) {
-        return CECS_ENTITY_INVALID;
+
+/** Load a snapshot saved by cecs_snapshot_save_in() into the given world,
+ * which must never have had an entity. Returns false, leaving the world
+ * untouched, if the file can't be read or doesn't match the registered
+ * components. */
+bool cecs_snapshot_load_in(cecs_world_t *world, const char *path)
+{
+    if (world->records_by_entity.next_index != 1u) {
+        return false;
     }
 
-    bucket = &it->set->buckets[it->i_bucket];
-    /* If the bucket has one element then its value is in the bucket directly */
-    if (bucket->count == 1u) {
-        ++it->i_entity;
-        return bucket->value;
-    } else {
-        /* Iterate the bucket */
-        return bucket->entities[it->i_entity++];
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
     }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(struct snapshot_header)) {
+        close(fd);
+        return false;
+    }
+
+    const uint64_t file_size = (uint64_t)st.st_size;
+    void *mapping            = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const uint8_t *base = mapping;
+
+    /* Check the whole snapshot before touching the world, so a bad file
+     * can't leave it half loaded */
+    const struct snapshot_header *header = (const struct snapshot_header *)base;
+    cecs_component_t *runtime_ids        = cecs_alloc(CECS_N_COMPONENTS * sizeof(cecs_component_t));
+
+    bool ok = snapshot_registry_ok(base, file_size, header, runtime_ids);
+
+    /* The generations array was checked to lie within the file, so this is
+     * bounded by the file's size */
+    uint8_t *used = ok ? alloc_zeroed((size_t)header->n_indices, sizeof(uint8_t)) : NULL;
+
+    const struct snapshot_archetype *entries = (const struct snapshot_archetype *)(base + header->archetypes_offset);
+    for (uint64_t i = 0u; ok && i < header->n_archetypes; ++i) {
+        struct signature sig;
+        ok = snapshot_archetype_sig(base, file_size, header, &entries[i], runtime_ids, &sig)
+             && snapshot_archetype_ok(base, file_size, header, &entries[i], runtime_ids, &sig, used);
+    }
+    ok = ok && snapshot_free_list_ok(base, header, used);
+    cecs_free(used);
+
+    if (ok) {
+        snapshot_restore(world, base, header, runtime_ids);
+    }
+
+    cecs_free(runtime_ids);
+    munmap(mapping, (size_t)file_size);
+
+    return ok;
 }
 
 
-/** Get an iterator over the entities that implement the given components.
- * Returns the number of entities in the iterator.
- */
-cecs_entity_t _cecs_query(cecs_iter_t *it, const cecs_component_t n, ...)
+/** Magic number identifying a delta */
+#define DELTA_MAGIC "CECSDLTA"
+
+/** Version of the delta format, bumped whenever the layout changes */
+#define DELTA_VERSION ((uint32_t)1u)
+
+/** Minimum number of bytes allocated for a delta buffer */
+#define DELTA_MIN_SIZE ((size_t)4096u)
+
+/** Start of a delta. Offsets are in bytes from the start of the delta. Fields
+ * are native integers, packed without padding, so a delta may be read from
+ * any address.
+ *
+ * The destroyed section lists entity handles. The chunks section holds
+ * `n_chunks` runs of rows, each a struct delta_chunk followed by the snapshot
+ * indices of its archetype's components, the handle of each row, one
+ * component index and the row data for each column sent, and one component
+ * index and the enabled mask words for each component disabled on any row. */
+struct delta_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    /** Size of the whole delta, including this header */
+    uint64_t size;
+    /** Changes made at or after this tick are included */
+    uint64_t since;
+    /** Tick of the world when the delta was encoded */
+    uint64_t tick;
+    uint64_t n_destroyed;
+    uint64_t destroyed_offset;
+    uint64_t n_chunks;
+    uint64_t chunks_offset;
+    /** Number and offset of the struct snapshot_component entries of the
+     * components referenced by the delta */
+    uint64_t n_components;
+    uint64_t components_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+/** A run of rows of one archetype, up to one chunk long */
+struct delta_chunk {
+    uint64_t n_components;
+    uint64_t n_rows;
+    uint64_t n_columns;
+    uint64_t n_masks;
+};
+
+/** Components referenced by a delta being encoded */
+struct delta_registry {
+    /** One plus the index of each component in the delta, or 0 if it isn't
+     * referenced yet */
+    uint64_t *indices;
+    /** Components in the order they were first referenced */
+    cecs_component_t *ids;
+    uint64_t count;
+};
+
+
+/** Append the given bytes to the delta buffer. Returns their offset. */
+static size_t delta_write(cecs_delta_buffer_t *buffer, const void *data, const size_t size)
 {
-    va_list components;
-    cecs_entity_t n_entities = 0u;
+    if (buffer->size + size > buffer->cap) {
+        size_t cap = (buffer->cap == 0u) ? DELTA_MIN_SIZE : buffer->cap;
+        while (cap < buffer->size + size) {
+            cap *= 2u;
+        }
+        buffer->data = cecs_realloc(buffer->data, cap);
+        buffer->cap  = cap;
+    }
+
+    const size_t offset = buffer->size;
+    if (size > 0u) {
+        memcpy(buffer->data + offset, data, size);
+    }
+    buffer->size += size;
+
+    return offset;
+}
+
+
+/** Append a native integer to the delta buffer */
+static __always_inline void delta_write_u64(cecs_delta_buffer_t *buffer, const uint64_t value)
+{
+    delta_write(buffer, &value, sizeof(value));
+}
 
-    /* Use a prebuilt set so we aren't allocating set vectors on every query */
-    it->set = &query_result_cache;
-    /* Zero out the iterator */
-    it->i_bucket = 0u;
-    it->i_entity = 0u;
 
-    /* Clear the previous results from the cached set */
-    for (size_t i = 0u; i < N_ENTITY_SET_BUCKETS; ++i) {
-        it->set->buckets[i].count = 0u;
+/** Return the index of the given component in the delta being encoded,
+ * adding it to the registry if it isn't referenced yet */
+static uint64_t delta_component_index(struct delta_registry *registry, const cecs_component_t id)
+{
+    if (registry->indices[id] == 0u) {
+        registry->ids[registry->count] = id;
+        registry->indices[id]          = ++registry->count;
     }
 
-    va_start(components, n);
-    struct signature sig = components_to_sig(n, components);
-    va_end(components);
+    return registry->indices[id] - 1u;
+}
 
-    struct achetype_vec *archetypes = get_archetypes_by_sig(&sig);
-    if (archetypes->count == 0u) {
-        /* There are no entities with this archetype */
-        return 0u;
-    }
-
-    /* Build entity set from all the entities in all the archetypes returned */
-    for (size_t i_archetype = 0u; i_archetype < archetypes->count; ++i_archetype) {
-        struct archetype *archetype = archetypes->elements[i_archetype];
-        for (size_t i = 0u; i < archetype->count; ++i) {
-            const cecs_entity_t entity = archetype->entities[i];
-            const size_t i_bucket = (size_t)(entity % N_ENTITY_SET_BUCKETS);
-            struct cecs_entity_set_bucket *bucket = &it->set->buckets[i_bucket];
-
-            if (bucket->count == 0u) {
-                /* The bucket is empty, the first entity can go in the singulate
-                 * value instead of allocating a vector */
-                bucket->value = entity;
-                bucket->count = 1u;
-                ++n_entities;
-                /* Next entity in archetype */
-                continue;
-            }
 
-            /* Check for duplicates */
-            bool exists = false;
-            if (bucket->entities) {
-                /* The bucket vector is populated, we have to check every single entry */
-                for (size_t j = 0u; j < bucket->count; ++j) {
-                    if (bucket->entities[j] == entity) {
-                        exists = true;
-                        break;
-                    }
-                }
-            } else {
-                /* Bucket vector is not populated */
-                exists = bucket->value == entity;
-            }
-            if (exists) {
-                /* Go to next entity in archetype */
-                continue;
+/** Append the given rows of an archetype to the delta, with the columns that
+ * were written at or after `since`, or all of them if `all_columns` */
+static void delta_write_chunk(cecs_delta_buffer_t *buffer, struct delta_registry *registry, const struct cecs_archetype *archetype, const size_t first_row, const size_t n_rows, const cecs_tick_t since, const bool all_columns)
+{
+    const size_t i_chunk = CHUNK_OF_ROW(first_row);
+
+    struct delta_chunk chunk = {
+        .n_rows  = n_rows,
+        .n_masks = archetype->enabled.count,
+    };
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        chunk.n_components += (uint64_t)__builtin_popcountll(archetype->sig.components[i]);
+    }
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        if (all_columns || archetype->columns[i].changed[i_chunk] >= since) {
+            ++chunk.n_columns;
+        }
+    }
+    delta_write(buffer, &chunk, sizeof(chunk));
+
+    for (size_t i = 0u; i < g_sig_words; ++i) {
+        for (cecs_component_t bits = archetype->sig.components[i]; bits; bits &= bits - 1u) {
+            const cecs_component_t id = (cecs_component_t)(i * 64u) + (cecs_component_t)__builtin_ctzll(bits);
+            delta_write_u64(buffer, delta_component_index(registry, id));
+        }
+    }
+
+    delta_write(buffer, &archetype->entities[first_row], n_rows * sizeof(cecs_entity_t));
+
+    for (size_t i = 0u; i < archetype->n_columns; ++i) {
+        const struct column *column = &archetype->columns[i];
+        if (all_columns || column->changed[i_chunk] >= since) {
+            delta_write_u64(buffer, delta_component_index(registry, column->id));
+            delta_write(buffer, COLUMN_DATA_PTR(column, first_row), n_rows * column->size);
+        }
+    }
+
+    /* Chunks start on a word of the masks, so their words are copied whole */
+    for (size_t i = 0u; i < archetype->enabled.count; ++i) {
+        const struct enabled_mask *mask = &archetype->enabled.masks[i];
+        delta_write_u64(buffer, delta_component_index(registry, mask->id));
+        delta_write(buffer, &mask->bits[first_row / 64u], ENABLED_MASK_WORDS(n_rows) * sizeof(uint64_t));
+    }
+}
+
+
+/** Encode the changes made to the given world at or after tick `since` into
+ * the buffer, replacing its contents */
+void cecs_delta_encode(cecs_world_t *world, const cecs_tick_t since, cecs_delta_buffer_t *buffer)
+{
+    struct delta_header header;
+    memset(&header, 0u, sizeof(header));
+    memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+    header.version    = DELTA_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.since      = since;
+    header.tick       = world->tick;
+
+    buffer->size = 0u;
+    delta_write(buffer, &header, sizeof(header));
+
+    /* Destroys are sent first, so a handle reused by a later create isn't
+     * mistaken for the destroyed entity */
+    header.destroyed_offset = buffer->size;
+    cecs_removed_iter_t it;
+    cecs_entity_t entity;
+    cecs_query_destroyed(world, &it, since);
+    while ((entity = cecs_removed_next(&it))) {
+        delta_write(buffer, &entity, sizeof(entity));
+        ++header.n_destroyed;
+    }
+
+    /* Send each chunk rows were added to, with all its data, and the changed
+     * columns of each chunk that was written to or had a component toggled.
+     * Entities that gained or lost components were added to a chunk of their
+     * new archetype. Every chunk sent carries its enabled masks. */
+    struct delta_registry registry = {
+        .indices = alloc_zeroed(CECS_N_COMPONENTS, sizeof(uint64_t)),
+        .ids     = cecs_alloc(CECS_N_COMPONENTS * sizeof(cecs_component_t)),
+    };
+
+    header.chunks_offset = buffer->size;
+    for (size_t i = 0u; i < world->archetypes.count; ++i) {
+        const struct cecs_archetype *archetype = world->archetypes.elements[i];
+
+        for (size_t first_row = 0u; first_row < archetype->count; first_row += CECS_CHUNK_ROWS) {
+            const size_t i_chunk = CHUNK_OF_ROW(first_row);
+            const size_t n_rows  = (archetype->count - first_row < CECS_CHUNK_ROWS) ? archetype->count - first_row : CECS_CHUNK_ROWS;
+
+            const bool added = archetype->added[i_chunk] >= since;
+            bool changed     = archetype->toggled[i_chunk] >= since;
+            for (size_t i_column = 0u; i_column < archetype->n_columns && !changed; ++i_column) {
+                changed = archetype->columns[i_column].changed[i_chunk] >= since;
             }
 
-            GROW_VEC_IF_NEEDED(bucket, ENTITY_SET_MIN_BUCKET_SIZE, entities, cecs_entity_t);
-            if (bucket->count == 1u) {
-                /* We're transitioning from 1 element to 2 elements, move the
-                 * singulate value to the vector */
-                bucket->entities[0u] = bucket->value;
+            if (added || changed) {
+                delta_write_chunk(buffer, &registry, archetype, first_row, n_rows, since, added);
+                ++header.n_chunks;
             }
-            /* Add an entry to the end of the bucket and increase the count */
-            bucket->entities[bucket->count++] = entity;
-            /* Track the total number of entities returned by the query */
-            ++n_entities;
         }
     }
 
-    return n_entities;
+    /* Name the referenced components so the receiver can match them with its
+     * own registrations */
+    header.n_components = registry.count;
+    size_t names_size   = 0u;
+    for (uint64_t i = 0u; i < registry.count; ++i) {
+        names_size += strlen(get_component_by_id(registry.ids[i])->name) + 1u;
+    }
+
+    header.components_offset = buffer->size;
+    size_t name              = 0u;
+    for (uint64_t i = 0u; i < registry.count; ++i) {
+        const struct component_by_id *component = get_component_by_id(registry.ids[i]);
+        const struct snapshot_component entry   = { .name = name, .size = component->size };
+        delta_write(buffer, &entry, sizeof(entry));
+        name += strlen(component->name) + 1u;
+    }
+
+    header.names_offset = buffer->size;
+    header.names_size   = names_size;
+    for (uint64_t i = 0u; i < registry.count; ++i) {
+        const char *component_name = get_component_by_id(registry.ids[i])->name;
+        delta_write(buffer, component_name, strlen(component_name) + 1u);
+    }
+
+    cecs_free(registry.ids);
+    cecs_free(registry.indices);
+
+    header.size = buffer->size;
+    memcpy(buffer->data, &header, sizeof(header));
 }
 
 
-/** Get a pointer to the component data for the given entity and component pair */
-void *_cecs_get(const cecs_entity_t entity, const cecs_component_t id)
+/** Free the memory held by the given delta buffer, leaving it empty */
+void cecs_delta_buffer_free(cecs_delta_buffer_t *buffer)
 {
-    struct component_by_id *component = get_component_by_id(id);
+    cecs_free(buffer->data);
+    memset(buffer, 0u, sizeof(*buffer));
+}
 
-    const size_t i_index_bucket = (size_t)(entity % N_INDEX_BY_ENTITY_BUCKETS);
-    struct index_by_entity_bucket *index_bucket
-        = &component->indices_by_entity[i_index_bucket];
 
-    struct index_by_entity_pair *index_by_entity = NULL;
-    if (index_bucket->count == 1u) {
-        index_by_entity = &index_bucket->value;
-    } else {
-        FIND_ENTRY_IN_VEC(index_bucket, entity, entity, index_by_entity);
+/** Write all of the given bytes to a file descriptor, retrying short
+ * writes. Returns false on error. */
+static bool write_all(const int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0u) {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
     }
 
-    if (!index_by_entity) {
-        /* Entity doesn't have component */
-        return NULL;
+    return true;
+}
+
+
+/** Read exactly `size` bytes from a file descriptor, retrying short reads.
+ * Returns false on error or end of file. */
+static bool read_all(const int fd, uint8_t *data, size_t size)
+{
+    while (size > 0u) {
+        const ssize_t n_read = read(fd, data, size);
+        if (n_read <= 0) {
+            return false;
+        }
+        data += n_read;
+        size -= (size_t)n_read;
     }
 
-    return COMPONENT_DATA_PTR(component, index_by_entity->index);
+    return true;
 }
 
 
-/** Create a new entity implementing the given components */
-cecs_entity_t _cecs_create(const cecs_component_t n, ...)
+/** Encode the changes made to the given world at or after tick `since` and
+ * write them to a file descriptor */
+bool cecs_delta_encode_fd(cecs_world_t *world, const cecs_tick_t since, const int fd)
 {
-    va_list components;
-    va_start(components, n);
-    struct signature sig = components_to_sig(n, components);
-    va_end(components);
+    cecs_delta_buffer_t buffer = { 0u };
+    cecs_delta_encode(world, since, &buffer);
 
-    const cecs_entity_t entity = g_next_entity++;
+    const bool ok = write_all(fd, buffer.data, buffer.size);
+    cecs_delta_buffer_free(&buffer);
 
-    /* Update the entity's cached signature */
-    set_sig_by_entity(entity, &sig);
+    return ok;
+}
 
-    /* Add the entity to its new archetype */
-    add_entity_to_archetype(entity, get_or_add_archetype_by_sig(&sig));
 
-    /* Add the entity to all the named components */
-    va_start(components, n);
-    for (size_t i = 0u; i < n; ++i) {
-        add_entity_to_component(va_arg(components, cecs_component_t), entity);
+/** Cursor over a delta being decoded */
+struct delta_reader {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+};
+
+
+/** Return the next `size` bytes of the delta and step past them, or NULL if
+ * the delta is too short */
+static const uint8_t *delta_read(struct delta_reader *reader, const uint64_t size)
+{
+    if (size > reader->size - reader->offset) {
+        return NULL;
     }
-    va_end(components);
 
-    return entity;
+    const uint8_t *data = reader->data + reader->offset;
+    reader->offset += (size_t)size;
+
+    return data;
 }
 
 
-/** Add the specified components to the given entity */
-void _cecs_add(const cecs_entity_t entity, const cecs_component_t n, ...)
+/** Read the next native integer of the delta into `value`. Returns false if
+ * the delta is too short. */
+static bool delta_read_u64(struct delta_reader *reader, uint64_t *value)
 {
-    va_list components;
+    const uint8_t *data = delta_read(reader, sizeof(uint64_t));
+    if (!data) {
+        return false;
+    }
 
-    struct signature *sig      = get_sig_by_entity(entity);
-    struct signature sig_added = *sig;
+    memcpy(value, data, sizeof(uint64_t));
+    return true;
+}
 
-    va_start(components, n);
-    struct signature sig_to_add = components_to_sig(n, components);
-    va_end(components);
 
-    sig_union(&sig_added, &sig_to_add);
+/** Place the given entity on a row of the specified archetype in a world
+ * receiving deltas, creating it under the same handle or moving it there */
+static void delta_place_entity(struct cecs_world *world, const cecs_entity_t entity, struct cecs_archetype *archetype)
+{
+    const uint32_t index                  = CECS_ENTITY_INDEX(entity);
+    struct record_by_entity_entry *record = get_record_slot(world, index, true);
 
-    if (sigs_are_equal(&sig_added, sig)) {
-        /* Nothing to do */
-        return;
+    if (record->archetype && record->generation != CECS_ENTITY_GENERATION(entity)) {
+        /* The destroy of the index's previous entity predates the delta */
+        cecs_destroy_in(world, CECS_ENTITY(index, record->generation));
+        --world->records_by_entity.free_indices.count;
     }
 
-    /* Add the entity to its new archetype */
-    add_entity_to_archetype(entity, get_or_add_archetype_by_sig(&sig_added));
-    /* Update the cached signature for this entity */
-    set_sig_by_entity(entity, &sig_added);
+    if (!record->archetype) {
+        set_record_by_entity(world, entity, archetype, add_entity_to_archetype(entity, archetype));
 
-    /* Add the entity to all components named */
-    va_start(components, n);
-    for (size_t i = 0u; i < n; ++i) {
-        add_entity_to_component(va_arg(components, cecs_component_t), entity);
+        if (index >= world->records_by_entity.next_index) {
+            world->records_by_entity.next_index = index + 1u;
+        }
+    } else if (record->archetype != archetype) {
+        move_entity_to_archetype(world, entity, record, archetype);
     }
-    va_end(components);
 }
 
 
-/** Remove the specified components from the given entity */
-void _cecs_remove(const cecs_entity_t entity, const cecs_component_t n, ...)
+/** Read a run of rows of a delta, applying it to the given world if `apply`
+ * or else only checking it. Returns false if the run is malformed. */
+static bool delta_read_chunk(struct cecs_world *world, struct delta_reader *reader, const uint64_t n_components, const cecs_component_t *runtime_ids, struct index_vec *rows, const bool apply)
 {
-    va_list components;
+    const uint8_t *data = delta_read(reader, sizeof(struct delta_chunk));
+    if (!data) {
+        return false;
+    }
+    struct delta_chunk chunk;
+    memcpy(&chunk, data, sizeof(chunk));
+
+    struct signature sig;
+    memset(&sig, 0u, sizeof(sig));
+    size_t n_columns = 0u;
+    for (uint64_t i = 0u; i < chunk.n_components; ++i) {
+        uint64_t component;
+        if (!delta_read_u64(reader, &component) || component >= n_components) {
+            return false;
+        }
+        CECS_ADD_COMPONENT(&sig, runtime_ids[component]);
+        n_columns += (get_component_by_id(runtime_ids[component])->size > 0u) ? 1u : 0u;
+    }
 
-    /* Get the entity's current signature from the cache */
-    struct signature *sig        = get_sig_by_entity(entity);
-    struct signature sig_removed = *sig;
+    if (chunk.n_columns > n_columns || chunk.n_rows > reader->size / sizeof(cecs_entity_t)) {
+        return false;
+    }
 
-    va_start(components, n);
-    struct signature sig_to_remove = components_to_sig(n, components);
-    va_end(components);
+    const uint8_t *entities = delta_read(reader, chunk.n_rows * sizeof(cecs_entity_t));
+    if (!entities) {
+        return false;
+    }
 
-    sig_remove(&sig_removed, &sig_to_remove);
+    struct cecs_archetype *archetype = NULL;
+    if (apply) {
+        archetype = get_or_add_archetype_by_sig(world, &sig);
 
-    if (sigs_are_equal(&sig_removed, sig)) {
-        /* Nothing to do */
-        return;
+        if (chunk.n_rows > rows->cap) {
+            rows->indices = cecs_realloc(rows->indices, chunk.n_rows * sizeof(uint32_t));
+            rows->cap     = chunk.n_rows;
+        }
     }
 
-    /* Remove the entity from its current archetype */
-    struct archetype *archetype = get_archetype_by_sig(sig);
+    for (uint64_t i = 0u; i < chunk.n_rows; ++i) {
+        cecs_entity_t entity;
+        memcpy(&entity, entities + i * sizeof(cecs_entity_t), sizeof(entity));
+        if (CECS_ENTITY_INDEX(entity) == 0u) {
+            return false;
+        }
 
-    for (cecs_entity_t i = 0u; i < archetype->count; ++i) {
-        if (archetype->entities[i] == entity) {
-            /* Put the last entity in the array into the removed entity's slot */
-            archetype->entities[i] = archetype->entities[--archetype->count];
-            break;
+        if (apply) {
+            delta_place_entity(world, entity, archetype);
         }
     }
 
-    /* Add the entity to its new archetype */
-    add_entity_to_archetype(entity, get_or_add_archetype_by_sig(&sig_removed));
-    /* Cache the entity's new signature */
-    set_sig_by_entity(entity, &sig_removed);
+    /* Find the rows once every entity is placed, as placing one may have
+     * swapped another within the table */
+    for (uint64_t i = 0u; apply && i < chunk.n_rows; ++i) {
+        cecs_entity_t entity;
+        memcpy(&entity, entities + i * sizeof(cecs_entity_t), sizeof(entity));
 
-    /* Remove the entity from all components named in the vector */
-    va_start(components, n);
-    for (size_t i = 0u; i < n; ++i) {
-        remove_entity_from_component(va_arg(components, cecs_component_t), entity);
+        const size_t row = get_record_slot(world, CECS_ENTITY_INDEX(entity), false)->row;
+        rows->indices[i] = (uint32_t)row;
+
+        /* Rows are enabled unless the delta says otherwise */
+        for (size_t i_mask = 0u; i_mask < archetype->enabled.count; ++i_mask) {
+            set_enabled_bit(archetype->enabled.masks[i_mask].bits, row, true);
+        }
+        mark_toggled(archetype, row);
     }
-    va_end(components);
-}
 
+    for (uint64_t i = 0u; i < chunk.n_columns; ++i) {
+        uint64_t component;
+        if (!delta_read_u64(reader, &component) || component >= n_components) {
+            return false;
+        }
 
-/** Register the given component as having the specified size */
-void cecs_register_component(const cecs_component_t id, const size_t size)
-{
-    assert(
-        id < CECS_N_COMPONENTS
-        && "Component ID is out of range. Increase CECS_N_COMPONENTS."
-    );
+        const cecs_component_t id = runtime_ids[component];
+        const size_t size         = get_component_by_id(id)->size;
+        if (!CECS_HAS_COMPONENT(&sig, id) || size == 0u || chunk.n_rows > reader->size / size) {
+            return false;
+        }
 
-    struct component_by_id *component = get_component_by_id(id);
+        const uint8_t *column_data = delta_read(reader, chunk.n_rows * size);
+        if (!column_data) {
+            return false;
+        }
 
-    component->id   = id;
-    component->size = size;
+        if (apply) {
+            struct column *column = get_column(archetype, id);
+            for (uint64_t row = 0u; row < chunk.n_rows; ++row) {
+                memcpy(COLUMN_DATA_PTR(column, rows->indices[row]), column_data + row * size, size);
+                mark_changed(archetype, column, rows->indices[row]);
+            }
+        }
+    }
+
+    for (uint64_t i = 0u; i < chunk.n_masks; ++i) {
+        uint64_t component;
+        if (!delta_read_u64(reader, &component) || component >= n_components
+            || !CECS_HAS_COMPONENT(&sig, runtime_ids[component])) {
+            return false;
+        }
+
+        const uint8_t *words = delta_read(reader, ENABLED_MASK_WORDS(chunk.n_rows) * sizeof(uint64_t));
+        if (!words) {
+            return false;
+        }
+
+        if (apply) {
+            for (uint64_t row = 0u; row < chunk.n_rows; ++row) {
+                uint64_t word;
+                memcpy(&word, words + (row / 64u) * sizeof(uint64_t), sizeof(word));
+                if (!((word >> (row % 64u)) & 1u)) {
+                    set_row_enabled(archetype, runtime_ids[component], rows->indices[row], false);
+                }
+            }
+        }
+    }
+
+    return true;
 }
 
 
-/** Populate the component data for the given entity, component pair */
-bool _cecs_set(const cecs_entity_t entity, const cecs_component_t id, void *data)
+/** Read the destroys and runs of rows of a delta whose header and registry
+ * have been checked, applying them to the given world if `apply` or else only
+ * checking them. Returns false if the delta is malformed. */
+static bool delta_read_changes(struct cecs_world *world, const uint8_t *data, const struct delta_header *header, const cecs_component_t *runtime_ids, const bool apply)
 {
-    struct component_by_id *component = get_component_by_id(id);
+    struct delta_reader reader = { .data = data, .size = (size_t)header->size };
+
+    reader.offset            = (size_t)header->destroyed_offset;
+    const uint8_t *destroyed = delta_read(&reader, header->n_destroyed * sizeof(cecs_entity_t));
+    if (!destroyed) {
+        return false;
+    }
 
-    const size_t i_index_bucket = (size_t)(entity % N_INDEX_BY_ENTITY_BUCKETS);
-    struct index_by_entity_bucket *index_bucket
-        = &component->indices_by_entity[i_index_bucket];
+    if (apply) {
+        for (uint64_t i = 0u; i < header->n_destroyed; ++i) {
+            cecs_entity_t entity;
+            memcpy(&entity, destroyed + i * sizeof(cecs_entity_t), sizeof(entity));
 
-    struct index_by_entity_pair *index_by_entity = NULL;
-    if (index_bucket->count == 1u) {
-        /* Only one entry in bucket, search the singulate value */
-        if (index_bucket->value.entity == entity) {
-            index_by_entity = &index_bucket->value;
+            /* Indices are only ever handed out by the sending world, so the
+             * receiver keeps its free list empty */
+            if (cecs_destroy_in(world, entity)) {
+                --world->records_by_entity.free_indices.count;
+            }
         }
-    } else {
-        /* More than one entry in bucket, search the vector */
-        FIND_ENTRY_IN_VEC(index_bucket, entity, entity, index_by_entity);
     }
 
-    if (!index_by_entity) {
-        /* Entity doesn't have component */
-        return false;
+    reader.offset = (size_t)header->chunks_offset;
+
+    struct index_vec rows = { 0u };
+    bool ok               = true;
+    for (uint64_t i = 0u; ok && i < header->n_chunks; ++i) {
+        ok = delta_read_chunk(world, &reader, header->n_components, runtime_ids, &rows, apply);
     }
+    cecs_free(rows.indices);
 
-    memcpy(
-        COMPONENT_DATA_PTR(component, index_by_entity->index),
-        data,
-        component->size
-    );
+    return ok;
+}
 
-    return true;
+
+/** Check that the header of a delta of `size` bytes describes sections that
+ * lie within it. This needs nothing but the header, so a delta read from a
+ * stream can be checked before anything is allocated for it. */
+static bool delta_header_ok(const struct delta_header *header, const uint64_t size)
+{
+    return memcmp(header->magic, DELTA_MAGIC, sizeof(header->magic)) == 0
+           && header->version == DELTA_VERSION
+           && header->byte_order == SNAPSHOT_BYTE_ORDER
+           && header->size == size
+           && size >= sizeof(struct delta_header)
+           && size <= SIZE_MAX
+           && header->destroyed_offset <= size
+           && header->n_destroyed <= (size - header->destroyed_offset) / sizeof(cecs_entity_t)
+           && header->chunks_offset <= size
+           && header->n_chunks <= (size - header->chunks_offset) / sizeof(struct delta_chunk)
+           && header->n_components < CECS_N_COMPONENTS
+           && header->components_offset <= size
+           && header->n_components <= (size - header->components_offset) / sizeof(struct snapshot_component)
+           && header->names_offset <= size
+           && header->names_size <= size - header->names_offset;
 }
 
 
-/** Zero out the component data for the given entity, component pair */
-bool _cecs_zero(const cecs_entity_t entity, const size_t n, ...)
+/** Apply a delta made by cecs_delta_encode() to the given world. Returns
+ * false, leaving the world untouched, if the delta is malformed or doesn't
+ * match the registered components. */
+bool cecs_delta_apply(cecs_world_t *world, const void *delta, const size_t size)
 {
-    bool changed = false;
+    const uint8_t *data = delta;
+    struct delta_header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
 
-    va_list components;
-    va_start(components, n);
+    if (!delta_header_ok(&header, size)
+        || (header.names_size > 0u && data[header.names_offset + header.names_size - 1u] != '\0')) {
+        return false;
+    }
 
-    for (size_t k = 0u; k < n; ++k) {
-        struct component_by_id *component
-            = get_component_by_id(va_arg(components, cecs_component_t));
-
-        const size_t i_index_bucket = (size_t)(entity % N_INDEX_BY_ENTITY_BUCKETS);
-        struct index_by_entity_bucket *index_bucket
-            = &component->indices_by_entity[i_index_bucket];
-
-        struct index_by_entity_pair *index_by_entity = NULL;
-        if (index_bucket->count == 1u) {
-            /* Only one entry in bucket, search the singulate value */
-            if (index_bucket->value.entity == entity) {
-                index_by_entity = &index_bucket->value;
-            }
-        } else {
-            /* More than one entry in bucket, search the vector */
-            FIND_ENTRY_IN_VEC(index_bucket, entity, entity, index_by_entity);
+    /* Match the delta's components with the registered ones by name */
+    cecs_component_t *runtime_ids = cecs_alloc((header.n_components + 1u) * sizeof(cecs_component_t));
+    bool ok                       = true;
+    for (uint64_t i = 0u; ok && i < header.n_components; ++i) {
+        struct snapshot_component component;
+        memcpy(&component, data + header.components_offset + i * sizeof(component), sizeof(component));
+
+        ok = component.name < header.names_size;
+        if (ok) {
+            runtime_ids[i] = find_component_by_name((const char *)data + header.names_offset + component.name);
+            ok = runtime_ids[i] != CECS_COMPONENT_INVALID && get_component_by_id(runtime_ids[i])->size == component.size;
         }
+    }
 
-        if (!index_by_entity) {
-            /* Entity doesn't have component */
-            continue;
-        }
+    /* Check the whole delta before changing the world, so a bad one can't be
+     * half applied */
+    ok = ok && delta_read_changes(world, data, &header, runtime_ids, false);
+    if (ok) {
+        delta_read_changes(world, data, &header, runtime_ids, true);
+    }
 
-        memset(
-            COMPONENT_DATA_PTR(component, index_by_entity->index),
-            0u,
-            component->size
-        );
-        changed = true;
+    cecs_free(runtime_ids);
+
+    return ok;
+}
+
+
+/** Read one delta from a file descriptor and apply it to the given world */
+bool cecs_delta_apply_fd(cecs_world_t *world, const int fd)
+{
+    struct delta_header header;
+    if (!read_all(fd, (uint8_t *)&header, sizeof(header)) || !delta_header_ok(&header, header.size)) {
+        return false;
     }
 
-    va_end(components);
+    /* The size comes from the stream, so a corrupt one mustn't abort through
+     * check_alloc() */
+    uint8_t *data = g_allocator.alloc((size_t)header.size, g_allocator.ctx);
+    if (!data) {
+        return false;
+    }
+    memcpy(data, &header, sizeof(header));
 
-    return changed;
-}
\ No newline at end of file
+    const bool ok = read_all(fd, data + sizeof(header), (size_t)header.size - sizeof(header))
+                    && cecs_delta_apply(world, data, (size_t)header.size);
+    cecs_free(data);
+
+    return ok;
+}
@@ -0,0 +1,723 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <memory.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cecs/cecs.h>
+
+
+/** Size of a cache line, used to keep per-worker state from false sharing */
+#define CACHE_LINE_SIZE ((size_t)64u)
+
+/** Pack a [begin, end) range of task indices into one atomic word */
+#define RANGE_PACK(begin, end) ((((uint64_t)(end)) << 32u) | (uint64_t)(begin))
+#define RANGE_BEGIN(range)     ((size_t)((range) & (uint64_t)0xFFFFFFFFu))
+#define RANGE_END(range)       ((size_t)((range) >> 32u))
+
+
+/** The tasks owned by one worker. The owner takes tasks from the front and
+ * other workers steal from the back, both with a compare-and-swap on the
+ * packed range. */
+struct worker_range {
+    _Atomic uint64_t range;
+    uint8_t pad[CACHE_LINE_SIZE - sizeof(uint64_t)];
+};
+
+
+/** A batch of independent tasks to be spread across the workers. Jobs are
+ * owned by the thread that submitted them, so jobs from different threads,
+ * e.g. progressing different worlds, can be on the pool at once. */
+struct job {
+    /** Run the task with the given index on the given worker */
+    void (*run)(const size_t i_task, const size_t worker, void *ctx);
+    void *ctx;
+    /** One range of tasks per worker */
+    struct worker_range *ranges;
+    /** Number of helper threads running the job, guarded by the pool mutex */
+    size_t n_helpers;
+    /** Set once a worker has found no tasks left, so no more helpers join */
+    bool exhausted;
+    /** Next job posted to the pool */
+    struct job *next;
+};
+
+
+/** Vector of chunks */
+struct chunk_vec {
+    size_t count;
+    size_t cap;
+    cecs_chunk_t *chunks;
+};
+
+/** Minimum number of elements allocated for the vector of chunks to process */
+#define CHUNKS_VEC_MIN_SIZE ((size_t)64u)
+
+
+/** Pool of threads that run jobs together with the thread submitting them */
+struct thread_pool {
+    /** Protects everything below it */
+    pthread_mutex_t mutex;
+    /** Signalled when a job is posted or the pool is stopping */
+    pthread_cond_t wake;
+    /** Signalled when a helper thread leaves a job */
+    pthread_cond_t done;
+    /** Number of workers per job, including the submitting thread */
+    size_t n_workers;
+    /** Helper threads, of which there are `n_workers - 1` */
+    pthread_t *threads;
+    /** Jobs posted and not yet retired by their submitters */
+    struct job *jobs;
+    /** Set when the helper threads should exit */
+    bool stop;
+};
+
+
+/** Worker count requested with cecs_set_worker_count(), or 0 for one worker per
+ * online processor */
+static size_t g_requested_workers = 0u;
+
+/** Guards starting and stopping the pool */
+static pthread_mutex_t g_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** The pool, created on first use */
+static struct thread_pool *g_pool = NULL;
+
+/** Index of the worker the current thread is running a job as, or SIZE_MAX if
+ * it isn't running one */
+static _Thread_local size_t tl_worker = SIZE_MAX;
+
+
+/** Take a task from the front of the given range. Returns false if the range
+ * is empty. */
+static bool pop_task(struct worker_range *range, size_t *i_task)
+{
+    uint64_t r = atomic_load_explicit(&range->range, memory_order_relaxed);
+    while (RANGE_BEGIN(r) < RANGE_END(r)) {
+        const uint64_t next = RANGE_PACK(RANGE_BEGIN(r) + 1u, RANGE_END(r));
+        if (atomic_compare_exchange_weak(&range->range, &r, next)) {
+            *i_task = RANGE_BEGIN(r);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** Steal a task from the back of the given range. Returns false if the range
+ * is empty. */
+static bool steal_task(struct worker_range *range, size_t *i_task)
+{
+    uint64_t r = atomic_load_explicit(&range->range, memory_order_relaxed);
+    while (RANGE_BEGIN(r) < RANGE_END(r)) {
+        const uint64_t next = RANGE_PACK(RANGE_BEGIN(r), RANGE_END(r) - 1u);
+        if (atomic_compare_exchange_weak(&range->range, &r, next)) {
+            *i_task = RANGE_END(r) - 1u;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** Run the tasks of the given job as the specified worker: first its own,
+ * then whatever it can steal from the others */
+static void run_job(const struct job *job, const size_t worker, const size_t n_workers)
+{
+    tl_worker = worker;
+
+    size_t i_task = 0u;
+    while (pop_task(&job->ranges[worker], &i_task)) {
+        job->run(i_task, worker, job->ctx);
+    }
+
+    /* Keep sweeping the other workers until a full pass finds nothing */
+    bool stole = true;
+    while (stole) {
+        stole = false;
+        for (size_t k = 1u; k < n_workers; ++k) {
+            struct worker_range *victim = &job->ranges[(worker + k) % n_workers];
+            while (steal_task(victim, &i_task)) {
+                job->run(i_task, worker, job->ctx);
+                stole = true;
+            }
+        }
+    }
+
+    tl_worker = SIZE_MAX;
+}
+
+
+/** Argument passed to each helper thread */
+struct helper_arg {
+    struct thread_pool *pool;
+    size_t worker;
+};
+
+
+/** Return the first posted job that may still have tasks left, or NULL.
+ * Must be called with the pool mutex held. */
+static struct job *find_open_job(const struct thread_pool *pool)
+{
+    for (struct job *job = pool->jobs; job; job = job->next) {
+        if (!job->exhausted) {
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+
+/** Main loop of a helper thread: join any job with tasks left, run it, and
+ * report back */
+static void *helper_main(void *arg)
+{
+    struct helper_arg *helper = arg;
+    struct thread_pool *pool  = helper->pool;
+    const size_t worker       = helper->worker;
+    cecs_free(helper);
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        struct job *job = NULL;
+        while (!pool->stop && !(job = find_open_job(pool))) {
+            pthread_cond_wait(&pool->wake, &pool->mutex);
+        }
+        if (pool->stop) {
+            break;
+        }
+
+        ++job->n_helpers;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_job(job, worker, pool->n_workers);
+
+        pthread_mutex_lock(&pool->mutex);
+        /* A full sweep found nothing, so later helpers needn't join */
+        job->exhausted = true;
+        if (--job->n_helpers == 0u) {
+            pthread_cond_broadcast(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+
+/** Stop the helper threads of the pool and free it */
+static void stop_pool(struct thread_pool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0u; i + 1u < pool->n_workers; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->mutex);
+    cecs_free(pool->threads);
+    cecs_free(pool);
+}
+
+
+/** Start a pool with the given number of workers, including the thread that
+ * will submit jobs */
+static struct thread_pool *start_pool(const size_t n_workers)
+{
+    struct thread_pool *pool = cecs_alloc(sizeof(struct thread_pool));
+    memset(pool, 0u, sizeof(struct thread_pool));
+
+    pool->n_workers = n_workers;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    if (n_workers > 1u) {
+        pool->threads = cecs_alloc((n_workers - 1u) * sizeof(pthread_t));
+    }
+
+    for (size_t i = 0u; i + 1u < n_workers; ++i) {
+        struct helper_arg *helper = cecs_alloc(sizeof(struct helper_arg));
+        helper->pool   = pool;
+        helper->worker = i + 1u;
+
+        const int result = pthread_create(&pool->threads[i], NULL, helper_main, helper);
+        assert(result == 0 && "Failed to start worker thread");
+        (void)result;
+    }
+
+    return pool;
+}
+
+
+/** Return the number of workers to run with when none was requested */
+static size_t default_worker_count(void)
+{
+    const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return n_cpus > 0 ? (size_t)n_cpus : (size_t)1u;
+}
+
+
+/** Set the number of threads used to run parallel work */
+void cecs_set_worker_count(const size_t n_workers)
+{
+    pthread_mutex_lock(&g_pool_mutex);
+
+    g_requested_workers = n_workers;
+
+    /* The pool is restarted with the new size on its next use */
+    if (g_pool) {
+        stop_pool(g_pool);
+        g_pool = NULL;
+    }
+
+    pthread_mutex_unlock(&g_pool_mutex);
+}
+
+
+/** Get the number of threads used to run parallel work */
+size_t cecs_worker_count(void)
+{
+    return g_requested_workers > 0u ? g_requested_workers : default_worker_count();
+}
+
+
+/** Get the index of the worker the calling thread is running parallel work as */
+size_t cecs_current_worker(void)
+{
+    return tl_worker == SIZE_MAX ? (size_t)0u : tl_worker;
+}
+
+
+/** Run `n_tasks` tasks across the pool and return once all of them are done.
+ * Any number of threads may run jobs at once; idle helpers are shared between
+ * them. */
+static void run_on_pool(const size_t n_tasks, void (*run)(const size_t, const size_t, void *), void *ctx)
+{
+    pthread_mutex_lock(&g_pool_mutex);
+    if (!g_pool) {
+        g_pool = start_pool(cecs_worker_count());
+    }
+    struct thread_pool *pool = g_pool;
+    pthread_mutex_unlock(&g_pool_mutex);
+
+    const size_t n_workers = pool->n_workers;
+
+    /* Deal out the tasks in contiguous ranges so each worker starts on
+     * neighbouring chunks, and imbalance is fixed up by stealing */
+    assert(n_tasks <= (size_t)UINT32_MAX && "Too many tasks for one job");
+    struct job job = {
+        .run    = run,
+        .ctx    = ctx,
+        .ranges = cecs_alloc(n_workers * sizeof(struct worker_range)),
+    };
+    for (size_t w = 0u; w < n_workers; ++w) {
+        const size_t begin = (n_tasks * w) / n_workers;
+        const size_t end   = (n_tasks * (w + 1u)) / n_workers;
+        atomic_init(&job.ranges[w].range, RANGE_PACK(begin, end));
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    job.next   = pool->jobs;
+    pool->jobs = &job;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    /* The submitting thread works as worker 0 of its own job, and helpers are
+     * only ever in one job at a time, so worker indices are unique per job */
+    run_job(&job, 0u, n_workers);
+
+    pthread_mutex_lock(&pool->mutex);
+    job.exhausted = true;
+    while (job.n_helpers > 0u) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    struct job **link = &pool->jobs;
+    while (*link != &job) {
+        link = &(*link)->next;
+    }
+    *link = job.next;
+    pthread_mutex_unlock(&pool->mutex);
+
+    cecs_free(job.ranges);
+}
+
+
+/** Context for running a parallel query: the chunks to process and the
+ * callback to run on each */
+struct each_parallel_ctx {
+    const cecs_chunk_t *chunks;
+    cecs_chunk_fn fn;
+    void *ctx;
+};
+
+
+/** Run the user callback on one chunk */
+static void run_chunk_task(const size_t i_task, const size_t worker, void *ctx)
+{
+    const struct each_parallel_ctx *each = ctx;
+    each->fn(&each->chunks[i_task], worker, each->ctx);
+}
+
+
+/** Run a callback on every chunk matching a persistent query, spread across the
+ * worker threads. Returns once every chunk has been processed. */
+void cecs_query_each_parallel(const cecs_query_t *query, cecs_chunk_fn fn, void *ctx)
+{
+    /* Nested parallel calls from inside a callback run inline on the worker
+     * that made them, instead of waiting on the pool they're running on */
+    if (tl_worker != SIZE_MAX || cecs_worker_count() == 1u) {
+        const size_t worker = cecs_current_worker();
+        cecs_chunk_iter_t it;
+        cecs_chunk_t chunk;
+        cecs_query_iter_chunks(query, &it);
+        while (cecs_chunk_next(&it, &chunk)) {
+            fn(&chunk, worker, ctx);
+        }
+        return;
+    }
+
+    /* Gather the chunks up front so each one becomes an independent task.
+     * The vector belongs to this call, so queries on other worlds can run at
+     * the same time. */
+    struct chunk_vec chunks = { 0u };
+    cecs_chunk_iter_t it;
+    cecs_query_iter_chunks(query, &it);
+    for (;;) {
+        if (chunks.count == chunks.cap) {
+            chunks.cap    = chunks.cap == 0u ? CHUNKS_VEC_MIN_SIZE : chunks.cap * 2u;
+            chunks.chunks = cecs_realloc(chunks.chunks, chunks.cap * sizeof(cecs_chunk_t));
+        }
+        if (!cecs_chunk_next(&it, &chunks.chunks[chunks.count])) {
+            break;
+        }
+        ++chunks.count;
+    }
+
+    struct each_parallel_ctx each = { .chunks = chunks.chunks, .fn = fn, .ctx = ctx };
+    if (chunks.count > 0u) {
+        run_on_pool(chunks.count, run_chunk_task, &each);
+    }
+
+    cecs_free(chunks.chunks);
+}
+
+
+/** Number of 64-bit words in a component set */
+#define ACCESS_SET_WORDS ((size_t)CECS_MAX_COMPONENT_INDEX)
+
+/** Minimum number of elements allocated for the vector of systems */
+#define SYSTEMS_VEC_MIN_SIZE ((size_t)16u)
+
+/** Minimum number of elements allocated for a system's vector of dependents */
+#define DEPENDENTS_VEC_MIN_SIZE ((size_t)4u)
+
+
+/** Vector of system indices */
+struct system_index_vec {
+    size_t count;
+    size_t cap;
+    size_t *indices;
+};
+
+/** A registered system and the components it accesses */
+struct system {
+    cecs_system_fn fn;
+    void *ctx;
+    /** Bit set of the components the system reads */
+    uint64_t reads[ACCESS_SET_WORDS];
+    /** Bit set of the components the system writes */
+    uint64_t writes[ACCESS_SET_WORDS];
+    /** Number of earlier systems that must finish before this one starts */
+    size_t n_dependencies;
+    /** Later systems that wait on this one */
+    struct system_index_vec dependents;
+};
+
+/** Vector of systems, in registration order */
+struct system_vec {
+    size_t count;
+    size_t cap;
+    struct system *systems;
+};
+
+
+/** A system as seen by a frame */
+struct frame_system {
+    cecs_system_fn fn;
+    void *ctx;
+    size_t n_dependencies;
+    /** Later systems that wait on this one, in the frame's `dependents` */
+    size_t n_dependents;
+    const size_t *dependents;
+};
+
+
+/** State of the frame being run by cecs_progress(). Systems become ready once
+ * every system they depend on has finished, and any worker may pick them up. */
+struct frame {
+    cecs_world_t *world;
+    /** Copy of the systems registered when the frame started, so the frame
+     * runs without holding the registry lock */
+    struct frame_system *systems;
+    size_t n_systems;
+    /** Storage for the systems' dependents */
+    size_t *dependents;
+    /** Number of dependencies of each system that haven't finished yet */
+    size_t *n_waiting;
+    /** Queue of systems ready to run; each system is pushed exactly once */
+    size_t *ready;
+    size_t ready_head;
+    size_t ready_tail;
+    /** Number of systems that have finished */
+    size_t n_done;
+    /** Protects the frame's progress */
+    pthread_mutex_t mutex;
+    /** Signalled when a system becomes ready or the frame is done */
+    pthread_cond_t cond;
+};
+
+
+/** The registered systems */
+static struct system_vec g_systems = { 0u };
+
+/** Held for writing while systems are registered, and for reading while a
+ * frame copies them */
+static pthread_rwlock_t g_systems_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+/** Read a component count and that many component IDs from the argument list
+ * into a bit set */
+static void read_access_set(uint64_t *set, va_list *args)
+{
+    const cecs_component_t n = va_arg(*args, cecs_component_t);
+    for (cecs_component_t i = 0u; i < n; ++i) {
+        const cecs_component_t id = va_arg(*args, cecs_component_t);
+        assert(id <= CECS_MAX_COMPONENT && "Component ID out of range");
+        set[CECS_COMPONENT_TO_INDEX(id)] |= (uint64_t)1u << (id % 64u);
+    }
+}
+
+
+/** Returns true if the two bit sets share a component */
+static bool access_sets_intersect(const uint64_t *a, const uint64_t *b)
+{
+    for (size_t i = 0u; i < ACCESS_SET_WORDS; ++i) {
+        if (a[i] & b[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** Returns true if the two systems can't run at the same time, i.e. one of
+ * them writes a component the other reads or writes */
+static bool systems_conflict(const struct system *a, const struct system *b)
+{
+    return access_sets_intersect(a->writes, b->writes) ||
+           access_sets_intersect(a->writes, b->reads) ||
+           access_sets_intersect(a->reads, b->writes);
+}
+
+
+/** Register a system with the components it reads and writes */
+size_t _cecs_system_register(cecs_system_fn fn, void *ctx, ...)
+{
+    pthread_rwlock_wrlock(&g_systems_lock);
+
+    if (g_systems.count == g_systems.cap) {
+        g_systems.cap     = g_systems.cap == 0u ? SYSTEMS_VEC_MIN_SIZE : g_systems.cap * 2u;
+        g_systems.systems = cecs_realloc(g_systems.systems, g_systems.cap * sizeof(struct system));
+    }
+
+    const size_t i_system  = g_systems.count++;
+    struct system *system = &g_systems.systems[i_system];
+    memset(system, 0, sizeof(struct system));
+    system->fn  = fn;
+    system->ctx = ctx;
+
+    va_list args;
+    va_start(args, ctx);
+    read_access_set(system->reads, &args);
+    read_access_set(system->writes, &args);
+    va_end(args);
+
+    /* Systems run in registration order wherever they conflict, so each one
+     * depends on every earlier system it conflicts with */
+    for (size_t i = 0u; i < i_system; ++i) {
+        struct system *earlier = &g_systems.systems[i];
+        if (!systems_conflict(earlier, system)) {
+            continue;
+        }
+
+        struct system_index_vec *dependents = &earlier->dependents;
+        if (dependents->count == dependents->cap) {
+            dependents->cap = dependents->cap == 0u ? DEPENDENTS_VEC_MIN_SIZE : dependents->cap * 2u;
+            dependents->indices =
+                cecs_realloc(dependents->indices, dependents->cap * sizeof(size_t));
+        }
+        dependents->indices[dependents->count++] = i_system;
+        ++system->n_dependencies;
+    }
+
+    pthread_rwlock_unlock(&g_systems_lock);
+
+    return i_system;
+}
+
+
+/** Run ready systems of the frame until every system has finished */
+static void run_frame_task(const size_t i_task, const size_t worker, void *ctx)
+{
+    struct frame *frame = ctx;
+    (void)i_task;
+    (void)worker;
+
+    pthread_mutex_lock(&frame->mutex);
+    for (;;) {
+        while (frame->ready_head == frame->ready_tail && frame->n_done < frame->n_systems) {
+            pthread_cond_wait(&frame->cond, &frame->mutex);
+        }
+        if (frame->ready_head == frame->ready_tail) {
+            break;
+        }
+
+        const struct frame_system *system = &frame->systems[frame->ready[frame->ready_head++]];
+        pthread_mutex_unlock(&frame->mutex);
+
+        system->fn(frame->world, system->ctx);
+
+        pthread_mutex_lock(&frame->mutex);
+        ++frame->n_done;
+
+        bool wake = frame->n_done == frame->n_systems;
+        for (size_t i = 0u; i < system->n_dependents; ++i) {
+            const size_t dependent = system->dependents[i];
+            if (--frame->n_waiting[dependent] == 0u) {
+                frame->ready[frame->ready_tail++] = dependent;
+                wake                              = true;
+            }
+        }
+        if (wake) {
+            pthread_cond_broadcast(&frame->cond);
+        }
+    }
+    pthread_mutex_unlock(&frame->mutex);
+}
+
+
+/** Copy the registered systems into the given frame */
+static void copy_systems(struct frame *frame)
+{
+    pthread_rwlock_rdlock(&g_systems_lock);
+
+    size_t n_dependents = 0u;
+    for (size_t i = 0u; i < g_systems.count; ++i) {
+        n_dependents += g_systems.systems[i].dependents.count;
+    }
+
+    frame->n_systems  = g_systems.count;
+    frame->systems    = cecs_alloc((g_systems.count + 1u) * sizeof(struct frame_system));
+    frame->dependents = cecs_alloc((n_dependents + 1u) * sizeof(size_t));
+
+    size_t *dependents = frame->dependents;
+    for (size_t i = 0u; i < g_systems.count; ++i) {
+        const struct system *system = &g_systems.systems[i];
+        frame->systems[i]           = (struct frame_system){
+            .fn             = system->fn,
+            .ctx            = system->ctx,
+            .n_dependencies = system->n_dependencies,
+            .n_dependents   = system->dependents.count,
+            .dependents     = dependents,
+        };
+        if (system->dependents.count > 0u) {
+            memcpy(dependents, system->dependents.indices, system->dependents.count * sizeof(size_t));
+            dependents += system->dependents.count;
+        }
+    }
+
+    pthread_rwlock_unlock(&g_systems_lock);
+}
+
+
+/** Run every registered system once against the given world */
+void cecs_progress(cecs_world_t *world)
+{
+    /* Writes made during the frame are stamped with a tick of their own, and
+     * the last frame's temporaries are released */
+    cecs_world_advance_tick(world);
+    cecs_frame_reset(world);
+
+    /* Systems registered by a running system join from the next frame */
+    struct frame frame = { .world = world };
+    copy_systems(&frame);
+
+    /* Registration order never runs a system before one it depends on, so it
+     * is used directly when there is nothing to run in parallel */
+    if (tl_worker != SIZE_MAX || cecs_worker_count() == 1u) {
+        for (size_t i = 0u; i < frame.n_systems; ++i) {
+            frame.systems[i].fn(world, frame.systems[i].ctx);
+        }
+    } else if (frame.n_systems > 0u) {
+        /* The frame's state belongs to this call, so frames of different
+         * worlds share nothing but the pool */
+        frame.n_waiting = cecs_alloc(frame.n_systems * sizeof(size_t));
+        frame.ready     = cecs_alloc(frame.n_systems * sizeof(size_t));
+        pthread_mutex_init(&frame.mutex, NULL);
+        pthread_cond_init(&frame.cond, NULL);
+
+        for (size_t i = 0u; i < frame.n_systems; ++i) {
+            frame.n_waiting[i] = frame.systems[i].n_dependencies;
+            if (frame.n_waiting[i] == 0u) {
+                frame.ready[frame.ready_tail++] = i;
+            }
+        }
+
+        /* Every worker runs the same loop, picking up systems as they become
+         * ready */
+        run_on_pool(cecs_worker_count(), run_frame_task, &frame);
+
+        pthread_cond_destroy(&frame.cond);
+        pthread_mutex_destroy(&frame.mutex);
+        cecs_free(frame.ready);
+        cecs_free(frame.n_waiting);
+    }
+
+    cecs_free(frame.dependents);
+    cecs_free(frame.systems);
+}
+
+
+/** Stop the worker threads and unregister every system */
+void cecs_parallel_shutdown(void)
+{
+    pthread_mutex_lock(&g_pool_mutex);
+    if (g_pool) {
+        stop_pool(g_pool);
+        g_pool = NULL;
+    }
+    pthread_mutex_unlock(&g_pool_mutex);
+
+    pthread_rwlock_wrlock(&g_systems_lock);
+    for (size_t i = 0u; i < g_systems.count; ++i) {
+        cecs_free(g_systems.systems[i].dependents.indices);
+    }
+    cecs_free(g_systems.systems);
+    memset(&g_systems, 0u, sizeof(g_systems));
+    pthread_rwlock_unlock(&g_systems_lock);
+}
@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +32,15 @@ CECS_COMPONENT_DEF(has_health_t);
 CECS_COMPONENT_DEF(is_alive_t);
 
 
+/* A persistent query keeps track of the archetypes it matches as they are
+created, so systems that run every frame don't have to search for them. */
+cecs_query_t *g_movers = NULL;
+
+/* A command buffer defers structural changes made while iterating, so the
+tables being iterated aren't rearranged underneath the iterator. */
+cecs_cmd_buffer_t *g_commands = NULL;
+
+
 void move_system()
 {
     /* An entity set iterator allows you to iterate over all the entities that
@@ -40,52 +50,65 @@ void move_system()
 
     cecs_query(&it, is_alive_t, has_health_t);
     while ((entity = cecs_iter_next(&it))) {
+        /* Getting the component data for a given entity,component pair allows
+        you to update it in-situ */
         has_health_t *health = cecs_get(entity, has_health_t);
 
         health->hp -= 10;
         if (health->hp <= 0) {
-            cecs_remove(entity, is_alive_t);
+            cecs_cmd_remove(g_commands, entity, is_alive_t);
         }
-        printf("[alive, health] %llu = %d\n", entity, health->hp);
+        printf("[alive, health] %" PRIu64 " = %d\n", entity, health->hp);
     }
 
+    /* Apply the deferred changes now that iteration is done */
+    cecs_cmd_buffer_apply(cecs_default_world(), g_commands);
+
     cecs_query(&it, has_velocity_t);
     while ((entity = cecs_iter_next(&it))) {
-        printf("[velocity] %llu\n", entity);
+        printf("[velocity] %" PRIu64 "\n", entity);
     }
 
     cecs_query(&it, has_position_t);
     while ((entity = cecs_iter_next(&it))) {
-        printf("[position] %llu\n", entity);
+        printf("[position] %" PRIu64 "\n", entity);
     }
 
     cecs_query(&it, has_position_t, has_velocity_t);
     while ((entity = cecs_iter_next(&it))) {
-        printf("[position, velocity] %llu\n", entity);
+        printf("[position, velocity] %" PRIu64 "\n", entity);
     }
 
-    cecs_query(&it, has_velocity_t, has_position_t, has_health_t);
-    while ((entity = cecs_iter_next(&it))) {
-        /* Getting the component data for a given entity,component pair allows
-        you to update it in-situ */
-        has_position_t *pos  = cecs_get(entity, has_position_t);
-        has_velocity_t *vel  = cecs_get(entity, has_velocity_t);
-        has_health_t *health = cecs_get(entity, has_health_t);
-
-        printf("[position, velocity, health] %llu\n", entity);
-
-        printf(
-            "Position: %f,%f     velocity: %f,%f,    health: %u\n",
-            pos->x,
-            pos->y,
-            vel->x,
-            vel->y,
-            health->hp
-        );
+    /* A chunk iterator yields blocks of entities of the same archetype, with
+    each component's data laid out as a packed array. Systems can then update
+    many entities in a tight loop. */
+    cecs_chunk_iter_t chunks;
+    cecs_chunk_t chunk;
+
+    cecs_query_iter_chunks(g_movers, &chunks);
+    while (cecs_chunk_next(&chunks, &chunk)) {
+        has_position_t *pos  = cecs_chunk_column(&chunk, has_position_t);
+        has_velocity_t *vel  = cecs_chunk_column(&chunk, has_velocity_t);
+        has_health_t *health = cecs_chunk_column(&chunk, has_health_t);
+
+        for (size_t i = 0; i < chunk.count; ++i) {
+            printf("[position, velocity, health] %" PRIu64 "\n", chunk.entities[i]);
+
+            printf(
+                "Position: %f,%f     velocity: %f,%f,    health: %u\n",
+                pos[i].x,
+                pos[i].y,
+                vel[i].x,
+                vel[i].y,
+                health[i].hp
+            );
+        }
 
         /* The "move" system updates position based on velocity. */
-        pos->x += vel->x;
-        pos->y += vel->y;
+        for (size_t i = 0; i < chunk.count; ++i) {
+            pos[i].x += vel[i].x;
+            pos[i].y += vel[i].y;
+        }
     }
 }
 
@@ -106,6 +129,9 @@ int main()
     CECS_COMPONENT(has_health_t);
     CECS_COMPONENT(is_alive_t);
 
+    g_movers   = cecs_query_create(has_velocity_t, has_position_t, has_health_t);
+    g_commands = cecs_cmd_buffer_create();
+
     /* Create dummy data to populate entity's components with */
     has_position_t position = { .x = 0.0f, .y = 0.0f };
     has_velocity_t velocity = { .x = 1.0f, .y = 1.0f };
@@ -0,0 +1,19 @@
+#ifndef __CECS_TEST_H__
+#define __CECS_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/** Fail the test with the location of the failed check. Unlike assert(), this
+ * isn't compiled out in release builds. */
+#define CHECK(condition)                                                      \
+    do {                                                                      \
+        if (!(condition)) {                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                    #condition);                                              \
+            exit(EXIT_FAILURE);                                               \
+        }                                                                     \
+    } while (0)
+
+#endif /* __CECS_TEST_H__ */
@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+
+#define N_ENTITIES 5000u
+#define N_QUERIES 200u
+
+/** Number of frame arena allocations made in a frame, spilling over the
+ * arena's first block */
+#define N_FRAME_ALLOCS 4000u
+
+/** Header placed before every block handed out, so blocks the hooks didn't
+ * allocate are caught when they come back */
+#define HEADER_SIZE ((size_t)16u)
+#define MAGIC ((uint64_t)0xCEC5A110CA7Eu)
+
+
+/** What the counting allocator has handed out */
+struct counts {
+    size_t n_calls;
+    size_t n_live;
+};
+
+
+static void *counting_alloc(const size_t size, void *ctx)
+{
+    struct counts *counts = ctx;
+    ++counts->n_calls;
+    ++counts->n_live;
+
+    uint8_t *block = malloc(HEADER_SIZE + size);
+    CHECK(block != NULL);
+    const uint64_t magic = MAGIC;
+    memcpy(block, &magic, sizeof(magic));
+
+    return block + HEADER_SIZE;
+}
+
+
+/** Get the start of a block handed out by the counting allocator, checking
+ * that it was */
+static uint8_t *get_block(void *ptr)
+{
+    uint8_t *block = (uint8_t *)ptr - HEADER_SIZE;
+    uint64_t magic;
+    memcpy(&magic, block, sizeof(magic));
+    CHECK(magic == MAGIC);
+
+    return block;
+}
+
+
+static void *counting_realloc(void *ptr, const size_t size, void *ctx)
+{
+    if (!ptr) {
+        return counting_alloc(size, ctx);
+    }
+
+    struct counts *counts = ctx;
+    ++counts->n_calls;
+
+    uint8_t *block = realloc(get_block(ptr), HEADER_SIZE + size);
+    CHECK(block != NULL);
+
+    return block + HEADER_SIZE;
+}
+
+
+static void counting_free(void *ptr, void *ctx)
+{
+    struct counts *counts = ctx;
+    ++counts->n_calls;
+    --counts->n_live;
+
+    uint8_t *block = get_block(ptr);
+    memset(block, 0u, sizeof(uint64_t));
+    free(block);
+}
+
+
+/** Allocate a frame's worth of temporaries, checking their alignment and that
+ * they don't overlap */
+static void fill_frame(cecs_world_t *world)
+{
+    uint8_t *last = NULL;
+    for (size_t i = 0u; i < N_FRAME_ALLOCS; ++i) {
+        uint8_t *ptr = cecs_frame_alloc(world, 24u);
+        CHECK((uintptr_t)ptr % 16u == 0u);
+        CHECK(!last || ptr >= last + 24u || ptr + 24u <= last);
+        memset(ptr, 0xAB, 24u);
+        last = ptr;
+    }
+}
+
+
+int main(void)
+{
+    /* The hooks must be set before anything is allocated */
+    struct counts counts = { 0u };
+    const cecs_allocator_t allocator = {
+        .alloc = counting_alloc, .realloc = counting_realloc, .free = counting_free, .ctx = &counts
+    };
+    cecs_set_allocator(&allocator);
+
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    const size_t n_registered = counts.n_live;
+
+    /* Everything a world does goes through the hooks */
+    cecs_world_t *world = cecs_world_create();
+    static cecs_entity_t entities[N_ENTITIES];
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        entities[i] = cecs_create_in(world, has_position_t);
+        if (i % 2u == 0u) {
+            cecs_add_in(world, entities[i], has_health_t);
+        }
+    }
+    for (uint32_t i = 0u; i < N_ENTITIES; i += 3u) {
+        CHECK(cecs_destroy_in(world, entities[i]));
+    }
+    CHECK(counts.n_calls > 0u);
+
+    /* The frame arena settles on one block, after which a frame of
+     * temporaries makes no allocator calls */
+    fill_frame(world);
+    cecs_frame_reset(world);
+    fill_frame(world);
+    cecs_frame_reset(world);
+
+    const size_t n_calls = counts.n_calls;
+    fill_frame(world);
+    cecs_frame_reset(world);
+    CHECK(counts.n_calls == n_calls);
+
+    /* Queries come from a pool, which reuses destroyed ones rather than
+     * growing */
+    static cecs_query_t *queries[N_QUERIES];
+    cecs_memory_stats_t first;
+    for (size_t round = 0u; round < 3u; ++round) {
+        for (size_t i = 0u; i < N_QUERIES; ++i) {
+            queries[i] = cecs_query_create_in(world, has_position_t);
+        }
+        for (size_t i = 0u; i < N_QUERIES; ++i) {
+            cecs_query_destroy(queries[i]);
+        }
+
+        cecs_memory_stats_t stats;
+        cecs_memory_stats(world, &stats);
+        if (round == 0u) {
+            first = stats;
+        }
+        CHECK(stats.pools.allocated == first.pools.allocated);
+    }
+
+    /* Everything is freed through the hooks once the world is destroyed and
+     * the library shut down, except the component registrations */
+    cecs_world_destroy(world);
+    cecs_shutdown();
+    CHECK(counts.n_live == n_registered);
+
+    cecs_set_allocator(NULL);
+
+    return EXIT_SUCCESS;
+}
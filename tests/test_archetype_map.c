@@ -0,0 +1,80 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+/** Number of components, every combination of which gets an archetype */
+#define N_COMPONENTS 12u
+#define N_SUBSETS (1u << N_COMPONENTS)
+
+
+static const char *const g_names[N_COMPONENTS] = {
+    "c0", "c1", "c2", "c3", "c4", "c5", "c6", "c7", "c8", "c9", "c10", "c11",
+};
+
+static cecs_component_t g_ids[N_COMPONENTS];
+static cecs_entity_t g_entities[N_SUBSETS];
+
+
+/** Create an entity with the components whose bits are set in `subset` */
+static cecs_entity_t create_subset(cecs_world_t *world, const uint32_t subset)
+{
+    const cecs_entity_t entity = _cecs_create(world, 0u);
+    for (uint32_t i = 0u; i < N_COMPONENTS; ++i) {
+        if (subset & (1u << i)) {
+            _cecs_add(world, entity, 1u, g_ids[i]);
+        }
+    }
+
+    return entity;
+}
+
+
+int main(void)
+{
+    /* Low, adjacent component IDs, whose signatures differ only in a few low
+     * bits */
+    for (uint32_t i = 0u; i < N_COMPONENTS; ++i) {
+        g_ids[i] = CECS_NEXT_COMPONENT_ID++;
+        cecs_register_component(g_ids[i], sizeof(int32_t), g_names[i]);
+    }
+
+    cecs_world_t *world = cecs_world_create();
+    for (uint32_t subset = 0u; subset < N_SUBSETS; ++subset) {
+        g_entities[subset] = create_subset(world, subset);
+    }
+
+    /* The map grew to hold an archetype per combination, and lookups stay
+     * short */
+    cecs_map_stats_t stats;
+    cecs_archetype_map_stats(world, &stats);
+    CHECK(stats.count >= N_SUBSETS);
+    CHECK(stats.count < stats.capacity);
+    CHECK(stats.total_probes <= 2u * stats.count);
+    CHECK(stats.max_probe <= 32u);
+
+    /* Every entity found its own archetype */
+    for (uint32_t subset = 0u; subset < N_SUBSETS; ++subset) {
+        for (uint32_t i = 0u; i < N_COMPONENTS; ++i) {
+            CHECK(_cecs_has(world, g_entities[subset], g_ids[i]) == ((subset & (1u << i)) != 0u));
+        }
+    }
+
+    /* Entities with the same components land in the existing archetypes */
+    for (uint32_t subset = 0u; subset < N_SUBSETS; ++subset) {
+        const cecs_entity_t entity = create_subset(world, subset);
+        for (uint32_t i = 0u; i < N_COMPONENTS; ++i) {
+            CHECK(_cecs_has(world, entity, g_ids[i]) == ((subset & (1u << i)) != 0u));
+        }
+    }
+    cecs_map_stats_t again;
+    cecs_archetype_map_stats(world, &again);
+    CHECK(again.count == stats.count);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+#define N_EACH 1500u
+
+
+static cecs_entity_t g_positioned[N_EACH];
+static cecs_entity_t g_armoured[N_EACH];
+static cecs_entity_t g_healthy[N_EACH];
+
+
+/** Check that the entities with a position still have their data */
+static void check_data(cecs_world_t *world)
+{
+    for (uint32_t i = 0u; i < N_EACH; ++i) {
+        CHECK(cecs_get_const_in(world, g_positioned[i], has_position_t)->x == (int32_t)i);
+        CHECK(cecs_get_const_in(world, g_armoured[i], has_position_t)->y == (int32_t)i);
+    }
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    cecs_world_t *world = cecs_world_create();
+    for (uint32_t i = 0u; i < N_EACH; ++i) {
+        g_positioned[i] = cecs_create_in(world, has_position_t);
+        g_armoured[i]   = cecs_create_in(world, has_position_t, has_health_t);
+        g_healthy[i]    = cecs_create_in(world, has_health_t);
+        *cecs_get_in(world, g_positioned[i], has_position_t) = (has_position_t){(int32_t)i, 0};
+        *cecs_get_in(world, g_armoured[i], has_position_t)   = (has_position_t){0, (int32_t)i};
+        cecs_get_in(world, g_armoured[i], has_health_t)->points = (int32_t)i;
+    }
+    /* One destination table already has rows, which the moved ones join */
+    const cecs_entity_t settled = cecs_create_in(world, has_position_t, is_alive_t);
+
+    cecs_query_t *positioned = cecs_query_create_in(world, has_position_t);
+    cecs_query_t *healthy    = cecs_query_create_in(world, has_health_t);
+    cecs_query_t *alive      = cecs_query_create_in(world, is_alive_t);
+
+    /* Adding moves every matching entity, except those that already have the
+     * component */
+    CHECK(cecs_query_add(positioned, is_alive_t) == 2u * N_EACH);
+    CHECK(cecs_query_count(alive) == 2u * N_EACH + 1u);
+    for (uint32_t i = 0u; i < N_EACH; ++i) {
+        CHECK(cecs_has_in(world, g_positioned[i], is_alive_t));
+        CHECK(cecs_has_in(world, g_armoured[i], is_alive_t));
+        CHECK(!cecs_has_in(world, g_healthy[i], is_alive_t));
+    }
+    CHECK(cecs_has_in(world, settled, is_alive_t));
+    check_data(world);
+
+    /* Adding again changes nothing */
+    CHECK(cecs_query_add(positioned, is_alive_t) == 0u);
+
+    /* Removing keeps the other components' data */
+    CHECK(cecs_query_remove(alive, has_health_t) == N_EACH);
+    CHECK(cecs_query_count(healthy) == N_EACH);
+    for (uint32_t i = 0u; i < N_EACH; ++i) {
+        CHECK(!cecs_has_in(world, g_armoured[i], has_health_t));
+        CHECK(cecs_has_in(world, g_healthy[i], has_health_t));
+    }
+    check_data(world);
+
+    /* Destroying empties the matched tables and leaves the rest alone */
+    CHECK(cecs_query_destroy_entities(healthy) == N_EACH);
+    CHECK(cecs_query_count(healthy) == 0u);
+    for (uint32_t i = 0u; i < N_EACH; ++i) {
+        CHECK(!cecs_is_alive_in(world, g_healthy[i]));
+    }
+    check_data(world);
+    CHECK(cecs_query_count(positioned) == 2u * N_EACH + 1u);
+
+    /* The destroyed slots are reused like any other */
+    const cecs_entity_t created = cecs_create_in(world, has_health_t);
+    CHECK(cecs_is_alive_in(world, created));
+    CHECK(cecs_query_count(healthy) == 1u);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
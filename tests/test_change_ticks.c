@@ -0,0 +1,164 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    float x, y;
+} has_position_t, has_velocity_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_velocity_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_velocity_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+
+/** Count the entities yielded by an iterator */
+static size_t count_iter(cecs_iter_t *it)
+{
+    size_t count = 0u;
+    while (cecs_iter_next(it)) {
+        ++count;
+    }
+
+    return count;
+}
+
+
+/** Count the rows of the chunks of the query where the component was written
+ * at or after `since`. Chunks are counted rather than entities, since entity
+ * iterators skip rows with disabled components. */
+static size_t count_changed(const cecs_query_t *query, const cecs_component_t id, const cecs_tick_t since)
+{
+    cecs_chunk_iter_t it;
+    cecs_chunk_t chunk;
+    _cecs_query_iter_chunks_changed(query, &it, id, since);
+
+    size_t count = 0u;
+    while (cecs_chunk_next(&it, &chunk)) {
+        count += chunk.count;
+    }
+
+    return count;
+}
+
+
+/** Count the entities the query finds in chunks with rows added at or after
+ * `since` */
+static size_t count_added(const cecs_query_t *query, const cecs_tick_t since)
+{
+    cecs_iter_t it;
+    cecs_query_iter_added(query, &it, since);
+    return count_iter(&it);
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_velocity_t);
+    CECS_COMPONENT(is_alive_t);
+
+    cecs_world_t *world   = cecs_world_create();
+    cecs_query_t *movers  = cecs_query_create_in(world, has_position_t);
+    const cecs_component_t position = CECS_ID_OF(has_position_t);
+    const cecs_component_t velocity = CECS_ID_OF(has_velocity_t);
+
+    /* Adding an entity stamps its chunk as added and its columns as written */
+    const cecs_tick_t t0 = cecs_world_tick(world);
+    CHECK(t0 > 0u);
+    cecs_entity_t entity = cecs_create_in(world, has_position_t);
+    CHECK(count_added(movers, t0) == 1u);
+    CHECK(count_changed(movers, position, t0) == 1u);
+
+    /* Nothing happens at a later tick until something is written */
+    const cecs_tick_t t1 = cecs_world_advance_tick(world);
+    CHECK(t1 == t0 + 1u);
+    CHECK(count_added(movers, t1) == 0u);
+    CHECK(count_changed(movers, position, t1) == 0u);
+
+    /* Reading through the const accessor isn't a write */
+    CHECK(cecs_get_const_in(world, entity, has_position_t) != NULL);
+    CHECK(count_changed(movers, position, t1) == 0u);
+
+    /* Setting the component is a write, but not an addition */
+    has_position_t position_value = { .x = 1.0f, .y = 2.0f };
+    CHECK(cecs_set_in(world, entity, has_position_t, &position_value));
+    CHECK(count_changed(movers, position, t1) == 1u);
+    CHECK(count_added(movers, t1) == 0u);
+
+    /* So is taking a mutable pointer */
+    const cecs_tick_t t2 = cecs_world_advance_tick(world);
+    cecs_get_in(world, entity, has_position_t)->x = 3.0f;
+    CHECK(count_changed(movers, position, t2) == 1u);
+
+    /* Toggling the component counts as writing it */
+    const cecs_tick_t t3 = cecs_world_advance_tick(world);
+    CHECK(cecs_disable_in(world, entity, has_position_t));
+    CHECK(count_changed(movers, position, t3) == 1u);
+    const cecs_tick_t t4 = cecs_world_advance_tick(world);
+    CHECK(count_changed(movers, position, t4) == 0u);
+    CHECK(cecs_enable_in(world, entity, has_position_t));
+    CHECK(count_changed(movers, position, t4) == 1u);
+
+    /* The entity iterator agrees with the chunks once the entity is enabled */
+    cecs_iter_t it;
+    _cecs_query_iter_changed(movers, &it, position, t4);
+    CHECK(cecs_iter_next(&it) == entity && !cecs_iter_next(&it));
+
+    /* Moving into another archetype counts as an addition there */
+    const cecs_tick_t t5 = cecs_world_advance_tick(world);
+    cecs_add_in(world, entity, has_velocity_t);
+    CHECK(count_added(movers, t5) == 1u);
+    CHECK(count_changed(movers, velocity, t5) == 1u);
+
+    /* A changed filter on an optional component skips the archetypes that lack
+     * it, even those with rows added since */
+    cecs_query_t *optional = cecs_query_create_terms_in(
+        world,
+        cecs_with(has_position_t),
+        cecs_no_components(),
+        cecs_optional(has_velocity_t),
+        cecs_no_components()
+    );
+    const cecs_tick_t t6 = cecs_world_advance_tick(world);
+    cecs_entity_t still = cecs_create_in(world, has_position_t);
+    CHECK(count_added(optional, t6) == 1u);
+    CHECK(count_changed(optional, position, t6) == 1u);
+    CHECK(count_changed(optional, velocity, t6) == 0u);
+
+    has_velocity_t velocity_value = { .x = 1.0f, .y = 1.0f };
+    CHECK(cecs_set_in(world, entity, has_velocity_t, &velocity_value));
+    CHECK(count_changed(optional, velocity, t6) == 1u);
+
+    cecs_chunk_iter_t chunks;
+    cecs_chunk_t chunk;
+    _cecs_query_iter_chunks_changed(optional, &chunks, velocity, t6);
+    size_t n_chunks = 0u;
+    while (cecs_chunk_next(&chunks, &chunk)) {
+        CHECK(cecs_chunk_column(&chunk, has_velocity_t) != NULL);
+        CHECK(chunk.count == 1u && chunk.entities[0] == entity);
+        ++n_chunks;
+    }
+    CHECK(n_chunks == 1u);
+
+    /* Tags hold no data, so they count as written when added */
+    cecs_query_t *alive = cecs_query_create_in(world, is_alive_t);
+    const cecs_tick_t t7 = cecs_world_advance_tick(world);
+    CHECK(count_changed(alive, CECS_ID_OF(is_alive_t), t7) == 0u);
+    cecs_add_in(world, still, is_alive_t);
+    CHECK(count_changed(alive, CECS_ID_OF(is_alive_t), t7) == 1u);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+
+/** Count the entities destroyed in the world at or after the given tick */
+static size_t count_destroyed(cecs_world_t *world, const cecs_tick_t since)
+{
+    cecs_removed_iter_t it;
+    cecs_query_destroyed(world, &it, since);
+
+    size_t count = 0u;
+    while (cecs_removed_next(&it) != CECS_ENTITY_INVALID) {
+        ++count;
+    }
+
+    return count;
+}
+
+
+/** Count the live entities in the world with no components */
+static size_t count_empty(cecs_world_t *world)
+{
+    cecs_query_t *query = cecs_query_create_terms_in(world, cecs_no_components(), cecs_without(has_position_t, has_health_t, is_alive_t),
+                                                     cecs_no_components(), cecs_no_components());
+    const size_t count  = cecs_query_count(query);
+    cecs_query_destroy(query);
+
+    return count;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    cecs_world_t *world = cecs_world_create();
+    cecs_track_destroyed(world);
+    cecs_cmd_buffer_t *buffer = cecs_cmd_buffer_create();
+
+    /* Applying an empty buffer does nothing */
+    cecs_cmd_buffer_apply(world, buffer);
+
+    const cecs_entity_t existing = cecs_create_in(world, has_position_t);
+    *cecs_get_in(world, existing, has_position_t) = (has_position_t){1, 2};
+
+    /* Adding then removing a component leaves the entity where it was */
+    cecs_cmd_add(buffer, existing, has_health_t);
+    cecs_cmd_remove(buffer, existing, has_health_t);
+    cecs_cmd_buffer_apply(world, buffer);
+    CHECK(!cecs_has_in(world, existing, has_health_t));
+    CHECK(cecs_get_const_in(world, existing, has_position_t)->x == 1);
+
+    /* A set recorded after an add writes the added component */
+    const has_health_t health = {42};
+    cecs_cmd_add(buffer, existing, has_health_t);
+    cecs_cmd_set(buffer, existing, has_health_t, &health);
+    cecs_cmd_buffer_apply(world, buffer);
+    CHECK(cecs_get_const_in(world, existing, has_health_t)->points == 42);
+    CHECK(cecs_get_const_in(world, existing, has_position_t)->y == 2);
+
+    /* A destroy wins over every other command on the entity, whatever the
+     * order */
+    cecs_cmd_add(buffer, existing, is_alive_t);
+    cecs_cmd_destroy(buffer, existing);
+    cecs_cmd_set(buffer, existing, has_health_t, &health);
+    cecs_cmd_remove(buffer, existing, has_position_t);
+    cecs_cmd_buffer_apply(world, buffer);
+    CHECK(!cecs_is_alive_in(world, existing));
+
+    /* A placeholder resolves to the entity created for it, which has the data
+     * set through the placeholder */
+    const has_position_t position = {5, 6};
+    const cecs_entity_t placeholder = cecs_cmd_create(buffer, has_position_t);
+    cecs_cmd_add(buffer, placeholder, is_alive_t);
+    cecs_cmd_set(buffer, placeholder, has_position_t, &position);
+    CHECK(cecs_cmd_buffer_resolve(buffer, placeholder) == CECS_ENTITY_INVALID);
+    cecs_cmd_buffer_apply(world, buffer);
+
+    const cecs_entity_t created = cecs_cmd_buffer_resolve(buffer, placeholder);
+    CHECK(created != CECS_ENTITY_INVALID && cecs_is_alive_in(world, created));
+    CHECK(cecs_has_in(world, created, is_alive_t));
+    CHECK(cecs_get_const_in(world, created, has_position_t)->x == 5);
+    CHECK(cecs_get_const_in(world, created, has_position_t)->y == 6);
+    CHECK(cecs_cmd_buffer_resolve(buffer, created) == created);
+
+    /* An entity created and destroyed in one batch is never made, so it isn't
+     * logged as destroyed and leaves no empty entity behind */
+    cecs_world_advance_tick(world);
+    const cecs_tick_t since = cecs_world_tick(world);
+    const cecs_entity_t doomed = cecs_cmd_create(buffer, has_position_t);
+    cecs_cmd_set(buffer, doomed, has_position_t, &position);
+    cecs_cmd_destroy(buffer, doomed);
+    const cecs_entity_t kept = cecs_cmd_create(buffer, has_health_t);
+    cecs_cmd_buffer_apply(world, buffer);
+
+    CHECK(cecs_cmd_buffer_resolve(buffer, doomed) == CECS_ENTITY_INVALID);
+    CHECK(cecs_is_alive_in(world, cecs_cmd_buffer_resolve(buffer, kept)));
+    CHECK(count_destroyed(world, since) == 0u);
+    CHECK(count_empty(world) == 0u);
+
+    /* The next command starts a new batch, whose placeholders start over */
+    const cecs_entity_t next = cecs_cmd_create(buffer, has_health_t);
+    CHECK(next == placeholder);
+    CHECK(cecs_cmd_buffer_resolve(buffer, next) == CECS_ENTITY_INVALID);
+    cecs_cmd_buffer_apply(world, buffer);
+    CHECK(cecs_is_alive_in(world, cecs_cmd_buffer_resolve(buffer, next)));
+
+    cecs_cmd_buffer_destroy(buffer);
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+#define N_ENTITIES 40000u
+
+/** Every KEPT_EVERY-th entity survives the purge */
+#define KEPT_EVERY 100u
+
+
+static cecs_entity_t g_entities[N_ENTITIES];
+
+
+/** Check that every surviving entity is reachable by its handle and still has
+ * its data */
+static void check_survivors(cecs_world_t *world)
+{
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        if (i % KEPT_EVERY != 0u) {
+            CHECK(!cecs_is_alive_in(world, g_entities[i]));
+            continue;
+        }
+
+        CHECK(cecs_is_alive_in(world, g_entities[i]));
+        const has_position_t *position = cecs_get_const_in(world, g_entities[i], has_position_t);
+        CHECK(position != NULL && position->x == (int32_t)i && position->y == -(int32_t)i);
+        if (i % 2u == 0u) {
+            CHECK(cecs_get_const_in(world, g_entities[i], has_health_t)->points == (int32_t)i);
+        }
+        if (i % 3u == 0u) {
+            CHECK(cecs_has_in(world, g_entities[i], is_alive_t));
+        }
+    }
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    /* Fill several archetypes, then destroy almost everything */
+    cecs_world_t *world = cecs_world_create();
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        g_entities[i] = cecs_create_in(world, has_position_t);
+        *cecs_get_in(world, g_entities[i], has_position_t) = (has_position_t){(int32_t)i, -(int32_t)i};
+        if (i % 2u == 0u) {
+            cecs_add_in(world, g_entities[i], has_health_t);
+            cecs_get_in(world, g_entities[i], has_health_t)->points = (int32_t)i;
+        }
+        if (i % 3u == 0u) {
+            cecs_add_in(world, g_entities[i], is_alive_t);
+        }
+    }
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        if (i % KEPT_EVERY != 0u) {
+            CHECK(cecs_destroy_in(world, g_entities[i]));
+        }
+    }
+
+    cecs_memory_usage_t before;
+    cecs_component_memory_in(world, has_position_t, &before);
+
+    /* A zero budget compacts one archetype per call, so a pass takes several
+     * calls, between which the world stays usable */
+    size_t n_calls = 0u;
+    while (!cecs_compact(world, 0u)) {
+        ++n_calls;
+        check_survivors(world);
+    }
+    CHECK(n_calls > 1u);
+    check_survivors(world);
+
+    /* Tables shrank to a power of two near their row counts, well below where
+     * they grew to */
+    cecs_memory_usage_t after;
+    cecs_component_memory_in(world, has_position_t, &after);
+    CHECK(after.used == before.used);
+    CHECK(after.allocated < before.allocated / 16u);
+    CHECK(after.allocated <= 4u * after.used);
+
+    /* New entities reuse the lowest free indices first */
+    const cecs_entity_t created = cecs_create_in(world, has_position_t);
+    CHECK(CECS_ENTITY_INDEX(created) == CECS_ENTITY_INDEX(g_entities[1]));
+
+    /* A pass over a compacted world changes nothing */
+    CHECK(cecs_destroy_in(world, created));
+    while (!cecs_compact(world, 1000u)) {
+    }
+    check_survivors(world);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+/* Offsets of header fields, for corrupting them */
+#define MAGIC_OFFSET 0u
+#define VERSION_OFFSET 8u
+#define SIZE_OFFSET 16u
+#define N_CHUNKS_OFFSET 56u
+
+
+/** Check that the given entity has the same components, data and enabled
+ * state in both worlds, or is dead in both */
+static void check_same(cecs_world_t *source, cecs_world_t *replica, const cecs_entity_t entity)
+{
+    CHECK(cecs_is_alive_in(source, entity) == cecs_is_alive_in(replica, entity));
+
+    const has_position_t *position = cecs_get_const_in(source, entity, has_position_t);
+    const has_position_t *copy     = cecs_get_const_in(replica, entity, has_position_t);
+    CHECK(!position == !copy);
+    if (position) {
+        CHECK(position->x == copy->x && position->y == copy->y);
+        CHECK(cecs_is_enabled_in(source, entity, has_position_t) == cecs_is_enabled_in(replica, entity, has_position_t));
+    }
+
+    const has_health_t *health      = cecs_get_const_in(source, entity, has_health_t);
+    const has_health_t *health_copy = cecs_get_const_in(replica, entity, has_health_t);
+    CHECK(!health == !health_copy);
+    if (health) {
+        CHECK(health->points == health_copy->points);
+        CHECK(cecs_is_enabled_in(source, entity, has_health_t) == cecs_is_enabled_in(replica, entity, has_health_t));
+    }
+
+    CHECK(cecs_has_in(source, entity, is_alive_t) == cecs_has_in(replica, entity, is_alive_t));
+    CHECK(cecs_is_enabled_in(source, entity, is_alive_t) == cecs_is_enabled_in(replica, entity, is_alive_t));
+}
+
+
+/** Encode the changes to the source since the given tick, apply them twice to
+ * the replica and check that the entities match. Returns the tick to encode
+ * the next delta since. */
+static cecs_tick_t replicate(cecs_world_t *source, cecs_world_t *replica, const cecs_tick_t since, const cecs_entity_t *entities, const size_t n_entities)
+{
+    cecs_delta_buffer_t buffer = { 0 };
+    cecs_delta_encode(source, since, &buffer);
+    CHECK(cecs_delta_apply(replica, buffer.data, buffer.size));
+    CHECK(cecs_delta_apply(replica, buffer.data, buffer.size));
+    cecs_delta_buffer_free(&buffer);
+
+    for (size_t i = 0u; i < n_entities; ++i) {
+        check_same(source, replica, entities[i]);
+    }
+
+    const cecs_tick_t next = cecs_world_tick(source);
+    cecs_world_advance_tick(source);
+
+    return next;
+}
+
+
+/** Returns true if applying `size` bytes of `data` fails */
+static bool apply_fails(cecs_world_t *replica, const uint8_t *data, const size_t size)
+{
+    return !cecs_delta_apply(replica, data, size);
+}
+
+
+/** Apply a delta read from a pipe holding `size` bytes of `data` */
+static bool apply_from_pipe(cecs_world_t *replica, const uint8_t *data, const size_t size)
+{
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    CHECK(write(fds[1], data, size) == (ssize_t)size);
+    close(fds[1]);
+
+    const bool ok = cecs_delta_apply_fd(replica, fds[0]);
+    close(fds[0]);
+
+    return ok;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    cecs_world_t *source  = cecs_world_create();
+    cecs_world_t *replica = cecs_world_create();
+    cecs_track_destroyed(source);
+
+    /* Creates */
+    cecs_tick_t since = cecs_world_tick(source);
+    cecs_entity_t entities[4];
+    entities[0] = cecs_create_in(source, has_position_t, has_health_t);
+    entities[1] = cecs_create_in(source, has_position_t);
+    entities[2] = cecs_create_in(source, is_alive_t);
+    entities[3] = cecs_create_in(source, has_position_t, is_alive_t);
+    for (int32_t i = 0; i < 4; ++i) {
+        has_position_t *position = cecs_get_in(source, entities[i], has_position_t);
+        if (position) {
+            *position = (has_position_t){i, 10 * i};
+        }
+    }
+    cecs_get_in(source, entities[0], has_health_t)->points = 100;
+    since = replicate(source, replica, since, entities, 4u);
+    CHECK(cecs_is_alive_in(replica, entities[2]));
+
+    /* Adds, removes, sets and destroys */
+    cecs_add_in(source, entities[1], has_health_t);
+    cecs_get_in(source, entities[1], has_health_t)->points = 50;
+    cecs_remove_in(source, entities[0], has_health_t);
+    has_position_t moved = {-1, -2};
+    cecs_set_in(source, entities[3], has_position_t, &moved);
+    CHECK(cecs_destroy_in(source, entities[2]));
+    since = replicate(source, replica, since, entities, 4u);
+    CHECK(!cecs_is_alive_in(replica, entities[2]));
+    CHECK(cecs_get_const_in(replica, entities[1], has_health_t)->points == 50);
+    CHECK(!cecs_has_in(replica, entities[0], has_health_t));
+
+    /* Toggling a tag changes no column, but is still sent */
+    cecs_disable_in(source, entities[3], is_alive_t);
+    since = replicate(source, replica, since, entities, 4u);
+    CHECK(!cecs_is_enabled_in(replica, entities[3], is_alive_t));
+
+    cecs_enable_in(source, entities[3], is_alive_t);
+    since = replicate(source, replica, since, entities, 4u);
+    CHECK(cecs_is_enabled_in(replica, entities[3], is_alive_t));
+
+    /* Truncated and corrupt deltas are rejected without touching the
+     * replica */
+    cecs_get_in(source, entities[1], has_health_t)->points = 75;
+    cecs_delta_buffer_t buffer = { 0 };
+    cecs_delta_encode(source, 0u, &buffer);
+    uint8_t *bad = malloc(buffer.size);
+    CHECK(bad != NULL);
+
+    for (size_t size = 0u; size < buffer.size; ++size) {
+        CHECK(apply_fails(replica, buffer.data, size));
+    }
+
+    const size_t corruptions[] = {MAGIC_OFFSET, VERSION_OFFSET, SIZE_OFFSET, N_CHUNKS_OFFSET + 7u};
+    for (size_t i = 0u; i < sizeof(corruptions) / sizeof(corruptions[0]); ++i) {
+        memcpy(bad, buffer.data, buffer.size);
+        bad[corruptions[i]] ^= 0x40u;
+        CHECK(apply_fails(replica, bad, buffer.size));
+    }
+
+    /* A component the replica doesn't know by name */
+    memcpy(bad, buffer.data, buffer.size);
+    uint8_t *name = NULL;
+    for (size_t i = 0u; !name && i + sizeof("has_health_t") <= buffer.size; ++i) {
+        if (memcmp(&bad[i], "has_health_t", sizeof("has_health_t")) == 0) {
+            name = &bad[i];
+        }
+    }
+    CHECK(name != NULL);
+    name[0] = 'X';
+    CHECK(apply_fails(replica, bad, buffer.size));
+    CHECK(cecs_get_const_in(replica, entities[1], has_health_t)->points == 50);
+
+    /* Deltas read from a stream, including a cut short one and one whose
+     * header claims more memory than can be allocated */
+    CHECK(apply_from_pipe(replica, buffer.data, buffer.size));
+    CHECK(cecs_get_const_in(replica, entities[1], has_health_t)->points == 75);
+
+    cecs_get_in(source, entities[1], has_health_t)->points = 25;
+    cecs_delta_encode(source, 0u, &buffer);
+    CHECK(!apply_from_pipe(replica, buffer.data, 0u));
+    CHECK(!apply_from_pipe(replica, buffer.data, buffer.size / 2u));
+    CHECK(!apply_from_pipe(replica, buffer.data, buffer.size - 1u));
+
+    memcpy(bad, buffer.data, buffer.size);
+    const uint64_t huge = (uint64_t)1u << 62u;
+    memcpy(&bad[SIZE_OFFSET], &huge, sizeof(huge));
+    CHECK(!apply_from_pipe(replica, bad, buffer.size));
+
+    memcpy(bad, buffer.data, buffer.size);
+    bad[MAGIC_OFFSET] ^= 0x40u;
+    CHECK(!apply_from_pipe(replica, bad, buffer.size));
+    CHECK(cecs_get_const_in(replica, entities[1], has_health_t)->points == 75);
+
+    free(bad);
+    cecs_delta_buffer_free(&buffer);
+
+    cecs_world_destroy(replica);
+    cecs_world_destroy(source);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
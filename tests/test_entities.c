@@ -0,0 +1,100 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+
+#define N_CYCLES 100u
+#define N_PER_CYCLE 1000u
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+
+    cecs_world_t *world = cecs_world_create();
+
+    const cecs_entity_t doomed = cecs_create_in(world, has_position_t);
+    const cecs_entity_t kept   = cecs_create_in(world, has_position_t);
+    *cecs_get_in(world, doomed, has_position_t) = (has_position_t){1, 1};
+    *cecs_get_in(world, kept, has_position_t)   = (has_position_t){2, 2};
+
+    /* A destroyed entity's handle goes stale, and destroying it again fails */
+    CHECK(cecs_destroy_in(world, doomed));
+    CHECK(!cecs_is_alive_in(world, doomed));
+    CHECK(!cecs_destroy_in(world, doomed));
+    CHECK(cecs_get_in(world, doomed, has_position_t) == NULL);
+    CHECK(!cecs_has_in(world, doomed, has_position_t));
+
+    /* The entity moved into the destroyed row keeps its data */
+    CHECK(cecs_get_const_in(world, kept, has_position_t)->x == 2);
+
+    /* The slot is reused with a new generation, and the stale handle can't
+     * reach the entity now living in it */
+    const cecs_entity_t reused = cecs_create_in(world, has_position_t);
+    *cecs_get_in(world, reused, has_position_t) = (has_position_t){3, 3};
+    CHECK(CECS_ENTITY_INDEX(reused) == CECS_ENTITY_INDEX(doomed));
+    CHECK(CECS_ENTITY_GENERATION(reused) == CECS_ENTITY_GENERATION(doomed) + 1u);
+    CHECK(cecs_is_alive_in(world, reused));
+    CHECK(!cecs_is_alive_in(world, doomed));
+
+    has_position_t moved = {-1, -1};
+    CHECK(!cecs_set_in(world, doomed, has_position_t, &moved));
+    cecs_add_in(world, doomed, has_health_t);
+    cecs_remove_in(world, doomed, has_position_t);
+    CHECK(!cecs_destroy_in(world, doomed));
+    CHECK(cecs_is_alive_in(world, reused));
+    CHECK(!cecs_has_in(world, reused, has_health_t));
+    CHECK(cecs_get_const_in(world, reused, has_position_t)->x == 3);
+
+    /* Spawning and despawning in waves reuses the same slots, so the entity
+     * table stops growing after the first wave */
+    static cecs_entity_t wave[N_PER_CYCLE];
+    cecs_memory_stats_t first;
+    for (uint32_t cycle = 0u; cycle < N_CYCLES; ++cycle) {
+        for (uint32_t i = 0u; i < N_PER_CYCLE; ++i) {
+            wave[i] = cecs_create_in(world, has_position_t, has_health_t);
+            CHECK(CECS_ENTITY_INDEX(wave[i]) <= N_PER_CYCLE + 2u);
+            cecs_get_in(world, wave[i], has_health_t)->points = (int32_t)cycle;
+        }
+        for (uint32_t i = 0u; i < N_PER_CYCLE; ++i) {
+            CHECK(cecs_get_const_in(world, wave[i], has_health_t)->points == (int32_t)cycle);
+            CHECK(cecs_destroy_in(world, wave[i]));
+        }
+
+        cecs_memory_stats_t stats;
+        cecs_memory_stats(world, &stats);
+        if (cycle == 0u) {
+            first = stats;
+        }
+        CHECK(stats.entity_index.allocated == first.entity_index.allocated);
+        CHECK(stats.free_list.allocated == first.free_list.allocated);
+    }
+
+    /* Handles from every earlier wave stay stale */
+    for (uint32_t i = 0u; i < N_PER_CYCLE; ++i) {
+        CHECK(!cecs_is_alive_in(world, wave[i]));
+    }
+    CHECK(cecs_is_alive_in(world, kept) && cecs_is_alive_in(world, reused));
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
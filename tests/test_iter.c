@@ -0,0 +1,143 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+/** Entities per archetype, enough to span several chunks */
+#define N_PER_ARCHETYPE 2500u
+#define N_ENTITIES (3u * N_PER_ARCHETYPE)
+
+
+static cecs_entity_t g_entities[N_ENTITIES];
+
+/** Number of times each entity was returned, by index */
+static uint8_t g_visits[N_ENTITIES + 1u];
+
+
+/** Iterate the entities with a position, counting the visits to each, and
+ * return how many were returned */
+static size_t visit_all(cecs_world_t *world)
+{
+    memset(g_visits, 0u, sizeof(g_visits));
+
+    cecs_iter_t it;
+    cecs_entity_t entity;
+    size_t count = 0u;
+    cecs_query_in(world, &it, has_position_t);
+    while ((entity = cecs_iter_next(&it))) {
+        ++g_visits[CECS_ENTITY_INDEX(entity)];
+        ++count;
+    }
+
+    return count;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    /* Three archetypes with a position, and one without */
+    cecs_world_t *world = cecs_world_create();
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        switch (i % 3u) {
+        case 0u:
+            g_entities[i] = cecs_create_in(world, has_position_t);
+            break;
+        case 1u:
+            g_entities[i] = cecs_create_in(world, has_position_t, has_health_t);
+            break;
+        default:
+            g_entities[i] = cecs_create_in(world, has_position_t, is_alive_t);
+            break;
+        }
+        CHECK(CECS_ENTITY_INDEX(g_entities[i]) <= N_ENTITIES);
+        *cecs_get_in(world, g_entities[i], has_position_t) = (has_position_t){(int32_t)i, 0};
+    }
+    const cecs_entity_t unpositioned = cecs_create_in(world, has_health_t);
+
+    /* The count is known up front, and each entity is returned once */
+    cecs_iter_t it;
+    CHECK(cecs_query_in(world, &it, has_position_t) == N_ENTITIES);
+    CHECK(visit_all(world) == N_ENTITIES);
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        CHECK(g_visits[CECS_ENTITY_INDEX(g_entities[i])] == 1u);
+    }
+
+    /* Disabled rows are skipped */
+    cecs_disable_in(world, g_entities[0], has_position_t);
+    CHECK(visit_all(world) == N_ENTITIES - 1u);
+    CHECK(g_visits[CECS_ENTITY_INDEX(g_entities[0])] == 0u);
+    cecs_enable_in(world, g_entities[0], has_position_t);
+
+    /* Destroying the current entity, or removing a queried component from it,
+     * swaps another row into its place, which is still visited once */
+    memset(g_visits, 0u, sizeof(g_visits));
+    cecs_entity_t entity;
+    size_t n_visited = 0u;
+    cecs_query_in(world, &it, has_position_t);
+    while ((entity = cecs_iter_next(&it))) {
+        ++g_visits[CECS_ENTITY_INDEX(entity)];
+        ++n_visited;
+
+        const int32_t x = cecs_get_const_in(world, entity, has_position_t)->x;
+        if (x % 4 == 0) {
+            CHECK(cecs_destroy_in(world, entity));
+        } else if (x % 4 == 1) {
+            cecs_remove_in(world, entity, has_position_t);
+        }
+    }
+    CHECK(n_visited == N_ENTITIES);
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        CHECK(g_visits[CECS_ENTITY_INDEX(g_entities[i])] == 1u);
+    }
+
+    /* The survivors kept their data, and only they are left to iterate */
+    size_t n_kept = 0u;
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        const has_position_t *position = cecs_get_const_in(world, g_entities[i], has_position_t);
+        switch (i % 4u) {
+        case 0u:
+            CHECK(!cecs_is_alive_in(world, g_entities[i]));
+            break;
+        case 1u:
+            CHECK(cecs_is_alive_in(world, g_entities[i]) && position == NULL);
+            break;
+        default:
+            CHECK(position != NULL && position->x == (int32_t)i);
+            ++n_kept;
+            break;
+        }
+    }
+    CHECK(visit_all(world) == n_kept);
+    CHECK(cecs_is_alive_in(world, unpositioned));
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+    int32_t damage;
+} has_weapon_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(has_weapon_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(has_weapon_t);
+
+#define N_RESERVED 10000u
+
+
+/** Measure the world's memory, checking that no part claims to use more than
+ * it has allocated and that the parts add up to the total */
+static cecs_memory_stats_t measure(cecs_world_t *world)
+{
+    cecs_memory_stats_t stats;
+    cecs_memory_stats(world, &stats);
+
+    const cecs_memory_usage_t *parts[] = {
+        &stats.columns,   &stats.tables,          &stats.entity_index,
+        &stats.free_list, &stats.archetype_index, &stats.queries,
+        &stats.pools,     &stats.frame_arena,     &stats.removed_log,
+        &stats.scratch,
+    };
+    size_t used      = 0u;
+    size_t allocated = 0u;
+    for (size_t i = 0u; i < sizeof(parts) / sizeof(parts[0]); ++i) {
+        CHECK(parts[i]->used <= parts[i]->allocated);
+        used += parts[i]->used;
+        allocated += parts[i]->allocated;
+    }
+    CHECK(stats.total.used == used && stats.total.allocated == allocated);
+
+    return stats;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(has_weapon_t);
+
+    cecs_world_t *world = cecs_world_create();
+    cecs_memory_usage_t usage;
+    measure(world);
+
+    /* A new archetype's table starts small */
+    const cecs_entity_t armed = cecs_create_in(world, has_weapon_t);
+    cecs_component_memory_in(world, has_weapon_t, &usage);
+    CHECK(usage.used == sizeof(has_weapon_t));
+    CHECK(usage.allocated < 1024u * sizeof(has_weapon_t));
+    measure(world);
+
+    /* Reserving sizes the table exactly, so filling it never moves the data */
+    cecs_reserve_in(world, N_RESERVED, has_position_t, has_health_t);
+    cecs_component_memory_in(world, has_position_t, &usage);
+    CHECK(usage.used == 0u && usage.allocated == N_RESERVED * sizeof(has_position_t));
+
+    static cecs_entity_t entities[N_RESERVED];
+    entities[0]                 = cecs_create_in(world, has_position_t, has_health_t);
+    const has_position_t *first = cecs_get_const_in(world, entities[0], has_position_t);
+    for (uint32_t i = 1u; i < N_RESERVED; ++i) {
+        entities[i] = cecs_create_in(world, has_position_t, has_health_t);
+    }
+    for (uint32_t i = 0u; i < N_RESERVED; ++i) {
+        *cecs_get_in(world, entities[i], has_position_t) = (has_position_t){(int32_t)i, 0};
+        cecs_get_in(world, entities[i], has_health_t)->points = (int32_t)i;
+    }
+    CHECK(cecs_get_const_in(world, entities[0], has_position_t) == first);
+    cecs_component_memory_in(world, has_position_t, &usage);
+    CHECK(usage.used == usage.allocated);
+    measure(world);
+
+    /* Reserving less than the table holds does nothing */
+    cecs_reserve_in(world, 10u, has_position_t, has_health_t);
+    cecs_component_memory_in(world, has_position_t, &usage);
+    CHECK(usage.allocated == N_RESERVED * sizeof(has_position_t));
+
+    /* One more row outgrows the reservation */
+    const cecs_entity_t extra = cecs_create_in(world, has_position_t, has_health_t);
+    cecs_component_memory_in(world, has_position_t, &usage);
+    CHECK(usage.allocated > N_RESERVED * sizeof(has_position_t));
+    CHECK(cecs_destroy_in(world, extra));
+
+    /* Shrinking fits the tables to their rows, frees those of empty
+     * archetypes and keeps the data */
+    for (uint32_t i = 0u; i < N_RESERVED; i += 2u) {
+        CHECK(cecs_destroy_in(world, entities[i]));
+    }
+    CHECK(cecs_destroy_in(world, armed));
+
+    const cecs_memory_stats_t before = measure(world);
+    cecs_shrink(world);
+    const cecs_memory_stats_t after = measure(world);
+    CHECK(after.total.allocated < before.total.allocated);
+    CHECK(after.columns.allocated < before.columns.allocated);
+    CHECK(after.columns.used == before.columns.used);
+
+    cecs_component_memory_in(world, has_position_t, &usage);
+    CHECK(usage.used == N_RESERVED / 2u * sizeof(has_position_t));
+    CHECK(usage.allocated == usage.used);
+    cecs_component_memory_in(world, has_weapon_t, &usage);
+    CHECK(usage.allocated == 0u);
+
+    for (uint32_t i = 1u; i < N_RESERVED; i += 2u) {
+        CHECK(cecs_get_const_in(world, entities[i], has_position_t)->x == (int32_t)i);
+        CHECK(cecs_get_const_in(world, entities[i], has_health_t)->points == (int32_t)i);
+    }
+
+    /* Shrunk tables grow again as needed */
+    const cecs_entity_t rearmed = cecs_create_in(world, has_weapon_t);
+    cecs_get_in(world, rearmed, has_weapon_t)->damage = 3;
+    CHECK(cecs_get_const_in(world, rearmed, has_weapon_t)->damage == 3);
+    measure(world);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int64_t x, y;
+} has_position_t, has_velocity_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_velocity_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_velocity_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+#define N_ENTITIES 150000u
+#define N_WORKERS 4u
+#define N_STEPS 10u
+
+/** Entities in the small world queried from inside a parallel callback */
+#define N_NESTED 100u
+
+/** Per-worker sums, each on its own cache line */
+struct worker_sum {
+    int64_t sum;
+    uint8_t pad[64u - sizeof(int64_t)];
+};
+
+
+/** Fill a world with moving entities, every third one also tagged so the
+ * query spans two archetypes */
+static void populate(cecs_world_t *world, const size_t n_entities)
+{
+    for (size_t i = 0u; i < n_entities; ++i) {
+        const cecs_entity_t entity = (i % 3u == 0u)
+            ? cecs_create_in(world, has_position_t, has_velocity_t, is_alive_t)
+            : cecs_create_in(world, has_position_t, has_velocity_t);
+        *cecs_get_in(world, entity, has_position_t) = (has_position_t){(int64_t)i, 0};
+        *cecs_get_in(world, entity, has_velocity_t) = (has_velocity_t){(int64_t)(i % 7u), 1};
+    }
+}
+
+
+/** Move every entity of the chunk by its velocity */
+static void move_chunk(const cecs_chunk_t *chunk, const size_t worker, void *ctx)
+{
+    (void)ctx;
+    CHECK(worker < cecs_worker_count());
+
+    has_position_t *positions        = cecs_chunk_column(chunk, has_position_t);
+    const has_velocity_t *velocities = cecs_chunk_column_const(chunk, has_velocity_t);
+    for (size_t i = 0u; i < chunk->count; ++i) {
+        positions[i].x += velocities[i].x;
+        positions[i].y += velocities[i].y;
+    }
+}
+
+
+/** Add the positions of the chunk to the worker's sum */
+static void sum_chunk(const cecs_chunk_t *chunk, const size_t worker, void *ctx)
+{
+    struct worker_sum *sums = ctx;
+
+    const has_position_t *positions = cecs_chunk_column_const(chunk, has_position_t);
+    for (size_t i = 0u; i < chunk->count; ++i) {
+        sums[worker].sum += positions[i].x + positions[i].y;
+    }
+}
+
+
+/** Sum the positions of the query's entities on the workers */
+static int64_t sum_parallel(const cecs_query_t *query)
+{
+    struct worker_sum sums[N_WORKERS] = { 0 };
+    cecs_query_each_parallel(query, sum_chunk, sums);
+
+    int64_t sum = 0;
+    for (size_t i = 0u; i < N_WORKERS; ++i) {
+        sum += sums[i].sum;
+    }
+
+    return sum;
+}
+
+
+/** Sum the positions of the query's entities on the calling thread */
+static int64_t sum_serial(const cecs_query_t *query)
+{
+    int64_t sum = 0;
+    cecs_chunk_iter_t it;
+    cecs_chunk_t chunk;
+    cecs_query_iter_chunks(query, &it);
+    while (cecs_chunk_next(&it, &chunk)) {
+        const has_position_t *positions = cecs_chunk_column_const(&chunk, has_position_t);
+        for (size_t i = 0u; i < chunk.count; ++i) {
+            sum += positions[i].x + positions[i].y;
+        }
+    }
+
+    return sum;
+}
+
+
+/** Expected sum of the positions after the given number of steps */
+static int64_t expected_sum(const size_t n_entities, const size_t n_steps)
+{
+    int64_t sum = 0;
+    for (size_t i = 0u; i < n_entities; ++i) {
+        sum += (int64_t)i + (int64_t)n_steps * ((int64_t)(i % 7u) + 1);
+    }
+
+    return sum;
+}
+
+
+/** State shared by the callbacks that start a parallel query of their own */
+struct nested_ctx {
+    const cecs_query_t *inner;
+    atomic_size_t n_outer;
+    atomic_size_t n_inner;
+    /** Set if a nested callback ran on a different worker than its caller */
+    atomic_bool moved;
+};
+
+
+/** Count the rows of a chunk of the inner query */
+static void count_inner_chunk(const cecs_chunk_t *chunk, const size_t worker, void *ctx)
+{
+    struct nested_ctx *nested = ctx;
+    if (worker != cecs_current_worker()) {
+        atomic_store(&nested->moved, true);
+    }
+    atomic_fetch_add(&nested->n_inner, chunk->count);
+}
+
+
+/** Run the inner query in parallel from inside a chunk of the outer one */
+static void run_nested_chunk(const cecs_chunk_t *chunk, const size_t worker, void *ctx)
+{
+    struct nested_ctx *nested = ctx;
+    (void)chunk;
+    (void)worker;
+
+    atomic_fetch_add(&nested->n_outer, 1u);
+    cecs_query_each_parallel(nested->inner, count_inner_chunk, nested);
+}
+
+
+/** A world stepped by a thread of its own */
+struct world_thread {
+    pthread_t thread;
+    size_t n_entities;
+    int64_t sum;
+};
+
+
+/** Create a world, step it in parallel and sum it */
+static void *run_world_thread(void *arg)
+{
+    struct world_thread *state = arg;
+
+    cecs_world_t *world = cecs_world_create();
+    populate(world, state->n_entities);
+    cecs_query_t *movers = cecs_query_create_in(world, has_position_t, has_velocity_t);
+
+    for (size_t step = 0u; step < N_STEPS; ++step) {
+        cecs_query_each_parallel(movers, move_chunk, NULL);
+    }
+    state->sum = sum_parallel(movers);
+    CHECK(state->sum == sum_serial(movers));
+
+    cecs_world_destroy(world);
+
+    return NULL;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_velocity_t);
+    CECS_COMPONENT(is_alive_t);
+
+    cecs_set_worker_count(N_WORKERS);
+
+    /* Parallel updates and sums match the serial result */
+    cecs_world_t *world  = cecs_world_create();
+    populate(world, N_ENTITIES);
+    cecs_query_t *movers = cecs_query_create_in(world, has_position_t, has_velocity_t);
+
+    CHECK(sum_parallel(movers) == expected_sum(N_ENTITIES, 0u));
+    for (size_t step = 0u; step < N_STEPS; ++step) {
+        cecs_query_each_parallel(movers, move_chunk, NULL);
+    }
+    CHECK(sum_serial(movers) == expected_sum(N_ENTITIES, N_STEPS));
+    CHECK(sum_parallel(movers) == expected_sum(N_ENTITIES, N_STEPS));
+
+    /* A parallel query started from a callback runs inline on its worker */
+    cecs_world_t *small = cecs_world_create();
+    populate(small, N_NESTED);
+    struct nested_ctx nested = { .inner = cecs_query_create_in(small, has_position_t) };
+    cecs_query_each_parallel(movers, run_nested_chunk, &nested);
+    CHECK(atomic_load(&nested.n_outer) > N_WORKERS);
+    CHECK(atomic_load(&nested.n_inner) == atomic_load(&nested.n_outer) * N_NESTED);
+    CHECK(!atomic_load(&nested.moved));
+
+    /* Worlds stepped from two threads at once share the pool */
+    struct world_thread threads[2] = {
+        { .n_entities = N_ENTITIES },
+        { .n_entities = N_ENTITIES / 3u },
+    };
+    for (size_t i = 0u; i < 2u; ++i) {
+        CHECK(pthread_create(&threads[i].thread, NULL, run_world_thread, &threads[i]) == 0);
+    }
+    for (size_t i = 0u; i < 2u; ++i) {
+        CHECK(pthread_join(threads[i].thread, NULL) == 0);
+        CHECK(threads[i].sum == expected_sum(threads[i].n_entities, N_STEPS));
+    }
+
+    cecs_world_destroy(small);
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
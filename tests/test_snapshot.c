@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+#define N_ENTITIES 3000u
+
+/* Offsets of header and archetype entry fields, for corrupting them */
+#define N_ARCHETYPES_OFFSET 88u
+#define ARCHETYPES_OFFSET 96u
+#define ARCHETYPE_SIZE 64u
+#define N_COLUMNS_OFFSET 32u
+#define COLUMNS_OFFSET 40u
+#define N_MASKS_OFFSET 48u
+#define MASKS_OFFSET 56u
+
+/** Entity with its position disabled, so its archetype has two masks */
+#define HIDDEN 6u
+
+
+/** Read the whole file at the specified path into a new buffer */
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    CHECK(file != NULL);
+    CHECK(fseek(file, 0, SEEK_END) == 0);
+    const long length = ftell(file);
+    CHECK(length > 0);
+    CHECK(fseek(file, 0, SEEK_SET) == 0);
+
+    *size         = (size_t)length;
+    uint8_t *data = malloc(*size);
+    CHECK(data != NULL);
+    CHECK(fread(data, 1u, *size, file) == *size);
+    fclose(file);
+
+    return data;
+}
+
+
+/** Replace the file at the specified path with `size` bytes of `data` */
+static void write_file(const char *path, const uint8_t *data, const size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    CHECK(file != NULL);
+    CHECK(fwrite(data, 1u, size, file) == size);
+    fclose(file);
+}
+
+
+/** Find the only place the given entity handle is stored in the snapshot */
+static size_t find_entity(const uint8_t *data, const size_t size, const cecs_entity_t entity)
+{
+    size_t found = SIZE_MAX;
+    for (size_t i = 0u; i + sizeof(entity) <= size; ++i) {
+        if (memcmp(&data[i], &entity, sizeof(entity)) == 0) {
+            CHECK(found == SIZE_MAX);
+            found = i;
+        }
+    }
+    CHECK(found != SIZE_MAX);
+
+    return found;
+}
+
+
+/** Find the only saved archetype with the given numbers of columns and masks,
+ * returning the offset of its entry */
+static size_t find_archetype(const uint8_t *data, const uint64_t n_columns, const uint64_t n_masks)
+{
+    uint64_t n_archetypes, archetypes_offset;
+    memcpy(&n_archetypes, &data[N_ARCHETYPES_OFFSET], sizeof(n_archetypes));
+    memcpy(&archetypes_offset, &data[ARCHETYPES_OFFSET], sizeof(archetypes_offset));
+
+    size_t found = SIZE_MAX;
+    for (uint64_t i = 0u; i < n_archetypes; ++i) {
+        const size_t entry = (size_t)(archetypes_offset + i * ARCHETYPE_SIZE);
+        uint64_t entry_columns, entry_masks;
+        memcpy(&entry_columns, &data[entry + N_COLUMNS_OFFSET], sizeof(entry_columns));
+        memcpy(&entry_masks, &data[entry + N_MASKS_OFFSET], sizeof(entry_masks));
+        if (entry_columns == n_columns && entry_masks == n_masks) {
+            CHECK(found == SIZE_MAX);
+            found = entry;
+        }
+    }
+    CHECK(found != SIZE_MAX);
+
+    return found;
+}
+
+
+/** Make the second of the arrays whose offset is stored at `field` belong to
+ * the same component as the first */
+static void duplicate_array(uint8_t *data, const size_t field)
+{
+    uint64_t arrays;
+    memcpy(&arrays, &data[field], sizeof(arrays));
+    /* Each array is a component index followed by an offset */
+    memcpy(&data[arrays + 2u * sizeof(uint64_t)], &data[arrays], sizeof(uint64_t));
+}
+
+
+/** Returns true if loading the file at the specified path fails and leaves
+ * the given world without any entity */
+static bool load_fails(cecs_world_t *world, cecs_query_t *all, const char *path)
+{
+    return !cecs_snapshot_load_in(world, path) && cecs_query_count(all) == 0u;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    char path[] = "/tmp/cecs_test_snapshot_XXXXXX";
+    const int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    /* Spread the entities over three archetypes, one of them only a tag, then
+     * free some slots, reuse a few and disable components on others */
+    cecs_world_t *world = cecs_world_create();
+    static cecs_entity_t entities[N_ENTITIES];
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        switch (i % 3u) {
+        case 0u:
+            entities[i] = cecs_create_in(world, has_position_t, has_health_t);
+            cecs_get_in(world, entities[i], has_health_t)->points = (int32_t)i;
+            break;
+        case 1u:
+            entities[i] = cecs_create_in(world, has_position_t, is_alive_t);
+            break;
+        default:
+            entities[i] = cecs_create_in(world, is_alive_t);
+            break;
+        }
+        if (i % 3u != 2u) {
+            *cecs_get_in(world, entities[i], has_position_t) = (has_position_t){(int32_t)i, -(int32_t)i};
+        }
+    }
+
+    cecs_entity_t stale[3];
+    for (uint32_t i = 0u; i < 3u; ++i) {
+        stale[i] = entities[100u * i + 3u];
+        CHECK(cecs_destroy_in(world, stale[i]));
+    }
+    /* The destroyed slots are handed out again with a new generation */
+    cecs_entity_t reused[2];
+    reused[0] = cecs_create_in(world, has_position_t, has_health_t);
+    reused[1] = cecs_create_in(world, has_position_t, has_health_t);
+    for (uint32_t i = 0u; i < 2u; ++i) {
+        CHECK(CECS_ENTITY_GENERATION(reused[i]) > 0u);
+        *cecs_get_in(world, reused[i], has_position_t) = (has_position_t){7, 7};
+        cecs_get_in(world, reused[i], has_health_t)->points = 7;
+    }
+    for (uint32_t i = 0u; i < N_ENTITIES; i += 10u) {
+        if (i % 3u == 0u && i % 100u != 3u) {
+            cecs_disable_in(world, entities[i], has_health_t);
+        }
+        else if (i % 3u == 2u) {
+            cecs_disable_in(world, entities[i], is_alive_t);
+        }
+    }
+    cecs_disable_in(world, entities[HIDDEN], has_position_t);
+
+    /* Saving goes through a temporary file, which doesn't outlive it */
+    char tmp_path[sizeof(path) + 4u];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    CHECK(cecs_snapshot_save_in(world, path));
+    CHECK(access(tmp_path, F_OK) != 0);
+
+    /* Loading restores every entity with its data, handle and enabled state */
+    cecs_world_t *loaded     = cecs_world_create();
+    cecs_query_t *all        = cecs_query_create_terms_in(loaded, cecs_no_components(), cecs_no_components(), cecs_no_components(), cecs_no_components());
+    cecs_query_t *healthy    = cecs_query_create_in(loaded, has_health_t);
+    cecs_query_t *positioned = cecs_query_create_in(loaded, has_position_t);
+    cecs_query_t *alive      = cecs_query_create_in(loaded, is_alive_t);
+    CHECK(cecs_snapshot_load_in(loaded, path));
+
+    CHECK(cecs_query_count(all) == N_ENTITIES - 1u);
+    /* Counts include rows with disabled components; each archetype lost one
+     * entity, and the two reused slots went to the first */
+    CHECK(cecs_query_count(healthy) == N_ENTITIES / 3u + 1u);
+    CHECK(cecs_query_count(positioned) == 2u * N_ENTITIES / 3u);
+    CHECK(cecs_query_count(alive) == 2u * N_ENTITIES / 3u - 2u);
+
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        if (i % 100u == 3u && i < 300u) {
+            CHECK(!cecs_is_alive_in(loaded, entities[i]));
+            continue;
+        }
+        CHECK(cecs_is_alive_in(loaded, entities[i]));
+        const has_position_t *position = cecs_get_const_in(loaded, entities[i], has_position_t);
+        if (i % 3u == 2u) {
+            CHECK(position == NULL);
+            CHECK(cecs_is_enabled_in(loaded, entities[i], is_alive_t) == (i % 10u != 0u));
+            continue;
+        }
+        CHECK(position != NULL && position->x == (int32_t)i && position->y == -(int32_t)i);
+        if (i % 3u == 0u) {
+            CHECK(cecs_get_const_in(loaded, entities[i], has_health_t)->points == (int32_t)i);
+            CHECK(cecs_is_enabled_in(loaded, entities[i], has_health_t) == (i % 10u != 0u));
+        }
+        else {
+            CHECK(cecs_is_enabled_in(loaded, entities[i], is_alive_t));
+        }
+        CHECK(cecs_is_enabled_in(loaded, entities[i], has_position_t) == (i != HIDDEN));
+    }
+    for (uint32_t i = 0u; i < 2u; ++i) {
+        CHECK(cecs_is_alive_in(loaded, reused[i]));
+        CHECK(cecs_get_const_in(loaded, reused[i], has_health_t)->points == 7);
+    }
+
+    /* The slot that was still free is reused by the next entity, with a
+     * generation that keeps the destroyed handle stale */
+    const cecs_entity_t created = cecs_create_in(loaded, is_alive_t);
+    CHECK(cecs_is_alive_in(loaded, created));
+    size_t n_reclaimed = 0u;
+    for (uint32_t i = 0u; i < 3u; ++i) {
+        CHECK(!cecs_is_alive_in(loaded, stale[i]));
+        n_reclaimed += CECS_ENTITY_INDEX(created) == CECS_ENTITY_INDEX(stale[i]);
+    }
+    CHECK(n_reclaimed == 1u);
+
+    /* A world that has had entities can't be loaded into */
+    CHECK(!cecs_snapshot_load_in(loaded, path));
+
+    /* Missing, truncated and corrupt files are rejected without touching the
+     * world, which can still load a good file afterwards */
+    cecs_world_t *fresh = cecs_world_create();
+    cecs_query_t *fresh_all = cecs_query_create_terms_in(fresh, cecs_no_components(), cecs_no_components(), cecs_no_components(), cecs_no_components());
+    CHECK(load_fails(fresh, fresh_all, "/nonexistent/cecs_snapshot"));
+
+    size_t size;
+    uint8_t *data = read_file(path, &size);
+    uint8_t *bad  = malloc(size);
+    CHECK(bad != NULL);
+
+    const size_t truncations[] = {0u, 7u, 64u, size / 2u, size - 1u};
+    for (size_t i = 0u; i < sizeof(truncations) / sizeof(truncations[0]); ++i) {
+        write_file(path, data, truncations[i]);
+        CHECK(load_fails(fresh, fresh_all, path));
+    }
+
+    /* Wrong magic, version and an offset past the end of the file */
+    const size_t corruptions[] = {0u, 8u, 32u};
+    for (size_t i = 0u; i < sizeof(corruptions) / sizeof(corruptions[0]); ++i) {
+        memcpy(bad, data, size);
+        bad[corruptions[i] + 3u] ^= 0x40u;
+        write_file(path, bad, size);
+        CHECK(load_fails(fresh, fresh_all, path));
+    }
+
+    /* An entity whose generation doesn't match its slot's */
+    const size_t at_reused = find_entity(data, size, reused[0]);
+    memcpy(bad, data, size);
+    const cecs_entity_t wrong_generation = CECS_ENTITY(CECS_ENTITY_INDEX(reused[0]), CECS_ENTITY_GENERATION(reused[0]) + 1u);
+    memcpy(&bad[at_reused], &wrong_generation, sizeof(wrong_generation));
+    write_file(path, bad, size);
+    CHECK(load_fails(fresh, fresh_all, path));
+
+    /* Two rows holding the same entity */
+    memcpy(bad, data, size);
+    memcpy(&bad[at_reused], &reused[1], sizeof(reused[1]));
+    write_file(path, bad, size);
+    CHECK(load_fails(fresh, fresh_all, path));
+
+    /* The same component named by two columns, or by two masks, of one
+     * archetype */
+    const size_t armed = find_archetype(data, 2u, 2u);
+    memcpy(bad, data, size);
+    duplicate_array(bad, armed + COLUMNS_OFFSET);
+    write_file(path, bad, size);
+    CHECK(load_fails(fresh, fresh_all, path));
+
+    memcpy(bad, data, size);
+    duplicate_array(bad, armed + MASKS_OFFSET);
+    write_file(path, bad, size);
+    CHECK(load_fails(fresh, fresh_all, path));
+
+    /* A save that fails leaves the previous snapshot in place */
+    write_file(path, data, size);
+    CHECK(mkdir(tmp_path, 0700) == 0);
+    CHECK(!cecs_snapshot_save_in(world, path));
+    CHECK(rmdir(tmp_path) == 0);
+
+    CHECK(cecs_snapshot_load_in(fresh, path));
+    CHECK(cecs_query_count(fresh_all) == N_ENTITIES - 1u);
+
+    free(bad);
+    free(data);
+    unlink(path);
+
+    cecs_world_destroy(fresh);
+    cecs_world_destroy(loaded);
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+#define N_ENTITIES 5000u
+
+/** Number of distinct sort keys, so many rows share one */
+#define N_KEYS 100u
+
+
+static cecs_entity_t g_entities[N_ENTITIES];
+
+
+/** Order positions by x alone, so rows with the same x show whether the sort
+ * is stable */
+static int compare_x(const void *lhs, const void *rhs)
+{
+    const has_position_t *a = lhs;
+    const has_position_t *b = rhs;
+
+    return (a->x > b->x) - (a->x < b->x);
+}
+
+
+/** Check that every archetype with a position is ordered by x, and that each
+ * row's entity and health moved with its position. If `by_creation` is set,
+ * rows of equal x must also be in creation order, as a stable sort of rows in
+ * creation order leaves them. */
+static void check_sorted(cecs_world_t *world, const bool by_creation)
+{
+    cecs_chunk_iter_t it;
+    cecs_chunk_t chunk;
+    const has_position_t *previous = NULL;
+    const struct cecs_archetype *archetype = NULL;
+
+    cecs_query_chunks_in(world, &it, has_position_t);
+    while (cecs_chunk_next(&it, &chunk)) {
+        if (chunk.archetype != archetype) {
+            archetype = chunk.archetype;
+            previous  = NULL;
+        }
+
+        const has_position_t *positions = cecs_chunk_column_const(&chunk, has_position_t);
+        const has_health_t *healths     = cecs_chunk_column_const(&chunk, has_health_t);
+        for (size_t i = 0u; i < chunk.count; ++i) {
+            if (previous) {
+                CHECK(previous->x <= positions[i].x);
+                CHECK(!by_creation || previous->x < positions[i].x || previous->y < positions[i].y);
+            }
+            previous = &positions[i];
+
+            CHECK(cecs_get_const_in(world, chunk.entities[i], has_position_t) == &positions[i]);
+            if (healths) {
+                CHECK(healths[i].points == positions[i].y);
+            }
+        }
+    }
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    /* Two archetypes with a position, filled with shuffled keys, and one
+     * without */
+    cecs_world_t *world = cecs_world_create();
+    uint32_t seed       = 12345u;
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        const int32_t key = (int32_t)((seed >> 16u) % N_KEYS);
+
+        g_entities[i] = (i % 2u == 0u) ? cecs_create_in(world, has_position_t, has_health_t)
+                                       : cecs_create_in(world, has_position_t, is_alive_t);
+        *cecs_get_in(world, g_entities[i], has_position_t) = (has_position_t){key, (int32_t)i};
+        if (i % 2u == 0u) {
+            cecs_get_in(world, g_entities[i], has_health_t)->points = (int32_t)i;
+        }
+    }
+    const cecs_entity_t unsorted = cecs_create_in(world, has_health_t);
+    cecs_get_in(world, unsorted, has_health_t)->points = -1;
+
+    /* Disabled bits move with their rows */
+    for (uint32_t i = 0u; i < N_ENTITIES; i += 7u) {
+        cecs_disable_in(world, g_entities[i], has_position_t);
+    }
+
+    cecs_sort_by_in(world, has_position_t, compare_x);
+    check_sorted(world, true);
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        CHECK(cecs_get_const_in(world, g_entities[i], has_position_t)->y == (int32_t)i);
+        CHECK(cecs_is_enabled_in(world, g_entities[i], has_position_t) == (i % 7u != 0u));
+    }
+    CHECK(cecs_get_const_in(world, unsorted, has_health_t)->points == -1);
+
+    /* Sorting again after moving a few entities restores the order */
+    for (uint32_t i = 0u; i < N_ENTITIES; i += 50u) {
+        cecs_get_in(world, g_entities[i], has_position_t)->x = (int32_t)(N_KEYS - 1u - i % N_KEYS);
+    }
+    cecs_sort_by_in(world, has_position_t, compare_x);
+    check_sorted(world, false);
+
+    /* Removing and adding rows after a sort keeps every handle valid */
+    CHECK(cecs_destroy_in(world, g_entities[1]));
+    cecs_add_in(world, g_entities[2], is_alive_t);
+    cecs_sort_by_in(world, has_position_t, compare_x);
+    check_sorted(world, false);
+    CHECK(cecs_get_const_in(world, g_entities[2], has_position_t)->y == 2);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
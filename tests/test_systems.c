@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t, has_velocity_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_velocity_t);
+CECS_COMPONENT_DECL(has_health_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_velocity_t);
+CECS_COMPONENT_DEF(has_health_t);
+
+#define N_SYSTEMS 7u
+#define N_FRAMES 50u
+
+/** Number of frame arena allocations each system makes per frame */
+#define N_ALLOCS 64u
+
+/** Index of each system in the order they are registered */
+enum {
+    WRITE_POSITION,
+    READ_POSITION_A,
+    READ_POSITION_B,
+    MOVE,
+    WRITE_POSITION_AGAIN,
+    READ_VELOCITY,
+    REGISTRAR,
+};
+
+/** Pairs of systems that conflict, the first registered before the second */
+static const size_t g_conflicts[][2] = {
+    {WRITE_POSITION, READ_POSITION_A},
+    {WRITE_POSITION, READ_POSITION_B},
+    {WRITE_POSITION, MOVE},
+    {WRITE_POSITION, WRITE_POSITION_AGAIN},
+    {READ_POSITION_A, WRITE_POSITION_AGAIN},
+    {READ_POSITION_B, WRITE_POSITION_AGAIN},
+    {MOVE, WRITE_POSITION_AGAIN},
+    {MOVE, READ_VELOCITY},
+};
+
+
+/** Sequence numbers handed out as systems start and end */
+static atomic_size_t g_sequence;
+static size_t g_started[N_SYSTEMS];
+static size_t g_ended[N_SYSTEMS];
+
+/** Set by the two position readers when they start, so each can wait to see
+ * the other running at the same time */
+static atomic_bool g_reader_arrived[2];
+static bool g_readers_met;
+
+/** Whether the systems run on several workers, so the readers can meet */
+static bool g_parallel;
+
+/** Number of runs of the system registered by REGISTRAR */
+static atomic_size_t g_late_runs;
+
+
+/** Current time in seconds on a monotonic clock */
+static double now_s(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+
+/** Allocate from the frame arena and check no other system was handed the
+ * same memory */
+static void use_frame_arena(cecs_world_t *world, const size_t system)
+{
+    size_t *allocs[N_ALLOCS];
+    for (size_t i = 0u; i < N_ALLOCS; ++i) {
+        allocs[i]    = cecs_frame_alloc(world, 8u * sizeof(size_t));
+        allocs[i][0] = system;
+        allocs[i][7] = i;
+    }
+    for (size_t i = 0u; i < N_ALLOCS; ++i) {
+        CHECK(allocs[i][0] == system && allocs[i][7] == i);
+    }
+}
+
+
+/** Record the start and end of every run of a system */
+static void run_system(cecs_world_t *world, void *ctx)
+{
+    const size_t system = (size_t)(uintptr_t)ctx;
+    g_started[system]   = atomic_fetch_add(&g_sequence, 1u);
+
+    use_frame_arena(world, system);
+
+    if (g_parallel && (system == READ_POSITION_A || system == READ_POSITION_B)) {
+        const size_t self = system - READ_POSITION_A;
+        atomic_store(&g_reader_arrived[self], true);
+
+        const double deadline = now_s() + 5.0;
+        while (!atomic_load(&g_reader_arrived[1u - self]) && now_s() < deadline) {
+        }
+        if (atomic_load(&g_reader_arrived[1u - self]) && self == 0u) {
+            g_readers_met = true;
+        }
+    }
+
+    g_ended[system] = atomic_fetch_add(&g_sequence, 1u);
+}
+
+
+/** Count the runs of the system registered during a frame */
+static void run_late_system(cecs_world_t *world, void *ctx)
+{
+    (void)world;
+    (void)ctx;
+    atomic_fetch_add(&g_late_runs, 1u);
+}
+
+
+/** Register another system from inside a frame, the first time it runs */
+static void run_registrar(cecs_world_t *world, void *ctx)
+{
+    static bool registered = false;
+    if (!registered) {
+        registered = true;
+        cecs_system_register(run_late_system, NULL, cecs_no_components(), cecs_no_components());
+    }
+
+    run_system(world, ctx);
+}
+
+
+/** Run frames, checking that conflicting systems never overlap and run in
+ * registration order */
+static void run_frames(cecs_world_t *world)
+{
+    for (size_t frame = 0u; frame < N_FRAMES; ++frame) {
+        atomic_store(&g_reader_arrived[0], false);
+        atomic_store(&g_reader_arrived[1], false);
+        g_readers_met = false;
+
+        cecs_progress(world);
+
+        for (size_t i = 0u; i < sizeof(g_conflicts) / sizeof(g_conflicts[0]); ++i) {
+            CHECK(g_ended[g_conflicts[i][0]] < g_started[g_conflicts[i][1]]);
+        }
+        CHECK(g_readers_met == g_parallel);
+    }
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_velocity_t);
+    CECS_COMPONENT(has_health_t);
+
+    cecs_world_t *world = cecs_world_create();
+
+    cecs_system_register(run_system, (void *)(uintptr_t)WRITE_POSITION, cecs_no_components(), cecs_writes(has_position_t));
+    cecs_system_register(run_system, (void *)(uintptr_t)READ_POSITION_A, cecs_reads(has_position_t), cecs_no_components());
+    cecs_system_register(run_system, (void *)(uintptr_t)READ_POSITION_B, cecs_reads(has_position_t), cecs_writes(has_health_t));
+    cecs_system_register(run_system, (void *)(uintptr_t)MOVE, cecs_reads(has_position_t), cecs_writes(has_velocity_t));
+    cecs_system_register(run_system, (void *)(uintptr_t)WRITE_POSITION_AGAIN, cecs_no_components(), cecs_writes(has_position_t));
+    cecs_system_register(run_system, (void *)(uintptr_t)READ_VELOCITY, cecs_reads(has_velocity_t), cecs_no_components());
+    cecs_system_register(run_registrar, (void *)(uintptr_t)REGISTRAR, cecs_no_components(), cecs_no_components());
+
+    /* A system registered from inside a frame runs from the next frame on */
+    cecs_set_worker_count(4u);
+    g_parallel = true;
+    cecs_progress(world);
+    CHECK(atomic_load(&g_late_runs) == 0u);
+    cecs_progress(world);
+    CHECK(atomic_load(&g_late_runs) == 1u);
+
+    run_frames(world);
+
+    /* With one worker every system runs in registration order */
+    cecs_set_worker_count(1u);
+    g_parallel = false;
+    run_frames(world);
+    for (size_t i = 1u; i < N_SYSTEMS; ++i) {
+        CHECK(g_ended[i - 1u] < g_started[i]);
+    }
+    CHECK(atomic_load(&g_late_runs) == 1u + 2u * N_FRAMES);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
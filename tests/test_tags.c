@@ -0,0 +1,137 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+#define N_ENTITIES 3000u
+
+
+static cecs_entity_t g_entities[N_ENTITIES];
+
+
+/** Count the entities an iterator over the given component returns */
+static size_t count_iterated(cecs_world_t *world, const cecs_component_t id)
+{
+    cecs_iter_t it;
+    _cecs_query(world, &it, 1u, id);
+
+    size_t count = 0u;
+    while (cecs_iter_next(&it)) {
+        ++count;
+    }
+
+    return count;
+}
+
+
+/** Count the rows the chunks of a query have enabled for the given component */
+static size_t count_enabled_rows(const cecs_query_t *query, const cecs_component_t id)
+{
+    cecs_chunk_iter_t it;
+    cecs_chunk_t chunk;
+    size_t count = 0u;
+    cecs_query_iter_chunks(query, &it);
+    while (cecs_chunk_next(&it, &chunk)) {
+        const uint64_t *bits = _cecs_chunk_enabled(&chunk, id);
+        for (size_t i = 0u; i < chunk.count; ++i) {
+            count += CECS_CHUNK_ROW_ENABLED(bits, i) ? 1u : 0u;
+        }
+    }
+
+    return count;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    cecs_world_t *world = cecs_world_create();
+    for (uint32_t i = 0u; i < N_ENTITIES; ++i) {
+        g_entities[i] = cecs_create_in(world, has_position_t, is_alive_t);
+        *cecs_get_in(world, g_entities[i], has_position_t) = (has_position_t){(int32_t)i, 0};
+    }
+    cecs_query_t *alive = cecs_query_create_in(world, is_alive_t);
+
+    /* Tags take part in signatures but hold no data */
+    cecs_memory_usage_t usage;
+    cecs_component_memory_in(world, is_alive_t, &usage);
+    CHECK(usage.used == 0u && usage.allocated == 0u);
+    CHECK(cecs_has_in(world, g_entities[0], is_alive_t));
+    CHECK(cecs_get_in(world, g_entities[0], is_alive_t) == NULL);
+    CHECK(cecs_query_count(alive) == N_ENTITIES);
+
+    /* Toggling a tag or a component leaves the entity and its data in place,
+     * and entity iterators skip it while it is disabled */
+    const has_position_t *position = cecs_get_const_in(world, g_entities[5], has_position_t);
+    cecs_disable_in(world, g_entities[5], is_alive_t);
+    cecs_disable_in(world, g_entities[7], has_position_t);
+    CHECK(cecs_get_const_in(world, g_entities[5], has_position_t) == position);
+    CHECK(!cecs_is_enabled_in(world, g_entities[5], is_alive_t));
+    CHECK(cecs_is_enabled_in(world, g_entities[5], has_position_t));
+    CHECK(cecs_has_in(world, g_entities[5], is_alive_t));
+
+    CHECK(count_iterated(world, CECS_ID_OF(is_alive_t)) == N_ENTITIES - 1u);
+    CHECK(count_iterated(world, CECS_ID_OF(has_position_t)) == N_ENTITIES - 1u);
+    CHECK(cecs_query_count(alive) == N_ENTITIES);
+    CHECK(count_enabled_rows(alive, CECS_ID_OF(is_alive_t)) == N_ENTITIES - 1u);
+
+    /* The enabled bits follow their entity when another row is swapped into a
+     * destroyed one, and when it moves to another archetype */
+    const cecs_entity_t last = g_entities[N_ENTITIES - 1u];
+    cecs_disable_in(world, last, is_alive_t);
+    CHECK(cecs_destroy_in(world, g_entities[0]));
+    CHECK(!cecs_is_enabled_in(world, last, is_alive_t));
+    CHECK(cecs_is_enabled_in(world, g_entities[1], is_alive_t));
+    CHECK(!cecs_is_enabled_in(world, g_entities[5], is_alive_t));
+    CHECK(!cecs_is_enabled_in(world, g_entities[7], has_position_t));
+    cecs_enable_in(world, last, is_alive_t);
+    CHECK(cecs_is_enabled_in(world, last, is_alive_t));
+
+    cecs_add_in(world, g_entities[5], has_health_t);
+    cecs_add_in(world, g_entities[7], has_health_t);
+    CHECK(!cecs_is_enabled_in(world, g_entities[5], is_alive_t));
+    CHECK(!cecs_is_enabled_in(world, g_entities[7], has_position_t));
+    CHECK(cecs_is_enabled_in(world, g_entities[7], has_health_t));
+    CHECK(cecs_get_const_in(world, g_entities[7], has_position_t)->x == 7);
+    CHECK(count_iterated(world, CECS_ID_OF(is_alive_t)) == N_ENTITIES - 2u);
+
+    /* Enabling restores the entity to iteration */
+    cecs_enable_in(world, g_entities[5], is_alive_t);
+    cecs_enable_in(world, g_entities[7], has_position_t);
+    CHECK(count_iterated(world, CECS_ID_OF(is_alive_t)) == N_ENTITIES - 1u);
+    CHECK(count_iterated(world, CECS_ID_OF(has_position_t)) == N_ENTITIES - 1u);
+    CHECK(count_enabled_rows(alive, CECS_ID_OF(is_alive_t)) == N_ENTITIES - 1u);
+
+    /* Toggling a component the entity doesn't have fails */
+    CHECK(!_cecs_set_enabled(world, g_entities[1], CECS_ID_OF(has_health_t), false));
+    CHECK(!cecs_is_enabled_in(world, g_entities[1], has_health_t));
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#include <stdint.h>
+
+#include <cecs/cecs.h>
+
+#include "test.h"
+
+
+typedef struct {
+    int32_t x, y;
+} has_position_t;
+
+typedef struct {
+    int32_t points;
+} has_health_t;
+
+typedef struct {
+} is_alive_t;
+
+CECS_COMPONENT_DECL(has_position_t);
+CECS_COMPONENT_DECL(has_health_t);
+CECS_COMPONENT_DECL(is_alive_t);
+
+CECS_COMPONENT_DEF(has_position_t);
+CECS_COMPONENT_DEF(has_health_t);
+CECS_COMPONENT_DEF(is_alive_t);
+
+#define N_EACH 100u
+
+
+/** Count the entities an iterator over the query returns */
+static size_t count_iterated(const cecs_query_t *query)
+{
+    cecs_iter_t it;
+    cecs_query_iter(query, &it);
+
+    size_t count = 0u;
+    while (cecs_iter_next(&it)) {
+        ++count;
+    }
+
+    return count;
+}
+
+
+int main(void)
+{
+    CECS_COMPONENT(has_position_t);
+    CECS_COMPONENT(has_health_t);
+    CECS_COMPONENT(is_alive_t);
+
+    /* Entities with a position only, a position and health, a position and the
+     * tag, and health only */
+    cecs_world_t *world = cecs_world_create();
+    cecs_entity_t armoured = CECS_ENTITY_INVALID;
+    for (uint32_t i = 0u; i < N_EACH; ++i) {
+        cecs_create_in(world, has_position_t);
+        armoured = cecs_create_in(world, has_position_t, has_health_t);
+        cecs_create_in(world, has_position_t, is_alive_t);
+        cecs_create_in(world, has_health_t);
+    }
+
+    cecs_query_t *dead = cecs_query_create_terms_in(
+        world, cecs_with(has_position_t), cecs_without(is_alive_t), cecs_no_components(), cecs_no_components()
+    );
+    cecs_query_t *maybe_healthy = cecs_query_create_terms_in(
+        world, cecs_with(has_position_t), cecs_no_components(), cecs_optional(has_health_t), cecs_no_components()
+    );
+    cecs_query_t *either = cecs_query_create_terms_in(
+        world, cecs_no_components(), cecs_no_components(), cecs_no_components(), cecs_any_of(has_health_t, is_alive_t)
+    );
+
+    /* Without excludes whole archetypes, optional adds none, and any-of needs
+     * at least one of its components */
+    CHECK(cecs_query_count(dead) == 2u * N_EACH);
+    CHECK(cecs_query_count(maybe_healthy) == 3u * N_EACH);
+    CHECK(cecs_query_count(either) == 3u * N_EACH);
+
+    /* Columns of optional components are NULL where they are missing */
+    cecs_chunk_iter_t it;
+    cecs_chunk_t chunk;
+    size_t n_with_health    = 0u;
+    size_t n_without_health = 0u;
+    cecs_query_iter_chunks(maybe_healthy, &it);
+    while (cecs_chunk_next(&it, &chunk)) {
+        CHECK(cecs_chunk_column_const(&chunk, has_position_t) != NULL);
+        if (cecs_chunk_column_const(&chunk, has_health_t)) {
+            n_with_health += chunk.count;
+        } else {
+            n_without_health += chunk.count;
+        }
+    }
+    CHECK(n_with_health == N_EACH && n_without_health == 2u * N_EACH);
+
+    /* Disabling an optional component doesn't skip the entity, unlike a
+     * required one */
+    cecs_disable_in(world, armoured, has_health_t);
+    CHECK(count_iterated(maybe_healthy) == 3u * N_EACH);
+    cecs_disable_in(world, armoured, has_position_t);
+    CHECK(count_iterated(maybe_healthy) == 3u * N_EACH - 1u);
+
+    /* Archetypes made after the queries are matched against their terms */
+    cecs_create_in(world, has_health_t, is_alive_t);
+    cecs_create_in(world, has_position_t, has_health_t, is_alive_t);
+    CHECK(cecs_query_count(dead) == 2u * N_EACH);
+    CHECK(cecs_query_count(maybe_healthy) == 3u * N_EACH + 1u);
+    CHECK(cecs_query_count(either) == 3u * N_EACH + 2u);
+
+    cecs_world_destroy(world);
+    cecs_shutdown();
+
+    return EXIT_SUCCESS;
+}